@@ -0,0 +1,89 @@
+/** @file
+ * @brief Bandwidth benchmark of the dense gradient reducers (flat `MPI_Iallreduce`, hierarchical intra-/inter-node reduction and PPGrad's own segmented ring allreduce) on a single gradient bucket.
+ * @details Every rank fills a bucket with `rank + 1`, sums it with each reducer and checks the result. The time per reduction and the algorithm bandwidth (bucket bytes / time) are reported for several bucket sizes.
+ * Nodes are simulated by grouping consecutive ranks (`ranksPerNode`, first command line argument, default 2), so on a single machine this compares the overheads of the two paths rather than network savings.
+ * Run with e.g. `make example_AllreduceBenchmark CXX=mpic++ DEBUG=0 NP=4`.
+ */
+
+#include "NN/GradReducers.hpp"
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <string>
+#include <cstdlib>
+#include <cmath>
+#include <mpi.h>
+
+constexpr int ITERATIONS = 20;
+
+int main(int argc, char **argv)
+{
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    int worldSize, worldRank;
+    MPI_Comm_size(MPI_COMM_WORLD, &worldSize);
+    MPI_Comm_rank(MPI_COMM_WORLD, &worldRank);
+    const int ranksPerNode = argc > 1 ? std::atoi(argv[1]) : 2;
+
+    // Reducers to compare
+    std::vector<std::pair<std::string, std::function<std::shared_ptr<PPNN::GradReducer<double>>()>>> reducers = {
+        {"flat", []()
+         { return std::make_shared<PPNN::AllreduceReducer<double>>(); }},
+        {"hierarchical", [ranksPerNode]()
+         { return std::make_shared<PPNN::HierarchicalReducer<double>>(ranksPerNode); }},
+        {"ring 16 KiB", []()
+         { return std::make_shared<PPNN::RingReducer<double>>(16 * 1024); }},
+        {"ring 256 KiB", []()
+         { return std::make_shared<PPNN::RingReducer<double>>(256 * 1024); }},
+        {"ring 4 MiB", []()
+         { return std::make_shared<PPNN::RingReducer<double>>(4 * 1024 * 1024); }},
+    };
+    const std::vector<size_t> sizes = {1 << 10, 1 << 14, 1 << 18, 1 << 22, 1000003}; // last one is not divisible by the number of ranks
+
+    if (worldRank == 0)
+    {
+        std::cout << worldSize << " ranks, " << ranksPerNode << " ranks per (simulated) node" << std::endl;
+        std::cout << std::left << std::setw(16) << "reducer" << std::setw(16) << "bucket [KiB]" << std::setw(16) << "time [us]" << "bandwidth [GB/s]" << std::endl;
+    }
+
+    const double expected = worldSize * (worldSize + 1) / 2.0;
+    for (auto &[name, makeReducer] : reducers)
+    {
+        std::shared_ptr<PPNN::GradReducer<double>> reducer = makeReducer();
+        for (size_t bucketIdx = 0; bucketIdx < sizes.size(); bucketIdx++)
+        {
+            PPNN::GradBucket<double> bucket;
+            bucket.size = sizes[bucketIdx];
+            bucket.buffers.assign(1, std::vector<double>(bucket.size));
+
+            double elapsed = 0.0;
+            bool correct = true;
+            for (int iteration = 0; iteration <= ITERATIONS; iteration++) // first iteration is warm-up
+            {
+                std::fill(bucket.buffers[0].begin(), bucket.buffers[0].end(), (double)(worldRank + 1));
+                MPI_Barrier(MPI_COMM_WORLD);
+                double begin = MPI_Wtime();
+                reducer->start(bucket, bucketIdx, 0, MPI_COMM_WORLD);
+                reducer->finish(bucket, bucketIdx, 0);
+                if (iteration > 0)
+                {
+                    elapsed += MPI_Wtime() - begin;
+                }
+                correct = correct && std::abs(bucket.buffers[0][bucket.size - 1] - expected) < 1e-9 && std::abs(bucket.buffers[0][0] - expected) < 1e-9;
+            }
+            MPI_Allreduce(MPI_IN_PLACE, &elapsed, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+
+            if (worldRank == 0)
+            {
+                const double seconds = elapsed / ITERATIONS;
+                std::cout << std::left << std::setw(16) << name << std::setw(16) << bucket.size * sizeof(double) / 1024 << std::setw(16) << seconds * 1e6
+                          << bucket.size * sizeof(double) / seconds / 1e9 << (correct ? "" : "  (WRONG RESULT)") << std::endl;
+            }
+        }
+    }
+
+    MPI_Finalize();
+    return 0;
+}
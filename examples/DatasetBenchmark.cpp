@@ -0,0 +1,79 @@
+/** @file
+ * @brief Reading a dataset into per-sample heap tensors vs. mapping it into memory and streaming batch views with background prefetch.
+ * @details Writes a dataset of `N` samples of `FEATURES` values to a temporary file, then reports the time to open the dataset and to pass over all batches
+ * (summing every value, as a stand-in for a training step) once with `PPGrad::readTensorDataset` and once with `PPGrad::MappedTensorDataset`, which prefetches
+ * the next batch while the current one is processed. Run with e.g. `make example_DatasetBenchmark DEBUG=0`.
+ */
+
+#include "TensorDataset.hpp"
+#include "Tensor/TensorBase.hpp"
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+constexpr int N = 200000;
+constexpr int FEATURES = 16;
+constexpr int BATCH_SIZE = 256;
+
+double seconds(std::chrono::steady_clock::time_point begin)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+int main()
+{
+    const std::string path = (std::filesystem::temp_directory_path() / "ppgrad_dataset_benchmark.ppds").string();
+    {
+        std::vector<Eigen::Tensor<double, 2>> samples(N, Eigen::Tensor<double, 2>(FEATURES, 1));
+        for (Eigen::Tensor<double, 2> &sample : samples)
+            sample.setRandom();
+        PPGrad::writeTensorDataset<2, double>(path, samples);
+    }
+
+    std::cout << std::left << std::setw(24) << "loader" << std::setw(16) << "open [ms]" << std::setw(16) << "epoch [ms]" << "sum" << std::endl;
+
+    // Per-sample heap tensors
+    {
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> samples = PPGrad::readTensorDataset<2, double>(path);
+        const double open = seconds(begin);
+
+        begin = std::chrono::steady_clock::now();
+        double sum = 0.0;
+        for (int b = 0; b < N; b += BATCH_SIZE)
+        {
+            std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> batch(samples.begin() + b, samples.begin() + std::min(b + BATCH_SIZE, N));
+            for (std::shared_ptr<PPGrad::TensorBase<2, double>> &sample : batch)
+            {
+                Eigen::Tensor<double, 0> total = sample->getData()->sum();
+                sum += total();
+            }
+        }
+        std::cout << std::left << std::setw(24) << "heap tensors" << std::setw(16) << open * 1e3 << std::setw(16) << seconds(begin) * 1e3 << sum << std::endl;
+    }
+
+    // Mapped file with batch views and prefetch
+    {
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        PPGrad::MappedTensorDataset<2, double> dataset(path);
+        const double open = seconds(begin);
+
+        begin = std::chrono::steady_clock::now();
+        double sum = 0.0;
+        dataset.prefetch(0, BATCH_SIZE);
+        for (size_t b = 0; b < dataset.size(); b += BATCH_SIZE)
+        {
+            dataset.prefetch(b + BATCH_SIZE, b + 2 * BATCH_SIZE);
+            Eigen::Tensor<double, 0> total = dataset.batch(b, std::min<size_t>(b + BATCH_SIZE, dataset.size())).sum();
+            sum += total();
+        }
+        std::cout << std::left << std::setw(24) << "mapped + prefetch" << std::setw(16) << open * 1e3 << std::setw(16) << seconds(begin) * 1e3 << sum << std::endl;
+    }
+
+    std::filesystem::remove(path);
+    return 0;
+}
@@ -0,0 +1,154 @@
+/** @file
+ * @brief Checkpoint-restart of `DPTrainer`: training resumes automatically from the last checkpoint, also with a different number of ranks.
+ * @details Trains a small MLP with Adam on the XOR problem for `EPOCHS` epochs in total, checkpointing every `CHECKPOINT_INTERVAL` syncs in the background (every rank writes its shard). The first command line argument stops
+ * the run after that many epochs (emulating a failed job); running again then continues from the checkpoint instead of starting over. The checkpoint is removed once training completes.
+ * Run with e.g. `mpirun -np 4 ./build/example_ElasticTraining 5` followed by `mpirun -np 2 ./build/example_ElasticTraining`.
+ */
+
+#include "NN/Model.hpp"
+#include "NN/Dense.hpp"
+#include "NN/Loss.hpp"
+#include "NN/Optimizer.hpp"
+#include "NN/WeightInitializers.hpp"
+#include "NN/DPTrainer.hpp"
+#include "Tensor/TensorBase.hpp"
+#include "TensorMPI.hpp"
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <random>
+#include <string>
+#include <cstdlib>
+#include <algorithm>
+#include <filesystem>
+#include <mpi.h>
+
+constexpr double LEARNING_RATE = 0.001;
+constexpr int HIDDEN_SIZE = 32;
+constexpr int EPOCHS = 20;
+constexpr int BATCH_SIZE = 10;
+constexpr int N = 840; // divisible into whole batches for 2, 3 and 4 ranks
+constexpr int CHECKPOINT_INTERVAL = 10;
+
+class MLP : public PPNN::Model<2, double>
+{
+private:
+    std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> params;
+    std::vector<std::shared_ptr<PPNN::Dense<2, double>>> layers;
+
+public:
+    MLP(int hiddenSize)
+    {
+        layers.push_back(std::make_shared<PPNN::Dense<2, double>>(2, hiddenSize, PPNN::WeightInititializers::XAVIER, PPNN::Activations::ReLU));
+        layers.push_back(std::make_shared<PPNN::Dense<2, double>>(hiddenSize, hiddenSize, PPNN::WeightInititializers::XAVIER, PPNN::Activations::ReLU));
+        layers.push_back(std::make_shared<PPNN::Dense<2, double>>(hiddenSize, 1, PPNN::WeightInititializers::XAVIER, PPNN::Activations::Linear));
+        for (std::shared_ptr<PPNN::Dense<2, double>> &layer : layers)
+        {
+            params.insert(params.end(), layer->getParams().begin(), layer->getParams().end());
+        }
+    }
+
+    std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> forward(std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> inputs) override
+    {
+        std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> outputs = inputs;
+        for (std::shared_ptr<PPNN::Dense<2, double>> &layer : layers)
+        {
+            outputs = layer->forward(outputs);
+        }
+        return outputs;
+    }
+
+    std::shared_ptr<PPGrad::TensorBase<2, double>> forward(std::shared_ptr<PPGrad::TensorBase<2, double>> input) override
+    {
+        std::shared_ptr<PPGrad::TensorBase<2, double>> output = input;
+        for (std::shared_ptr<PPNN::Dense<2, double>> &layer : layers)
+        {
+            output = layer->forward(output);
+        }
+        return output;
+    }
+
+    std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> &getParams() override
+    {
+        return params;
+    }
+
+    void setParams(std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> &params) override
+    {
+        this->params = params;
+    }
+};
+
+int main(int argc, char **argv)
+{
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    int worldSize, worldRank;
+    MPI_Comm_size(MPI_COMM_WORLD, &worldSize);
+    MPI_Comm_rank(MPI_COMM_WORLD, &worldRank);
+    const int stopAfter = argc > 1 ? std::atoi(argv[1]) : EPOCHS;
+
+    // XOR data, written once and read back as strided shards, so a restart with a different number of ranks continues at the same global sample
+    const std::string inputsPath = (std::filesystem::temp_directory_path() / "ppgrad_elastic_inputs.ppds").string();
+    const std::string targetsPath = (std::filesystem::temp_directory_path() / "ppgrad_elastic_targets.ppds").string();
+    const std::string checkpointDirectory = (std::filesystem::temp_directory_path() / "ppgrad_elastic_checkpoints").string();
+    if (worldRank == 0 && !std::filesystem::exists(inputsPath))
+    {
+        std::vector<Eigen::Tensor<double, 2>> inputsEigen;
+        std::vector<Eigen::Tensor<double, 2>> targetsEigen;
+        std::mt19937 gen(42);
+        std::bernoulli_distribution bit(0.5);
+        for (int i = 0; i < N; i++)
+        {
+            Eigen::Tensor<double, 2> input(2, 1);
+            Eigen::Tensor<double, 2> target(1, 1);
+            double a = bit(gen) ? 1.0 : 0.0;
+            double b = bit(gen) ? 1.0 : 0.0;
+            input.setValues({{a}, {b}});
+            target.setValues({{a + b == 1.0 ? 1.0 : 0.0}});
+            inputsEigen.push_back(input);
+            targetsEigen.push_back(target);
+        }
+        PPGrad::writeTensorDataset<2, double>(inputsPath, inputsEigen);
+        PPGrad::writeTensorDataset<2, double>(targetsPath, targetsEigen);
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+    std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> inputs = PPGrad::readTensorShard<2, double>(inputsPath, worldSize, worldRank, PPGrad::ShardModes::STRIDED);
+    std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> targets = PPGrad::readTensorShard<2, double>(targetsPath, worldSize, worldRank, PPGrad::ShardModes::STRIDED);
+
+    std::shared_ptr<PPNN::Model<2, double>> model = std::make_shared<MLP>(HIDDEN_SIZE);
+    model = PPGrad::modelBroadcast<2, double>(model, worldSize, worldRank);
+    std::shared_ptr<PPNN::Optimizer<2, double>> optimizer = std::make_shared<PPNN::Adam<2, double>>(LEARNING_RATE);
+    std::shared_ptr<PPNN::Loss<2, double>> loss = std::make_shared<PPNN::MSE<2, double>>();
+
+    PPNN::DPTrainer<2, double> trainer(model, optimizer, loss, 1, true);
+    trainer.setCheckpointing(checkpointDirectory, CHECKPOINT_INTERVAL);
+    if (worldRank == 0 && PPNN::AsyncCheckpointer<2, double>::exists(checkpointDirectory))
+    {
+        PPNN::MappedCheckpoint<2, double> manifest((std::filesystem::path(checkpointDirectory) / "manifest.ckpt").string());
+        std::cout << "Resuming checkpoint " << manifest.counter("step") << " (" << manifest.counter("numShards") << " shards) at epoch " << manifest.counter("epoch")
+                  << ", sample " << manifest.counter("position") << " on " << worldSize << " ranks." << std::endl;
+    }
+    trainer.train(inputs, targets, std::min(stopAfter, EPOCHS), BATCH_SIZE);
+
+    // Final training loss, averaged over all ranks
+    std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> predictions = model->forward(inputs);
+    double finalLoss = loss->operator()(predictions, targets) / worldSize;
+    MPI_Allreduce(MPI_IN_PLACE, &finalLoss, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    if (worldRank == 0)
+    {
+        const PPNN::CheckpointStats &stats = *trainer.getCheckpointStats();
+        std::cout << "Loss after " << std::min(stopAfter, EPOCHS) << " epochs on " << worldSize << " ranks: " << finalLoss << std::endl;
+        std::cout << stats.committed << " checkpoints committed, rank 0 wrote " << stats.bytesWritten << " bytes in " << stats.writeTime * 1e3 << " ms in the background and blocked training for "
+                  << stats.blockedTime * 1e3 << " ms." << std::endl;
+        if (stopAfter >= EPOCHS)
+        {
+            std::filesystem::remove_all(checkpointDirectory);
+            std::filesystem::remove(inputsPath);
+            std::filesystem::remove(targetsPath);
+        }
+    }
+
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,191 @@
+/** @file
+ * @brief Compare the gradient reducers of `DPTrainer` (dense allreduce vs. compressed ones), per-thread model replicas and DiLoCo-style local SGD on the same model and data.
+ * @details Trains a small MLP on the XOR problem once per configuration, starting from identical weights, and reports the final training loss (averaged over all ranks), the payload bytes every rank sent for gradient synchronization and the training time.
+ * Run with e.g. `make example_GradSyncBenchmark CXX=mpic++ DEBUG=0 NP=2`.
+ */
+
+#include "NN/Model.hpp"
+#include "NN/Dense.hpp"
+#include "NN/Loss.hpp"
+#include "NN/Optimizer.hpp"
+#include "NN/WeightInitializers.hpp"
+#include "NN/DPTrainer.hpp"
+#include "NN/GradReducers.hpp"
+#include "Tensor/TensorBase.hpp"
+#include "TensorMPI.hpp"
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <memory>
+#include <random>
+#include <functional>
+#include <string>
+#include <filesystem>
+#include <mpi.h>
+
+constexpr double LEARNING_RATE = 0.01;
+constexpr double OUTER_LEARNING_RATE = 0.7; // DiLoCo defaults
+constexpr double OUTER_MOMENTUM = 0.9;
+constexpr int HIDDEN_SIZE = 32;
+constexpr int EPOCHS = 20;
+constexpr int BATCH_SIZE = 40;
+constexpr int N = 800;
+constexpr size_t BUCKET_SIZE_BYTES = 4096;
+
+class MLP : public PPNN::Model<2, double>
+{
+private:
+    std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> params;
+    std::vector<std::shared_ptr<PPNN::Dense<2, double>>> layers;
+
+public:
+    MLP(int hiddenSize)
+    {
+        layers.push_back(std::make_shared<PPNN::Dense<2, double>>(2, hiddenSize, PPNN::WeightInititializers::XAVIER, PPNN::Activations::ReLU));
+        layers.push_back(std::make_shared<PPNN::Dense<2, double>>(hiddenSize, hiddenSize, PPNN::WeightInititializers::XAVIER, PPNN::Activations::ReLU));
+        layers.push_back(std::make_shared<PPNN::Dense<2, double>>(hiddenSize, 1, PPNN::WeightInititializers::XAVIER, PPNN::Activations::Linear));
+        for (std::shared_ptr<PPNN::Dense<2, double>> &layer : layers)
+        {
+            params.insert(params.end(), layer->getParams().begin(), layer->getParams().end());
+        }
+    }
+
+    std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> forward(std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> inputs) override
+    {
+        std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> outputs = inputs;
+        for (std::shared_ptr<PPNN::Dense<2, double>> &layer : layers)
+        {
+            outputs = layer->forward(outputs);
+        }
+        return outputs;
+    }
+
+    std::shared_ptr<PPGrad::TensorBase<2, double>> forward(std::shared_ptr<PPGrad::TensorBase<2, double>> input) override
+    {
+        std::shared_ptr<PPGrad::TensorBase<2, double>> output = input;
+        for (std::shared_ptr<PPNN::Dense<2, double>> &layer : layers)
+        {
+            output = layer->forward(output);
+        }
+        return output;
+    }
+
+    std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> &getParams() override
+    {
+        return params;
+    }
+
+    void setParams(std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> &params) override
+    {
+        this->params = params;
+    }
+};
+
+int main()
+{
+    int provided;
+    MPI_Init_thread(NULL, NULL, MPI_THREAD_FUNNELED, &provided);
+    int worldSize, worldRank;
+    MPI_Comm_size(MPI_COMM_WORLD, &worldSize);
+    MPI_Comm_rank(MPI_COMM_WORLD, &worldRank);
+
+    // XOR data, generated on root and written to dataset files every rank reads its own shard from
+    const std::string inputsPath = (std::filesystem::temp_directory_path() / "ppgrad_xor_inputs.ppds").string();
+    const std::string targetsPath = (std::filesystem::temp_directory_path() / "ppgrad_xor_targets.ppds").string();
+    if (worldRank == 0)
+    {
+        std::vector<Eigen::Tensor<double, 2>> inputsEigen;
+        std::vector<Eigen::Tensor<double, 2>> targetsEigen;
+        std::mt19937 gen(42);
+        std::bernoulli_distribution bit(0.5);
+        for (int i = 0; i < N; i++)
+        {
+            Eigen::Tensor<double, 2> input(2, 1);
+            Eigen::Tensor<double, 2> target(1, 1);
+            double a = bit(gen) ? 1.0 : 0.0;
+            double b = bit(gen) ? 1.0 : 0.0;
+            input.setValues({{a}, {b}});
+            target.setValues({{a + b == 1.0 ? 1.0 : 0.0}});
+            inputsEigen.push_back(input);
+            targetsEigen.push_back(target);
+        }
+        PPGrad::writeTensorDataset<2, double>(inputsPath, inputsEigen);
+        PPGrad::writeTensorDataset<2, double>(targetsPath, targetsEigen);
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+    std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> inputs = PPGrad::readTensorShard<2, double>(inputsPath, worldSize, worldRank, PPGrad::ShardModes::STRIDED);
+    std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> targets = PPGrad::readTensorShard<2, double>(targetsPath, worldSize, worldRank, PPGrad::ShardModes::STRIDED);
+
+    // Configurations to compare: name, gradSyncFreq and setup of the trainer
+    struct Config
+    {
+        std::string name;
+        int32_t gradSyncFreq;
+        std::function<void(PPNN::DPTrainer<2, double> &)> setup;
+    };
+    std::vector<Config> configs = {
+        {"dense allreduce", 1, [](PPNN::DPTrainer<2, double> &trainer)
+         { trainer.setGradReducer(std::make_shared<PPNN::AllreduceReducer<double>>()); }},
+        {"dense, thread replicas", 1, [](PPNN::DPTrainer<2, double> &trainer)
+         { trainer.setThreadReplicas(); }},
+        {"hierarchical", 1, [](PPNN::DPTrainer<2, double> &trainer)
+         { trainer.setGradReducer(std::make_shared<PPNN::HierarchicalReducer<double>>()); }},
+        {"ring allreduce", 1, [](PPNN::DPTrainer<2, double> &trainer)
+         { trainer.setGradReducer(std::make_shared<PPNN::RingReducer<double>>(1024)); }},
+        {"top-k 10%", 1, [](PPNN::DPTrainer<2, double> &trainer)
+         { trainer.setGradReducer(std::make_shared<PPNN::TopKReducer<double>>(0.1)); }},
+        {"top-k 1%", 1, [](PPNN::DPTrainer<2, double> &trainer)
+         { trainer.setGradReducer(std::make_shared<PPNN::TopKReducer<double>>(0.01)); }},
+        {"bf16 allreduce", 1, [](PPNN::DPTrainer<2, double> &trainer)
+         { trainer.setGradReducer(std::make_shared<PPNN::LowPrecisionReducer<double>>(PPNN::CommPrecisions::BF16)); }},
+        {"fp16 allreduce", 1, [](PPNN::DPTrainer<2, double> &trainer)
+         { trainer.setGradReducer(std::make_shared<PPNN::LowPrecisionReducer<double>>(PPNN::CommPrecisions::FP16)); }},
+        {"powerSGD rank 1", 1, [](PPNN::DPTrainer<2, double> &trainer)
+         { trainer.setGradReducer(std::make_shared<PPNN::PowerSGDReducer<double>>(1)); }},
+        {"powerSGD rank 4", 1, [](PPNN::DPTrainer<2, double> &trainer)
+         { trainer.setGradReducer(std::make_shared<PPNN::PowerSGDReducer<double>>(4)); }},
+        {"DiLoCo H=10", 10, [](PPNN::DPTrainer<2, double> &trainer)
+         { trainer.setLocalSGD(std::make_shared<PPNN::NesterovSGD<2, double>>(OUTER_LEARNING_RATE, OUTER_MOMENTUM)); }},
+        {"DiLoCo H=50", 50, [](PPNN::DPTrainer<2, double> &trainer)
+         { trainer.setLocalSGD(std::make_shared<PPNN::NesterovSGD<2, double>>(OUTER_LEARNING_RATE, OUTER_MOMENTUM)); }},
+    };
+
+    if (worldRank == 0)
+    {
+        std::cout << std::left << std::setw(24) << "configuration" << std::setw(16) << "final loss" << std::setw(20) << "bytes sent/rank" << "time [ms]" << std::endl;
+    }
+
+    std::shared_ptr<PPNN::Loss<2, double>> loss = std::make_shared<PPNN::MSE<2, double>>();
+    for (Config &config : configs)
+    {
+        std::shared_ptr<PPNN::Model<2, double>> model = std::make_shared<MLP>(HIDDEN_SIZE);
+        model = PPGrad::modelBroadcast<2, double>(model, worldSize, worldRank);
+        std::shared_ptr<PPNN::Optimizer<2, double>> optimizer = std::make_shared<PPNN::SGD<2, double>>(LEARNING_RATE);
+
+        PPNN::DPTrainer<2, double> trainer(model, optimizer, loss, config.gradSyncFreq, true, BUCKET_SIZE_BYTES);
+        config.setup(trainer);
+
+        double begin = MPI_Wtime();
+        trainer.train(inputs, targets, EPOCHS, BATCH_SIZE);
+        double elapsed = MPI_Wtime() - begin;
+
+        // Final training loss, averaged over all ranks
+        std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> predictions = model->forward(inputs);
+        double finalLoss = loss->operator()(predictions, targets) / worldSize;
+        MPI_Allreduce(MPI_IN_PLACE, &finalLoss, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+
+        if (worldRank == 0)
+        {
+            std::cout << std::left << std::setw(24) << config.name << std::setw(16) << finalLoss << std::setw(20) << trainer.getGradReducer()->getBytesSent() << elapsed * 1e3 << std::endl;
+        }
+    }
+
+    if (worldRank == 0)
+    {
+        std::filesystem::remove(inputsPath);
+        std::filesystem::remove(targetsPath);
+    }
+
+    MPI_Finalize();
+    return 0;
+}
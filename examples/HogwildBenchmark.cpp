@@ -0,0 +1,140 @@
+/** @file
+ * @brief Single-node throughput of serial `Trainer` training vs. lock-free Hogwild training with an increasing number of OpenMP threads.
+ * @details Trains a small MLP on the XOR problem with plain SGD, starting from identical weights for every configuration, and reports the samples per second and the final training loss.
+ * Hogwild runs with 1, 2, 4, ... threads up to `omp_get_max_threads()` (set `OMP_NUM_THREADS` to the number of cores).
+ * Run with e.g. `make example_HogwildBenchmark DEBUG=0`.
+ */
+
+#include "NN/Model.hpp"
+#include "NN/Dense.hpp"
+#include "NN/Loss.hpp"
+#include "NN/Optimizer.hpp"
+#include "NN/WeightInitializers.hpp"
+#include "NN/Trainer.hpp"
+#include "Tensor/TensorBase.hpp"
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <memory>
+#include <random>
+#include <string>
+#include <omp.h>
+
+constexpr double LEARNING_RATE = 0.01;
+constexpr int HIDDEN_SIZE = 32;
+constexpr int EPOCHS = 20;
+constexpr int BATCH_SIZE = 4;
+constexpr int N = 2000;
+
+class MLP : public PPNN::Model<2, double>
+{
+private:
+    std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> params;
+    std::vector<std::shared_ptr<PPNN::Dense<2, double>>> layers;
+
+public:
+    MLP(int hiddenSize)
+    {
+        layers.push_back(std::make_shared<PPNN::Dense<2, double>>(2, hiddenSize, PPNN::WeightInititializers::XAVIER, PPNN::Activations::ReLU));
+        layers.push_back(std::make_shared<PPNN::Dense<2, double>>(hiddenSize, hiddenSize, PPNN::WeightInititializers::XAVIER, PPNN::Activations::ReLU));
+        layers.push_back(std::make_shared<PPNN::Dense<2, double>>(hiddenSize, 1, PPNN::WeightInititializers::XAVIER, PPNN::Activations::Linear));
+        for (std::shared_ptr<PPNN::Dense<2, double>> &layer : layers)
+        {
+            params.insert(params.end(), layer->getParams().begin(), layer->getParams().end());
+        }
+    }
+
+    std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> forward(std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> inputs) override
+    {
+        std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> outputs = inputs;
+        for (std::shared_ptr<PPNN::Dense<2, double>> &layer : layers)
+        {
+            outputs = layer->forward(outputs);
+        }
+        return outputs;
+    }
+
+    std::shared_ptr<PPGrad::TensorBase<2, double>> forward(std::shared_ptr<PPGrad::TensorBase<2, double>> input) override
+    {
+        std::shared_ptr<PPGrad::TensorBase<2, double>> output = input;
+        for (std::shared_ptr<PPNN::Dense<2, double>> &layer : layers)
+        {
+            output = layer->forward(output);
+        }
+        return output;
+    }
+
+    std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> &getParams() override
+    {
+        return params;
+    }
+
+    void setParams(std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> &params) override
+    {
+        this->params = params;
+    }
+};
+
+int main()
+{
+    // XOR data
+    std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> inputs;
+    std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> targets;
+    std::mt19937 gen(42);
+    std::bernoulli_distribution bit(0.5);
+    for (int i = 0; i < N; i++)
+    {
+        Eigen::Tensor<double, 2> input(2, 1);
+        Eigen::Tensor<double, 2> target(1, 1);
+        double a = bit(gen) ? 1.0 : 0.0;
+        double b = bit(gen) ? 1.0 : 0.0;
+        input.setValues({{a}, {b}});
+        target.setValues({{a + b == 1.0 ? 1.0 : 0.0}});
+        inputs.push_back(std::make_shared<PPGrad::Tensor<2, double>>(std::make_shared<Eigen::Tensor<double, 2>>(input)));
+        targets.push_back(std::make_shared<PPGrad::Tensor<2, double>>(std::make_shared<Eigen::Tensor<double, 2>>(target)));
+    }
+
+    // Identical initial weights for every configuration
+    MLP initialModel(HIDDEN_SIZE);
+    std::vector<Eigen::Tensor<double, 2>> initialWeights;
+    for (std::shared_ptr<PPGrad::TensorBase<2, double>> &param : initialModel.getParams())
+    {
+        initialWeights.push_back(*param->getData());
+    }
+
+    // Configurations to compare: name and number of Hogwild threads (0 = serial trainer)
+    std::vector<std::pair<std::string, int>> configs = {{"serial", 0}};
+    for (int threads = 1; threads <= omp_get_max_threads(); threads *= 2)
+    {
+        configs.emplace_back("hogwild " + std::to_string(threads) + " threads", threads);
+    }
+
+    std::cout << std::left << std::setw(24) << "configuration" << std::setw(16) << "samples/s" << "final loss" << std::endl;
+
+    std::shared_ptr<PPNN::Loss<2, double>> loss = std::make_shared<PPNN::MSE<2, double>>();
+    for (auto &[name, threads] : configs)
+    {
+        std::shared_ptr<PPNN::Model<2, double>> model = std::make_shared<MLP>(HIDDEN_SIZE);
+        for (size_t i = 0; i < initialWeights.size(); i++)
+        {
+            *model->getParams()[i]->getData() = initialWeights[i];
+        }
+        std::shared_ptr<PPNN::Optimizer<2, double>> optimizer = std::make_shared<PPNN::SGD<2, double>>(LEARNING_RATE);
+
+        PPNN::Trainer<2, double> trainer(model, optimizer, loss);
+        if (threads > 0)
+        {
+            trainer.setHogwild();
+            omp_set_num_threads(threads);
+        }
+
+        double begin = omp_get_wtime();
+        trainer.train(inputs, targets, EPOCHS, BATCH_SIZE);
+        double elapsed = omp_get_wtime() - begin;
+
+        std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> predictions = model->forward(inputs);
+        std::cout << std::left << std::setw(24) << name << std::setw(16) << EPOCHS * N / elapsed << loss->operator()(predictions, targets) << std::endl;
+    }
+
+    return 0;
+}
@@ -41,6 +41,7 @@ constexpr int HIDDEN_SIZE = 8;
 constexpr int EPOCHS = 500;
 constexpr int BATCH_SIZE = 40;
 constexpr int N = 800;
+constexpr size_t BUCKET_SIZE_BYTES = 512; // tiny model, so use tiny buckets to get several of them
 constexpr LogicalOperator LOGICAL_OPERATOR = LogicalOperator::OR;
 
 class LogicalNN : public PPNN::Model<2, double>
@@ -128,8 +129,9 @@ int main()
     std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> targets;
     std::chrono::steady_clock::time_point begin;
 #ifdef USE_MPI
-    // // Initialize MPI
-    MPI_Init(NULL, NULL);
+    // // Initialize MPI (only the OpenMP master thread talks to MPI)
+    int provided;
+    MPI_Init_thread(NULL, NULL, MPI_THREAD_FUNNELED, &provided);
     int worldSize, worldRank;
     MPI_Comm_size(MPI_COMM_WORLD, &worldSize);
     MPI_Comm_rank(MPI_COMM_WORLD, &worldRank);
@@ -212,7 +214,7 @@ int main()
 
     // // Broadcast the model parameters
 
-    model = PPGrad::modelBroadcast<2, double>(model, worldSize, worldRank);
+    model = PPGrad::modelBroadcast<2, double>(model, worldSize, worldRank, true);
 
 #ifdef PPGRAD_DEBUG
     // print 10 params from each parameter tensor
@@ -228,7 +230,7 @@ int main()
 
 #ifdef USE_MPI
     // // Create trainer
-    std::shared_ptr<PPNN::DPTrainer<2, double>> trainer = std::make_shared<PPNN::DPTrainer<2, double>>(model, optimizer, loss, 16, true);
+    std::shared_ptr<PPNN::DPTrainer<2, double>> trainer = std::make_shared<PPNN::DPTrainer<2, double>>(model, optimizer, loss, 16, true, BUCKET_SIZE_BYTES);
 #else
     std::shared_ptr<PPNN::Trainer<2, double>> trainer = std::make_shared<PPNN::Trainer<2, double>>(model, optimizer, loss);
 #endif
@@ -0,0 +1,183 @@
+/** @file
+ * @brief Compare the throughput of synchronous data parallel training (`DPTrainer`) and asynchronous parameter-server training (`PSTrainer`) when one rank is artificially slowed down.
+ * @details The last rank sleeps `SLOW_DELAY_US` per sample in forward(). Every worker trains on its strided shard of the XOR data for the same number of epochs, starting from identical weights.
+ * Reported are the aggregate throughput (sum over the workers of samples / own training time), the slowest worker's training time and the final training loss on the full data.
+ * `DPTrainer` waits for the slow rank at every sync, the parameter server only holds fast workers back once they are more than `staleness` steps ahead.
+ * Run with e.g. `make example_PSBenchmark CXX=mpic++ DEBUG=0 NP=4`.
+ */
+
+#include "NN/Model.hpp"
+#include "NN/Dense.hpp"
+#include "NN/Loss.hpp"
+#include "NN/Optimizer.hpp"
+#include "NN/WeightInitializers.hpp"
+#include "NN/DPTrainer.hpp"
+#include "NN/PSTrainer.hpp"
+#include "Tensor/TensorBase.hpp"
+#include "TensorMPI.hpp"
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <mpi.h>
+
+constexpr double LEARNING_RATE = 0.01;
+constexpr int HIDDEN_SIZE = 32;
+constexpr int EPOCHS = 10;
+constexpr int BATCH_SIZE = 20;
+constexpr int N = 1200;
+constexpr int SLOW_DELAY_US = 200;
+
+/// MLP whose forward pass is artificially slowed down by `delayUs` per sample (to emulate a slow node).
+class SlowMLP : public PPNN::Model<2, double>
+{
+private:
+    std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> params;
+    std::vector<std::shared_ptr<PPNN::Dense<2, double>>> layers;
+    int delayUs = 0;
+
+public:
+    SlowMLP(int hiddenSize)
+    {
+        layers.push_back(std::make_shared<PPNN::Dense<2, double>>(2, hiddenSize, PPNN::WeightInititializers::XAVIER, PPNN::Activations::ReLU));
+        layers.push_back(std::make_shared<PPNN::Dense<2, double>>(hiddenSize, hiddenSize, PPNN::WeightInititializers::XAVIER, PPNN::Activations::ReLU));
+        layers.push_back(std::make_shared<PPNN::Dense<2, double>>(hiddenSize, 1, PPNN::WeightInititializers::XAVIER, PPNN::Activations::Linear));
+        for (std::shared_ptr<PPNN::Dense<2, double>> &layer : layers)
+        {
+            params.insert(params.end(), layer->getParams().begin(), layer->getParams().end());
+        }
+    }
+
+    std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> forward(std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> inputs) override
+    {
+        std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> outputs = inputs;
+        for (std::shared_ptr<PPNN::Dense<2, double>> &layer : layers)
+        {
+            outputs = layer->forward(outputs);
+        }
+        return outputs;
+    }
+
+    void setDelay(int delayUs)
+    {
+        this->delayUs = delayUs;
+    }
+
+    std::shared_ptr<PPGrad::TensorBase<2, double>> forward(std::shared_ptr<PPGrad::TensorBase<2, double>> input) override
+    {
+        if (delayUs > 0)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(delayUs));
+        }
+        std::shared_ptr<PPGrad::TensorBase<2, double>> output = input;
+        for (std::shared_ptr<PPNN::Dense<2, double>> &layer : layers)
+        {
+            output = layer->forward(output);
+        }
+        return output;
+    }
+
+    std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> &getParams() override
+    {
+        return params;
+    }
+
+    void setParams(std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> &params) override
+    {
+        this->params = params;
+    }
+};
+
+int main()
+{
+    int provided;
+    MPI_Init_thread(NULL, NULL, MPI_THREAD_FUNNELED, &provided);
+    int worldSize, worldRank;
+    MPI_Comm_size(MPI_COMM_WORLD, &worldSize);
+    MPI_Comm_rank(MPI_COMM_WORLD, &worldRank);
+    const bool slow = worldRank == worldSize - 1;
+
+    // XOR data (same on every rank, every worker picks its own strided shard)
+    std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> inputs;
+    std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> targets;
+    std::mt19937 gen(42);
+    std::bernoulli_distribution bit(0.5);
+    for (int i = 0; i < N; i++)
+    {
+        double a = bit(gen) ? 1.0 : 0.0;
+        double b = bit(gen) ? 1.0 : 0.0;
+        std::shared_ptr<Eigen::Tensor<double, 2>> input = std::make_shared<Eigen::Tensor<double, 2>>(2, 1);
+        std::shared_ptr<Eigen::Tensor<double, 2>> target = std::make_shared<Eigen::Tensor<double, 2>>(1, 1);
+        input->setValues({{a}, {b}});
+        target->setValues({{a + b == 1.0 ? 1.0 : 0.0}});
+        inputs.push_back(std::make_shared<PPGrad::Tensor<2, double>>(input));
+        targets.push_back(std::make_shared<PPGrad::Tensor<2, double>>(target));
+    }
+    auto shard = [&](const std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> &data, int index, int count)
+    {
+        std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> result;
+        for (size_t i = index; index >= 0 && i + count - index <= data.size(); i += count)
+            result.push_back(data[i]);
+        return result;
+    };
+
+    if (worldRank == 0)
+    {
+        std::cout << worldSize << " ranks, rank " << worldSize - 1 << " slowed down by " << SLOW_DELAY_US << " us per sample" << std::endl;
+        std::cout << std::left << std::setw(24) << "trainer" << std::setw(20) << "samples/s" << std::setw(20) << "slowest [ms]" << "final loss" << std::endl;
+    }
+
+    std::shared_ptr<PPNN::Loss<2, double>> loss = std::make_shared<PPNN::MSE<2, double>>();
+    auto report = [&](const std::string &name, std::shared_ptr<PPNN::Model<2, double>> model, bool worker, size_t samples, double seconds)
+    {
+        double rates[2] = {worker ? samples / seconds : 0.0, seconds};
+        MPI_Allreduce(MPI_IN_PLACE, &rates[0], 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+        MPI_Allreduce(MPI_IN_PLACE, &rates[1], 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+        std::shared_ptr<SlowMLP> mlp = std::static_pointer_cast<SlowMLP>(model);
+        mlp->setDelay(0);
+        double finalLoss = loss->operator()(model->forward(inputs), targets);
+        if (worldRank == 0)
+        {
+            std::cout << std::left << std::setw(24) << name << std::setw(20) << rates[0] << std::setw(20) << rates[1] * 1e3 << finalLoss << std::endl;
+        }
+    };
+
+    // Synchronous data parallel baseline: every rank is a worker
+    {
+        std::shared_ptr<PPNN::Model<2, double>> model = std::make_shared<SlowMLP>(HIDDEN_SIZE);
+        model = PPGrad::modelBroadcast<2, double>(model, worldSize, worldRank);
+        std::static_pointer_cast<SlowMLP>(model)->setDelay(slow ? SLOW_DELAY_US : 0);
+        std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> localInputs = shard(inputs, worldRank, worldSize);
+        std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> localTargets = shard(targets, worldRank, worldSize);
+
+        PPNN::DPTrainer<2, double> trainer(model, std::make_shared<PPNN::SGD<2, double>>(LEARNING_RATE), loss, 1, true);
+        MPI_Barrier(MPI_COMM_WORLD);
+        double begin = MPI_Wtime();
+        trainer.train(localInputs, localTargets, EPOCHS, BATCH_SIZE);
+        report("DPTrainer", model, true, EPOCHS * localInputs.size(), MPI_Wtime() - begin);
+    }
+
+    // Parameter server (rank 0) with different staleness bounds
+    for (int32_t staleness : {0, 4, 1000000})
+    {
+        std::shared_ptr<PPNN::Model<2, double>> model = std::make_shared<SlowMLP>(HIDDEN_SIZE);
+        model = PPGrad::modelBroadcast<2, double>(model, worldSize, worldRank);
+        std::static_pointer_cast<SlowMLP>(model)->setDelay(slow ? SLOW_DELAY_US : 0);
+
+        PPNN::PSTrainer<2, double> trainer(model, std::make_shared<PPNN::SGD<2, double>>(LEARNING_RATE), loss, 1, staleness);
+        std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> localInputs = shard(inputs, trainer.workerIndex(), trainer.getNumWorkers());
+        std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> localTargets = shard(targets, trainer.workerIndex(), trainer.getNumWorkers());
+        MPI_Barrier(MPI_COMM_WORLD);
+        trainer.train(localInputs, localTargets, EPOCHS, BATCH_SIZE);
+
+        const std::string name = "PS staleness " + (staleness > 1000 ? std::string("inf") : std::to_string(staleness));
+        report(name, model, !trainer.isServer(), trainer.getStats().samples, trainer.getStats().trainTime);
+    }
+
+    MPI_Finalize();
+    return 0;
+}
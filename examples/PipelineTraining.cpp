@@ -0,0 +1,93 @@
+/** @file
+ * @brief Pipeline-parallel training of a deep MLP with `PipelineTrainer`: every rank constructs and trains only its own stage of the layers.
+ * @details Trains on the XOR problem once per number of micro-batches and reports the final training loss and the pipeline bubble (idle fraction averaged over the stages,
+ * next to the ideal 1F1B bubble), which shrinks as a batch is split into more micro-batches.
+ * Run with e.g. `mpirun -np 4 ./build/example_PipelineTraining`.
+ */
+
+#include "NN/Dense.hpp"
+#include "NN/Loss.hpp"
+#include "NN/Optimizer.hpp"
+#include "NN/WeightInitializers.hpp"
+#include "NN/PipelineTrainer.hpp"
+#include "Tensor/TensorBase.hpp"
+#include "Tensor/Tensor.hpp"
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <memory>
+#include <random>
+#include <mpi.h>
+
+constexpr double LEARNING_RATE = 0.002;
+constexpr int DEPTH = 12;
+constexpr int HIDDEN_SIZE = 32;
+constexpr int EPOCHS = 20;
+constexpr int BATCH_SIZE = 32;
+constexpr int N = 1024;
+
+int main(int argc, char **argv)
+{
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    int worldSize, worldRank;
+    MPI_Comm_size(MPI_COMM_WORLD, &worldSize);
+    MPI_Comm_rank(MPI_COMM_WORLD, &worldRank);
+
+    // XOR data (generated identically on every rank; only the first stage uses the inputs and the last stage the targets)
+    std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> inputs;
+    std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> targets;
+    std::mt19937 gen(42);
+    std::bernoulli_distribution bit(0.5);
+    for (int i = 0; i < N; i++)
+    {
+        Eigen::Tensor<double, 2> input(2, 1);
+        Eigen::Tensor<double, 2> target(1, 1);
+        double a = bit(gen) ? 1.0 : 0.0;
+        double b = bit(gen) ? 1.0 : 0.0;
+        input.setValues({{a}, {b}});
+        target.setValues({{a + b == 1.0 ? 1.0 : 0.0}});
+        inputs.push_back(std::make_shared<PPGrad::Tensor<2, double>>(std::make_shared<Eigen::Tensor<double, 2>>(input)));
+        targets.push_back(std::make_shared<PPGrad::Tensor<2, double>>(std::make_shared<Eigen::Tensor<double, 2>>(target)));
+    }
+
+    if (worldRank == 0)
+    {
+        std::cout << DEPTH << " layers on " << worldSize << " stages" << std::endl;
+        std::cout << std::left << std::setw(16) << "micro-batches" << std::setw(16) << "final loss" << std::setw(16) << "bubble [%]" << std::setw(20) << "ideal bubble [%]" << "time [ms]" << std::endl;
+    }
+
+    std::shared_ptr<PPNN::Loss<2, double>> loss = std::make_shared<PPNN::MSE<2, double>>();
+    for (size_t microBatches : {1, 2, 4, 8})
+    {
+        // Only this stage's layers
+        std::pair<size_t, size_t> range = PPNN::pipelineStageLayers(DEPTH, worldSize, worldRank);
+        std::vector<std::shared_ptr<PPNN::Dense<2, double>>> layers;
+        for (size_t layer = range.first; layer < range.second; layer++)
+        {
+            const int inDim = layer == 0 ? 2 : HIDDEN_SIZE;
+            const int outDim = layer == DEPTH - 1 ? 1 : HIDDEN_SIZE;
+            const PPNN::Activations activation = layer == DEPTH - 1 ? PPNN::Activations::Linear : PPNN::Activations::ReLU;
+            layers.push_back(std::make_shared<PPNN::Dense<2, double>>(inDim, outDim, PPNN::WeightInititializers::XAVIER, activation));
+        }
+        std::shared_ptr<PPNN::Optimizer<2, double>> optimizer = std::make_shared<PPNN::Adam<2, double>>(LEARNING_RATE);
+
+        PPNN::PipelineTrainer<2, double> trainer(layers, optimizer, loss, microBatches);
+        trainer.train(inputs, targets, EPOCHS, BATCH_SIZE);
+
+        // Loss from the last stage, bubble averaged over all stages
+        const PPNN::PipelineStats &stats = trainer.getStats();
+        double finalLoss = stats.loss;
+        MPI_Bcast(&finalLoss, 1, MPI_DOUBLE, worldSize - 1, MPI_COMM_WORLD);
+        double bubble = stats.bubbleFraction() / worldSize;
+        MPI_Allreduce(MPI_IN_PLACE, &bubble, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+        if (worldRank == 0)
+        {
+            std::cout << std::left << std::setw(16) << microBatches << std::setw(16) << finalLoss << std::setw(16) << bubble * 100.0 << std::setw(20) << stats.idealBubbleFraction * 100.0
+                      << stats.trainTime * 1e3 << std::endl;
+        }
+    }
+
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,156 @@
+/** @file
+ * @brief `DPTrainer` with replicated vs. sharded (ZeRO) Adam state.
+ * @details Trains the same MLP on the XOR problem twice, once with every rank keeping Adam's moments for all parameters and once with the moments sharded across
+ * the ranks (`DPTrainer::setOptimizerSharding()`), and reports the memory each rank holds for the optimizer state and the gradient synchronization (buckets,
+ * or the slice and reduce-scatter buffer of the sharded optimizer), the training time and how far the final parameters of the two runs differ (at most by the
+ * rounding of the different reduction order).
+ * Run with e.g. `mpirun -np 4 ./build/example_ShardedOptimizerTraining`.
+ */
+
+#include "NN/Model.hpp"
+#include "NN/Dense.hpp"
+#include "NN/Loss.hpp"
+#include "NN/Optimizer.hpp"
+#include "NN/WeightInitializers.hpp"
+#include "NN/DPTrainer.hpp"
+#include "Tensor/TensorBase.hpp"
+#include "Tensor/Tensor.hpp"
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <memory>
+#include <random>
+#include <mpi.h>
+
+constexpr double LEARNING_RATE = 0.001;
+constexpr int HIDDEN_SIZE = 256;
+constexpr int EPOCHS = 5;
+constexpr int BATCH_SIZE = 16;
+constexpr int N = 512;
+
+class MLP : public PPNN::Model<2, double>
+{
+private:
+    std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> params;
+    std::vector<std::shared_ptr<PPNN::Dense<2, double>>> layers;
+
+public:
+    MLP(int hiddenSize)
+    {
+        layers.push_back(std::make_shared<PPNN::Dense<2, double>>(2, hiddenSize, PPNN::WeightInititializers::XAVIER, PPNN::Activations::ReLU));
+        layers.push_back(std::make_shared<PPNN::Dense<2, double>>(hiddenSize, hiddenSize, PPNN::WeightInititializers::XAVIER, PPNN::Activations::ReLU));
+        layers.push_back(std::make_shared<PPNN::Dense<2, double>>(hiddenSize, 1, PPNN::WeightInititializers::XAVIER, PPNN::Activations::Linear));
+        for (std::shared_ptr<PPNN::Dense<2, double>> &layer : layers)
+        {
+            params.insert(params.end(), layer->getParams().begin(), layer->getParams().end());
+        }
+    }
+
+    std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> forward(std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> inputs) override
+    {
+        std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> outputs = inputs;
+        for (std::shared_ptr<PPNN::Dense<2, double>> &layer : layers)
+        {
+            outputs = layer->forward(outputs);
+        }
+        return outputs;
+    }
+
+    std::shared_ptr<PPGrad::TensorBase<2, double>> forward(std::shared_ptr<PPGrad::TensorBase<2, double>> input) override
+    {
+        std::shared_ptr<PPGrad::TensorBase<2, double>> output = input;
+        for (std::shared_ptr<PPNN::Dense<2, double>> &layer : layers)
+        {
+            output = layer->forward(output);
+        }
+        return output;
+    }
+
+    std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> &getParams() override
+    {
+        return params;
+    }
+
+    void setParams(std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> &params) override
+    {
+        this->params = params;
+    }
+};
+
+int main(int argc, char **argv)
+{
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    int worldSize, worldRank;
+    MPI_Comm_size(MPI_COMM_WORLD, &worldSize);
+    MPI_Comm_rank(MPI_COMM_WORLD, &worldRank);
+
+    // This rank's shard of the XOR data
+    std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> inputs;
+    std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> targets;
+    std::mt19937 gen(42 + worldRank);
+    std::bernoulli_distribution bit(0.5);
+    for (int i = 0; i < N / worldSize; i++)
+    {
+        Eigen::Tensor<double, 2> input(2, 1);
+        Eigen::Tensor<double, 2> target(1, 1);
+        double a = bit(gen) ? 1.0 : 0.0;
+        double b = bit(gen) ? 1.0 : 0.0;
+        input.setValues({{a}, {b}});
+        target.setValues({{a + b == 1.0 ? 1.0 : 0.0}});
+        inputs.push_back(std::make_shared<PPGrad::Tensor<2, double>>(std::make_shared<Eigen::Tensor<double, 2>>(input)));
+        targets.push_back(std::make_shared<PPGrad::Tensor<2, double>>(std::make_shared<Eigen::Tensor<double, 2>>(target)));
+    }
+
+    if (worldRank == 0)
+    {
+        std::cout << std::left << std::setw(24) << "optimizer state" << std::setw(24) << "state [KiB/rank]" << std::setw(24) << "sync buffers [KiB/rank]" << "time [ms]" << std::endl;
+    }
+
+    std::shared_ptr<PPNN::Loss<2, double>> loss = std::make_shared<PPNN::MSE<2, double>>();
+    std::vector<std::shared_ptr<MLP>> models;
+    for (bool sharding : {false, true})
+    {
+        // Same (deterministic) initialization on all ranks and in both runs
+        std::shared_ptr<MLP> model = std::make_shared<MLP>(HIDDEN_SIZE);
+        std::shared_ptr<PPNN::Adam<2, double>> adam = std::make_shared<PPNN::Adam<2, double>>(LEARNING_RATE);
+        PPNN::DPTrainer<2, double> trainer(model, adam, loss, 1);
+        trainer.setOptimizerSharding(sharding);
+
+        MPI_Barrier(MPI_COMM_WORLD);
+        double time = MPI_Wtime();
+        trainer.train(inputs, targets, EPOCHS, BATCH_SIZE);
+        time = MPI_Wtime() - time;
+
+        // Adam's moments and the gradient synchronization buffers this rank actually holds
+        long long bytes[2] = {0, (long long)trainer.getSyncBufferBytes()};
+        for (std::pair<std::string, std::shared_ptr<Eigen::Tensor<double, 2>>> &entry : adam->getState())
+        {
+            bytes[0] += entry.second->size() * sizeof(double);
+        }
+        MPI_Allreduce(MPI_IN_PLACE, bytes, 2, MPI_LONG_LONG, MPI_MAX, MPI_COMM_WORLD);
+        MPI_Allreduce(MPI_IN_PLACE, &time, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+        if (worldRank == 0)
+        {
+            std::cout << std::left << std::setw(24) << (sharding ? "sharded (ZeRO)" : "replicated") << std::setw(24) << bytes[0] / 1024.0 << std::setw(24) << bytes[1] / 1024.0
+                      << time * 1e3 << std::endl;
+        }
+        models.push_back(model);
+    }
+
+    double deviation = 0.0;
+    for (size_t i = 0; i < models[0]->getParams().size(); i++)
+    {
+        Eigen::Tensor<double, 0> max = (*models[0]->getParams()[i]->getData() - *models[1]->getParams()[i]->getData()).abs().maximum();
+        deviation = std::max(deviation, max());
+    }
+    MPI_Allreduce(MPI_IN_PLACE, &deviation, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    if (worldRank == 0)
+    {
+        std::cout << "Max. parameter difference between the two runs: " << deviation << std::endl;
+    }
+
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,146 @@
+/** @file
+ * @brief `DPTrainer` on a memory-mapped dataset that every rank maps in full, with a `DistributedSampler` handing every rank a different share of a fresh permutation each epoch.
+ * @details Trains a small MLP on the XOR problem; the samples are never exchanged between the ranks, reshuffling is pure index computation.
+ * Run with e.g. `mpirun -np 4 ./build/example_ShuffledTraining`.
+ */
+
+#include "NN/Model.hpp"
+#include "NN/Dense.hpp"
+#include "NN/Loss.hpp"
+#include "NN/Optimizer.hpp"
+#include "NN/WeightInitializers.hpp"
+#include "NN/DPTrainer.hpp"
+#include "NN/DistributedSampler.hpp"
+#include "Tensor/TensorBase.hpp"
+#include "TensorMPI.hpp"
+#include "TensorDataset.hpp"
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <random>
+#include <string>
+#include <filesystem>
+#include <mpi.h>
+
+constexpr double LEARNING_RATE = 0.001;
+constexpr int HIDDEN_SIZE = 32;
+constexpr int EPOCHS = 20;
+constexpr int BATCH_SIZE = 10;
+constexpr int N = 1000;
+constexpr uint64_t SEED = 1234;
+
+class MLP : public PPNN::Model<2, double>
+{
+private:
+    std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> params;
+    std::vector<std::shared_ptr<PPNN::Dense<2, double>>> layers;
+
+public:
+    MLP(int hiddenSize)
+    {
+        layers.push_back(std::make_shared<PPNN::Dense<2, double>>(2, hiddenSize, PPNN::WeightInititializers::XAVIER, PPNN::Activations::ReLU));
+        layers.push_back(std::make_shared<PPNN::Dense<2, double>>(hiddenSize, hiddenSize, PPNN::WeightInititializers::XAVIER, PPNN::Activations::ReLU));
+        layers.push_back(std::make_shared<PPNN::Dense<2, double>>(hiddenSize, 1, PPNN::WeightInititializers::XAVIER, PPNN::Activations::Linear));
+        for (std::shared_ptr<PPNN::Dense<2, double>> &layer : layers)
+        {
+            params.insert(params.end(), layer->getParams().begin(), layer->getParams().end());
+        }
+    }
+
+    std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> forward(std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> inputs) override
+    {
+        std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> outputs = inputs;
+        for (std::shared_ptr<PPNN::Dense<2, double>> &layer : layers)
+        {
+            outputs = layer->forward(outputs);
+        }
+        return outputs;
+    }
+
+    std::shared_ptr<PPGrad::TensorBase<2, double>> forward(std::shared_ptr<PPGrad::TensorBase<2, double>> input) override
+    {
+        std::shared_ptr<PPGrad::TensorBase<2, double>> output = input;
+        for (std::shared_ptr<PPNN::Dense<2, double>> &layer : layers)
+        {
+            output = layer->forward(output);
+        }
+        return output;
+    }
+
+    std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> &getParams() override
+    {
+        return params;
+    }
+
+    void setParams(std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> &params) override
+    {
+        this->params = params;
+    }
+};
+
+int main(int argc, char **argv)
+{
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    int worldSize, worldRank;
+    MPI_Comm_size(MPI_COMM_WORLD, &worldSize);
+    MPI_Comm_rank(MPI_COMM_WORLD, &worldRank);
+
+    // XOR data, written once by rank 0 and mapped by every rank
+    const std::string inputsPath = (std::filesystem::temp_directory_path() / "ppgrad_shuffled_inputs.ppds").string();
+    const std::string targetsPath = (std::filesystem::temp_directory_path() / "ppgrad_shuffled_targets.ppds").string();
+    if (worldRank == 0)
+    {
+        std::vector<Eigen::Tensor<double, 2>> inputsEigen;
+        std::vector<Eigen::Tensor<double, 2>> targetsEigen;
+        std::mt19937 gen(42);
+        std::bernoulli_distribution bit(0.5);
+        for (int i = 0; i < N; i++)
+        {
+            Eigen::Tensor<double, 2> input(2, 1);
+            Eigen::Tensor<double, 2> target(1, 1);
+            double a = bit(gen) ? 1.0 : 0.0;
+            double b = bit(gen) ? 1.0 : 0.0;
+            input.setValues({{a}, {b}});
+            target.setValues({{a + b == 1.0 ? 1.0 : 0.0}});
+            inputsEigen.push_back(input);
+            targetsEigen.push_back(target);
+        }
+        PPGrad::writeTensorDataset<2, double>(inputsPath, inputsEigen);
+        PPGrad::writeTensorDataset<2, double>(targetsPath, targetsEigen);
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    double finalLoss;
+    {
+        PPGrad::MappedTensorDataset<2, double> inputs(inputsPath);
+        PPGrad::MappedTensorDataset<2, double> targets(targetsPath);
+
+        std::shared_ptr<PPNN::Model<2, double>> model = std::make_shared<MLP>(HIDDEN_SIZE);
+        model = PPGrad::modelBroadcast<2, double>(model, worldSize, worldRank);
+        std::shared_ptr<PPNN::Optimizer<2, double>> optimizer = std::make_shared<PPNN::Adam<2, double>>(LEARNING_RATE);
+        std::shared_ptr<PPNN::Loss<2, double>> loss = std::make_shared<PPNN::MSE<2, double>>();
+
+        PPNN::DPTrainer<2, double> trainer(model, optimizer, loss, 1, true);
+        trainer.setSampler(std::make_shared<PPNN::DistributedSampler>(inputs.size(), worldSize, worldRank, SEED));
+        trainer.train(inputs, targets, EPOCHS, BATCH_SIZE);
+
+        // Final training loss over the whole dataset (the same on every rank)
+        std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> allInputs;
+        std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> allTargets;
+        inputs.load(0, inputs.size(), allInputs);
+        targets.load(0, targets.size(), allTargets);
+        std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> predictions = model->forward(allInputs);
+        finalLoss = loss->operator()(predictions, allTargets);
+    }
+
+    if (worldRank == 0)
+    {
+        std::cout << "Loss after " << EPOCHS << " shuffled epochs on " << worldSize << " ranks: " << finalLoss << std::endl;
+        std::filesystem::remove(inputsPath);
+        std::filesystem::remove(targetsPath);
+    }
+
+    MPI_Finalize();
+    return 0;
+}
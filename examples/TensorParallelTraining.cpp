@@ -0,0 +1,257 @@
+/** @file
+ * @brief 2-D parallel training: the wide hidden layers of an MLP are sharded across the ranks of a tensor-parallel group (`ColumnParallelDense` followed by
+ * `RowParallelDense`), and `DPTrainer` replicates the groups, synchronizing every shard's gradients with the ranks holding the same shard.
+ * @details The world is split into groups of `TP_SIZE` consecutive ranks (tensor parallelism) and communicators of the ranks with the same position in their group
+ * (data parallelism). An MLP with the same (deterministic) initial weights, trained by `DPTrainer` on the data-parallel communicator only, serves as reference:
+ * the sharded model has to match its predictions at initialization and its weights after training (up to rounding).
+ * Run with e.g. `mpirun -np 4 ./build/example_TensorParallelTraining` (2 x 2); `TP_SIZE` has to divide the number of ranks.
+ */
+
+#include "NN/Model.hpp"
+#include "NN/Dense.hpp"
+#include "NN/TensorParallel.hpp"
+#include "NN/Loss.hpp"
+#include "NN/Optimizer.hpp"
+#include "NN/WeightInitializers.hpp"
+#include "NN/DPTrainer.hpp"
+#include "NN/DistributedSampler.hpp"
+#include "Tensor/TensorBase.hpp"
+#include "Tensor/Tensor.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <random>
+#include <mpi.h>
+
+constexpr int TP_SIZE = 2;
+constexpr double LEARNING_RATE = 0.001;
+constexpr int FEATURES = 8;
+constexpr int HIDDEN_SIZE = 256;
+constexpr int EPOCHS = 5;
+constexpr int BATCH_SIZE = 16;
+constexpr int N = 512;
+
+/// @brief Two wide hidden layers sharded across `tpComm` (no communication in between them) and a replicated output layer.
+class TensorParallelMLP : public PPNN::Model<2, double>
+{
+private:
+    std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> params;
+    std::vector<std::shared_ptr<PPNN::Model<2, double>>> layers;
+
+public:
+    TensorParallelMLP(MPI_Comm tpComm)
+    {
+        layers.push_back(std::make_shared<PPNN::ColumnParallelDense<2, double>>(FEATURES, HIDDEN_SIZE, tpComm, false, PPNN::WeightInititializers::XAVIER, PPNN::Activations::ReLU));
+        layers.push_back(std::make_shared<PPNN::RowParallelDense<2, double>>(HIDDEN_SIZE, HIDDEN_SIZE, tpComm, true, PPNN::WeightInititializers::XAVIER, PPNN::Activations::ReLU));
+        layers.push_back(std::make_shared<PPNN::Dense<2, double>>(HIDDEN_SIZE, 1, PPNN::WeightInititializers::XAVIER, PPNN::Activations::Linear));
+        for (std::shared_ptr<PPNN::Model<2, double>> &layer : layers)
+        {
+            params.insert(params.end(), layer->getParams().begin(), layer->getParams().end());
+        }
+    }
+
+    std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> forward(std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> inputs) override
+    {
+        std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> outputs = inputs;
+        for (std::shared_ptr<PPNN::Model<2, double>> &layer : layers)
+        {
+            outputs = layer->forward(outputs);
+        }
+        return outputs;
+    }
+
+    std::shared_ptr<PPGrad::TensorBase<2, double>> forward(std::shared_ptr<PPGrad::TensorBase<2, double>> input) override
+    {
+        std::shared_ptr<PPGrad::TensorBase<2, double>> output = input;
+        for (std::shared_ptr<PPNN::Model<2, double>> &layer : layers)
+        {
+            output = layer->forward(output);
+        }
+        return output;
+    }
+
+    std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> &getParams() override
+    {
+        return params;
+    }
+
+    void setParams(std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> &params) override
+    {
+        this->params = params;
+    }
+
+    bool runsCollectives() const override
+    {
+        return true;
+    }
+};
+
+/// @brief The same MLP without sharding.
+class MLP : public PPNN::Model<2, double>
+{
+private:
+    std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> params;
+    std::vector<std::shared_ptr<PPNN::Dense<2, double>>> layers;
+
+public:
+    MLP()
+    {
+        layers.push_back(std::make_shared<PPNN::Dense<2, double>>(FEATURES, HIDDEN_SIZE, PPNN::WeightInititializers::XAVIER, PPNN::Activations::ReLU));
+        layers.push_back(std::make_shared<PPNN::Dense<2, double>>(HIDDEN_SIZE, HIDDEN_SIZE, PPNN::WeightInititializers::XAVIER, PPNN::Activations::ReLU));
+        layers.push_back(std::make_shared<PPNN::Dense<2, double>>(HIDDEN_SIZE, 1, PPNN::WeightInititializers::XAVIER, PPNN::Activations::Linear));
+        for (std::shared_ptr<PPNN::Dense<2, double>> &layer : layers)
+        {
+            params.insert(params.end(), layer->getParams().begin(), layer->getParams().end());
+        }
+    }
+
+    std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> forward(std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> inputs) override
+    {
+        std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> outputs = inputs;
+        for (std::shared_ptr<PPNN::Dense<2, double>> &layer : layers)
+        {
+            outputs = layer->forward(outputs);
+        }
+        return outputs;
+    }
+
+    std::shared_ptr<PPGrad::TensorBase<2, double>> forward(std::shared_ptr<PPGrad::TensorBase<2, double>> input) override
+    {
+        std::shared_ptr<PPGrad::TensorBase<2, double>> output = input;
+        for (std::shared_ptr<PPNN::Dense<2, double>> &layer : layers)
+        {
+            output = layer->forward(output);
+        }
+        return output;
+    }
+
+    std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> &getParams() override
+    {
+        return params;
+    }
+
+    void setParams(std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> &params) override
+    {
+        this->params = params;
+    }
+};
+
+/// @brief Mean squared error of `model` on all samples.
+double evaluate(PPNN::Model<2, double> &model,
+                const std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> &inputs,
+                const std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> &targets)
+{
+    double sum = 0.0;
+    for (size_t i = 0; i < inputs.size(); i++)
+    {
+        const double error = (*model.forward(inputs[i])->getData())(0, 0) - (*targets[i]->getData())(0, 0);
+        sum += error * error;
+    }
+    return sum / inputs.size();
+}
+
+/// @brief Largest difference between the sharded parameters and the matching slices of the reference parameters (in order: W1, b1, W2, b2, W3, b3).
+double maxDeviation(TensorParallelMLP &sharded, MLP &reference, MPI_Comm tpComm)
+{
+    int tpSize, tpRank;
+    MPI_Comm_size(tpComm, &tpSize);
+    MPI_Comm_rank(tpComm, &tpRank);
+    const std::pair<Eigen::Index, Eigen::Index> hidden = PPNN::tensorParallelShard(HIDDEN_SIZE, tpSize, tpRank);
+    const Eigen::Index hiddenShard = hidden.second - hidden.first;
+
+    // Column-parallel W1 and b1 hold rows, row-parallel W2 holds columns of the full parameters.
+    const Eigen::array<Eigen::Index, 2> offsets[] = {{hidden.first, 0}, {hidden.first, 0}, {0, hidden.first}, {0, 0}, {0, 0}, {0, 0}};
+    const Eigen::array<Eigen::Index, 2> extents[] = {{hiddenShard, FEATURES}, {hiddenShard, 1}, {HIDDEN_SIZE, hiddenShard}, {HIDDEN_SIZE, 1}, {1, HIDDEN_SIZE}, {1, 1}};
+    double deviation = 0.0;
+    for (size_t i = 0; i < sharded.getParams().size(); i++)
+    {
+        Eigen::Tensor<double, 0> max = (*sharded.getParams()[i]->getData() - reference.getParams()[i]->getData()->slice(offsets[i], extents[i])).abs().maximum();
+        deviation = std::max(deviation, max());
+    }
+    return deviation;
+}
+
+int main(int argc, char **argv)
+{
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    int worldSize, worldRank;
+    MPI_Comm_size(MPI_COMM_WORLD, &worldSize);
+    MPI_Comm_rank(MPI_COMM_WORLD, &worldRank);
+    if (worldSize % TP_SIZE != 0)
+    {
+        if (worldRank == 0)
+            std::cerr << "The number of ranks has to be a multiple of " << TP_SIZE << "." << std::endl;
+        MPI_Finalize();
+        return 1;
+    }
+
+    // Consecutive ranks share the layers' shards, ranks with the same shard replicate them.
+    MPI_Comm tpComm, dpComm;
+    MPI_Comm_split(MPI_COMM_WORLD, worldRank / TP_SIZE, worldRank, &tpComm);
+    MPI_Comm_split(MPI_COMM_WORLD, worldRank % TP_SIZE, worldRank, &dpComm);
+    int dpSize, dpRank;
+    MPI_Comm_size(dpComm, &dpSize);
+    MPI_Comm_rank(dpComm, &dpRank);
+
+    // Regression target y = sum(sin(x)) (generated identically on every rank; the sampler picks every replica's share)
+    std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> inputs;
+    std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> targets;
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<double> uniform(-2.0, 2.0);
+    for (int i = 0; i < N; i++)
+    {
+        Eigen::Tensor<double, 2> input(FEATURES, 1);
+        Eigen::Tensor<double, 2> target(1, 1);
+        double sum = 0.0;
+        for (int f = 0; f < FEATURES; f++)
+        {
+            input(f, 0) = uniform(gen);
+            sum += std::sin(input(f, 0));
+        }
+        target(0, 0) = sum;
+        inputs.push_back(std::make_shared<PPGrad::Tensor<2, double>>(std::make_shared<Eigen::Tensor<double, 2>>(input)));
+        targets.push_back(std::make_shared<PPGrad::Tensor<2, double>>(std::make_shared<Eigen::Tensor<double, 2>>(target)));
+    }
+
+    std::shared_ptr<TensorParallelMLP> model = std::make_shared<TensorParallelMLP>(tpComm);
+    std::shared_ptr<MLP> reference = std::make_shared<MLP>();
+
+    double initialDeviation = 0.0;
+    for (int i = 0; i < 16; i++)
+    {
+        initialDeviation = std::max(initialDeviation, std::abs((*model->forward(inputs[i])->getData())(0, 0) - (*reference->forward(inputs[i])->getData())(0, 0)));
+    }
+    const double initialLoss = evaluate(*model, inputs, targets);
+
+    std::shared_ptr<PPNN::Loss<2, double>> loss = std::make_shared<PPNN::MSE<2, double>>();
+    double time = MPI_Wtime();
+    PPNN::DPTrainer<2, double> trainer(model, std::make_shared<PPNN::Adam<2, double>>(LEARNING_RATE), loss, 1, false, 25 * 1024 * 1024, dpComm);
+    trainer.setSampler(std::make_shared<PPNN::DistributedSampler>(N, dpSize, dpRank));
+    trainer.train(inputs, targets, EPOCHS, BATCH_SIZE);
+    time = MPI_Wtime() - time;
+
+    PPNN::DPTrainer<2, double> referenceTrainer(reference, std::make_shared<PPNN::Adam<2, double>>(LEARNING_RATE), loss, 1, false, 25 * 1024 * 1024, dpComm);
+    referenceTrainer.setSampler(std::make_shared<PPNN::DistributedSampler>(N, dpSize, dpRank));
+    referenceTrainer.train(inputs, targets, EPOCHS, BATCH_SIZE);
+
+    const double finalLoss = evaluate(*model, inputs, targets);
+    double deviation = maxDeviation(*model, *reference, tpComm);
+    MPI_Allreduce(MPI_IN_PLACE, &deviation, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, &initialDeviation, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+
+    if (worldRank == 0)
+    {
+        std::cout << "Tensor parallel: " << TP_SIZE << ", data parallel: " << dpSize << " (" << HIDDEN_SIZE / TP_SIZE << " of " << HIDDEN_SIZE << " hidden units per rank)" << std::endl;
+        std::cout << "Max. prediction difference to the reference at initialization: " << initialDeviation << std::endl;
+        std::cout << "Loss: " << initialLoss << " -> " << finalLoss << " in " << time * 1e3 << " ms" << std::endl;
+        std::cout << "Max. parameter difference to the reference after training: " << deviation << std::endl;
+    }
+
+    MPI_Comm_free(&tpComm);
+    MPI_Comm_free(&dpComm);
+    MPI_Finalize();
+    return 0;
+}
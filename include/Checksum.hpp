@@ -0,0 +1,37 @@
+/** @file
+ * @brief Checksums used to verify data after it was moved around (broadcasts, checkpoint files).
+ */
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace PPGrad
+{
+
+    /// @brief 64-bit checksum of a byte range (word-wise FNV-1a variant), chainable over consecutive ranges via `seed`.
+    /// @param data Start of the range.
+    /// @param bytes Length of the range in bytes.
+    /// @param seed Checksum of the preceding ranges (or the default for the first one).
+    /// @return Checksum of everything up to and including this range.
+    inline uint64_t checksum64(const void *data, size_t bytes, uint64_t seed = 0xcbf29ce484222325ULL)
+    {
+        const unsigned char *bytesPtr = static_cast<const unsigned char *>(data);
+        uint64_t hash = seed;
+        size_t i = 0;
+        for (; i + sizeof(uint64_t) <= bytes; i += sizeof(uint64_t))
+        {
+            uint64_t word;
+            std::memcpy(&word, bytesPtr + i, sizeof(word));
+            hash = (hash ^ word) * 0x100000001b3ULL;
+            hash ^= hash >> 29;
+        }
+        for (; i < bytes; i++)
+        {
+            hash = (hash ^ bytesPtr[i]) * 0x100000001b3ULL;
+        }
+        return hash;
+    }
+
+} // namespace PPGrad
@@ -0,0 +1,120 @@
+/** @file
+ * @brief Conversions between `float` and the 16-bit floating point formats used on the wire (bfloat16 and IEEE 754 binary16).
+ * @details All conversions from `float` round to nearest, ties to even. Wider types (e.g., `double`) are expected to be cast to `float` first.
+ */
+
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+
+namespace PPGrad
+{
+
+    /// @brief Convert a float to bfloat16 (upper 16 bits of the float, rounded to nearest even).
+    /// @param value Value to convert.
+    /// @return Raw bfloat16 bits.
+    inline uint16_t floatToBF16(float value)
+    {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        if ((bits & 0x7FFFFFFFu) > 0x7F800000u)
+        {
+            return (uint16_t)((bits >> 16) | 0x40u); // keep NaN a (quiet) NaN
+        }
+        bits += 0x7FFFu + ((bits >> 16) & 1u);
+        return (uint16_t)(bits >> 16);
+    }
+
+    /// @brief Convert bfloat16 to a float (exact).
+    /// @param value Raw bfloat16 bits.
+    /// @return Converted value.
+    inline float bf16ToFloat(uint16_t value)
+    {
+        uint32_t bits = (uint32_t)value << 16;
+        float result;
+        std::memcpy(&result, &bits, sizeof(result));
+        return result;
+    }
+
+    /// @brief Convert a float to IEEE 754 half precision (binary16), including subnormals, overflow to infinity and NaN.
+    /// @param value Value to convert.
+    /// @return Raw binary16 bits.
+    inline uint16_t floatToFP16(float value)
+    {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        const uint32_t sign = (bits >> 16) & 0x8000u;
+        const uint32_t abs = bits & 0x7FFFFFFFu;
+
+        if (abs >= 0x7F800000u)
+        {
+            return (uint16_t)(sign | 0x7C00u | (abs > 0x7F800000u ? 0x200u : 0u));
+        }
+
+        const int32_t exponent = (int32_t)(abs >> 23) - 127 + 15;
+        const uint32_t mantissa = abs & 0x7FFFFFu;
+        if (exponent >= 31)
+        {
+            return (uint16_t)(sign | 0x7C00u);
+        }
+
+        if (exponent <= 0)
+        {
+            // Subnormal (or zero): value = m * 2^-24
+            if (exponent < -10)
+            {
+                return (uint16_t)sign;
+            }
+            const uint32_t full = mantissa | 0x800000u;
+            const uint32_t shift = (uint32_t)(14 - exponent);
+            uint32_t m = full >> shift;
+            const uint32_t remainder = full & ((1u << shift) - 1u);
+            const uint32_t half = 1u << (shift - 1u);
+            if (remainder > half || (remainder == half && (m & 1u)))
+            {
+                m++;
+            }
+            return (uint16_t)(sign | m);
+        }
+
+        // A carry out of the mantissa correctly bumps the exponent (up to infinity).
+        uint32_t h = ((uint32_t)exponent << 10) | (mantissa >> 13);
+        const uint32_t remainder = mantissa & 0x1FFFu;
+        if (remainder > 0x1000u || (remainder == 0x1000u && (h & 1u)))
+        {
+            h++;
+        }
+        return (uint16_t)(sign | h);
+    }
+
+    /// @brief Convert IEEE 754 half precision (binary16) to a float (exact).
+    /// @param value Raw binary16 bits.
+    /// @return Converted value.
+    inline float fp16ToFloat(uint16_t value)
+    {
+        const uint32_t sign = ((uint32_t)value & 0x8000u) << 16;
+        const uint32_t exponent = (value >> 10) & 0x1Fu;
+        const uint32_t mantissa = value & 0x3FFu;
+
+        if (exponent == 0)
+        {
+            float magnitude = std::ldexp((float)mantissa, -24);
+            return sign ? -magnitude : magnitude;
+        }
+
+        uint32_t bits;
+        if (exponent == 31)
+        {
+            bits = sign | 0x7F800000u | (mantissa << 13);
+        }
+        else
+        {
+            bits = sign | ((exponent + 112u) << 23) | (mantissa << 13);
+        }
+        float result;
+        std::memcpy(&result, &bits, sizeof(result));
+        return result;
+    }
+
+} // namespace PPGrad
@@ -0,0 +1,90 @@
+/** @file
+ * @brief Read-only memory mapping of a whole file (POSIX `mmap`), so large files can be used in place instead of being read into memory.
+ */
+
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace PPGrad
+{
+
+    /// @brief A file mapped read-only into memory, unmapped on destruction.
+    /// @details Pages are only read from disk when first touched, so mapping costs the same for any file size.
+    class MappedFile
+    {
+    private:
+        void *address = nullptr; ///< Start of the mapping (nullptr for an empty file).
+        size_t length = 0;       ///< Size of the file in bytes.
+
+    public:
+        /// @brief Map `path` into memory.
+        /// @param path File to map.
+        MappedFile(const std::string &path)
+        {
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+            {
+                throw std::runtime_error("Cannot open " + path + " for reading.");
+            }
+            struct stat info;
+            if (::fstat(fd, &info) != 0)
+            {
+                ::close(fd);
+                throw std::runtime_error("Cannot stat " + path + ".");
+            }
+            length = info.st_size;
+            if (length > 0)
+            {
+                address = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+            }
+            ::close(fd); // the mapping stays valid
+            if (address == MAP_FAILED)
+            {
+                address = nullptr;
+                throw std::runtime_error("Cannot map " + path + " into memory.");
+            }
+        }
+
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        ~MappedFile()
+        {
+            if (address)
+            {
+                ::munmap(address, length);
+            }
+        }
+
+        /// @brief Start of the mapped file.
+        const unsigned char *data() const
+        {
+            return static_cast<const unsigned char *>(address);
+        }
+
+        /// @brief Size of the mapped file in bytes.
+        size_t size() const
+        {
+            return length;
+        }
+
+        /// @brief Ask the kernel to read [offset, offset + bytes) ahead, as it will be needed soon (`madvise(MADV_WILLNEED)`, returns immediately).
+        void willNeed(size_t offset, size_t bytes) const
+        {
+            const size_t page = ::sysconf(_SC_PAGESIZE);
+            const size_t begin = offset / page * page;
+            if (address && begin < length && bytes > 0)
+            {
+                ::madvise(static_cast<char *>(address) + begin, std::min(offset + bytes, length) - begin, MADV_WILLNEED);
+            }
+        }
+    };
+
+} // namespace PPGrad
@@ -0,0 +1,271 @@
+/** @file
+ * @brief Sharded checkpoints written by background threads on all ranks, committed by an atomically replaced manifest.
+ */
+
+#pragma once
+
+#include "NN/Checkpoint.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include <mpi.h>
+
+namespace PPNN
+{
+
+    /// @brief Statistics of an `AsyncCheckpointer` (of the calling rank).
+    struct CheckpointStats
+    {
+        size_t committed = 0;     ///< Checkpoints committed (i.e., the manifest points to them).
+        size_t bytesWritten = 0;  ///< Shard bytes this rank wrote.
+        double writeTime = 0.0;   ///< Seconds the background thread spent writing shards.
+        double blockedTime = 0.0; ///< Seconds the caller waited for an earlier write to finish.
+    };
+
+    /// @brief Writes checkpoints in the background, every rank its own shard.
+    /// @details `save()` takes a staged snapshot (a `Checkpoint` holding copies of the tensors, so training can go on modifying the live ones) and hands this rank's shard of it,
+    /// a contiguous byte-balanced range of the tensors, to a background thread, which writes it to `<directory>/step<step>.shard<rank>of<ranks>.ckpt` and syncs it to disk.
+    /// Once all ranks finished their shard, they agree on whether all writes succeeded (an `MPI_Iallreduce` progressed by `poll()` from the calling thread, so MPI is only
+    /// called from there). If so, rank 0 atomically replaces `<directory>/manifest.ckpt`, which holds the counters, the step and the number of shards, and removes the shards
+    /// of the previous checkpoint; otherwise every rank throws and the previous checkpoint stays committed.
+    /// A crash at any point thus leaves the previous complete checkpoint in place. At most one checkpoint is in flight, `save()` first waits for the previous one.
+    /// The directory has to be on a file system all ranks see.
+    template <int Dim, typename DT>
+    class AsyncCheckpointer
+    {
+    private:
+        std::string directory;
+        MPI_Comm comm;
+        int worldSize = 1;
+        int worldRank = 0;
+        CheckpointStats stats;
+
+        bool inFlight = false;                    ///< Whether a checkpoint is being written or waiting to be committed.
+        bool agreementStarted = false;            ///< Whether this rank finished its shard and joined the agreement on the outcome.
+        MPI_Request agreement = MPI_REQUEST_NULL; ///< Agreement (maximum of `writeFailed` over all ranks) of the checkpoint in flight.
+        int writeFailed = 0;                      ///< Whether writing the shard failed on this rank (on any rank, once the agreement completed).
+        std::exception_ptr writeError;            ///< Error of this rank's failed write.
+        std::future<double> write;                ///< Background write of this rank's shard (returns the seconds it took).
+        Checkpoint<Dim, DT> manifest;             ///< Manifest of the checkpoint in flight (rank 0).
+        int64_t committedStep = -1;               ///< Step of the committed checkpoint (rank 0).
+        int64_t committedShards = 0;              ///< Number of shards of the committed checkpoint (rank 0).
+
+        std::string manifestPath() const
+        {
+            return (std::filesystem::path(directory) / "manifest.ckpt").string();
+        }
+
+        static std::string shardPath(const std::string &directory, int64_t step, int64_t shard, int64_t numShards)
+        {
+            return (std::filesystem::path(directory) / ("step" + std::to_string(step) + ".shard" + std::to_string(shard) + "of" + std::to_string(numShards) + ".ckpt")).string();
+        }
+
+        /// @brief Collect the outcome of this rank's write and start agreeing on the outcome of all ranks.
+        void startAgreement()
+        {
+            try
+            {
+                stats.writeTime += write.get();
+            }
+            catch (...)
+            {
+                writeFailed = 1;
+                writeError = std::current_exception();
+            }
+            MPI_Iallreduce(MPI_IN_PLACE, &writeFailed, 1, MPI_INT, MPI_MAX, comm, &agreement);
+            agreementStarted = true;
+        }
+
+        /// @brief Rank 0: point the manifest to the checkpoint in flight and remove the previous one, unless any rank failed writing its shard (then all ranks throw).
+        void commit()
+        {
+            inFlight = false;
+            agreementStarted = false;
+            if (writeFailed)
+            {
+                const int64_t step = manifest.counter("step");
+                std::error_code ignored;
+                std::filesystem::remove(shardPath(directory, step, worldRank, worldSize), ignored);
+                std::filesystem::remove(shardPath(directory, step, worldRank, worldSize) + ".tmp", ignored);
+                writeFailed = 0;
+                std::exception_ptr error = writeError;
+                writeError = nullptr;
+                if (error)
+                {
+                    std::rethrow_exception(error);
+                }
+                throw std::runtime_error("Checkpoint " + std::to_string(step) + " was not committed, another rank failed writing its shard.");
+            }
+
+            if (worldRank == 0)
+            {
+                saveCheckpoint(manifestPath(), manifest);
+                for (int64_t shard = 0; committedStep >= 0 && committedStep != manifest.counter("step") && shard < committedShards; shard++)
+                {
+                    std::filesystem::remove(shardPath(directory, committedStep, shard, committedShards));
+                }
+                committedStep = manifest.counter("step");
+                committedShards = manifest.counter("numShards");
+            }
+            stats.committed++;
+        }
+
+    public:
+        /// @brief Create the checkpointer (collective over `comm`).
+        /// @param directory Directory to write the checkpoints to (created if missing).
+        /// @param comm Communicator of all ranks taking part.
+        AsyncCheckpointer(const std::string &directory, MPI_Comm comm = MPI_COMM_WORLD) : directory(directory)
+        {
+            MPI_Comm_dup(comm, &this->comm);
+            MPI_Comm_size(this->comm, &worldSize);
+            MPI_Comm_rank(this->comm, &worldRank);
+            if (worldRank == 0)
+            {
+                std::filesystem::create_directories(directory);
+                if (exists(directory))
+                {
+                    // Shards of an earlier job's checkpoint are removed once this job commits its first one.
+                    MappedCheckpoint<Dim, DT> previous(manifestPath());
+                    committedStep = previous.counter("step");
+                    committedShards = previous.counter("numShards");
+                }
+            }
+            MPI_Barrier(this->comm);
+        }
+
+        AsyncCheckpointer(const AsyncCheckpointer &) = delete;
+        AsyncCheckpointer &operator=(const AsyncCheckpointer &) = delete;
+
+        ~AsyncCheckpointer()
+        {
+            if (write.valid())
+            {
+                write.wait();
+            }
+            int finalized;
+            MPI_Finalized(&finalized);
+            if (!finalized)
+            {
+                MPI_Comm_free(&comm);
+            }
+        }
+
+        /// @brief Start writing `snapshot` as checkpoint `step` (every rank has to call this with a snapshot of the same tensors).
+        /// @param step Increasing number of the checkpoint (e.g., the sync count).
+        /// @param snapshot Staged state; its counters go to the manifest, its tensors are sharded across the ranks.
+        void save(int64_t step, Checkpoint<Dim, DT> snapshot)
+        {
+            if (inFlight)
+            {
+                const double begin = MPI_Wtime();
+                complete();
+                stats.blockedTime += MPI_Wtime() - begin;
+            }
+
+            // Contiguous, byte-balanced ranges of the tensors, so concatenating the shards in rank order restores the original order.
+            size_t totalBytes = 0;
+            for (std::pair<std::string, std::shared_ptr<Eigen::Tensor<DT, Dim>>> &entry : snapshot.tensors)
+                totalBytes += entry.second->size() * sizeof(DT);
+            Checkpoint<Dim, DT> shard;
+            size_t bytesBefore = 0;
+            for (std::pair<std::string, std::shared_ptr<Eigen::Tensor<DT, Dim>>> &entry : snapshot.tensors)
+            {
+                const size_t bytes = entry.second->size() * sizeof(DT);
+                const size_t owner = totalBytes == 0 ? 0 : std::min<size_t>((2 * bytesBefore + bytes) * worldSize / (2 * totalBytes), worldSize - 1);
+                if ((int)owner == worldRank)
+                {
+                    shard.tensors.push_back(entry);
+                    stats.bytesWritten += bytes;
+                }
+                bytesBefore += bytes;
+            }
+
+            manifest.counters = snapshot.counters;
+            manifest.counters.emplace_back("step", step);
+            manifest.counters.emplace_back("numShards", worldSize);
+            const std::string path = shardPath(directory, step, worldRank, worldSize);
+            write = std::async(std::launch::async, [path, shard = std::move(shard)]()
+                               {
+                                   const std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+                                   saveCheckpoint(path, shard);
+                                   return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count(); });
+            inFlight = true;
+        }
+
+        /// @brief Progress the checkpoint in flight without blocking (call regularly from the thread that calls MPI, e.g., once per step).
+        /// @return Whether no checkpoint is in flight anymore.
+        bool poll()
+        {
+            if (!inFlight)
+            {
+                return true;
+            }
+            if (!agreementStarted)
+            {
+                if (write.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+                {
+                    return false;
+                }
+                startAgreement();
+            }
+            int done;
+            MPI_Test(&agreement, &done, MPI_STATUS_IGNORE);
+            if (done)
+            {
+                commit();
+            }
+            return done;
+        }
+
+        /// @brief Wait until the checkpoint in flight (if any) is committed.
+        void complete()
+        {
+            if (!inFlight)
+            {
+                return;
+            }
+            if (!agreementStarted)
+            {
+                startAgreement();
+            }
+            MPI_Wait(&agreement, MPI_STATUS_IGNORE);
+            commit();
+        }
+
+        /// @brief Statistics of the checkpoints written so far.
+        const CheckpointStats &getStats() const
+        {
+            return stats;
+        }
+
+        /// @brief Whether `directory` holds a committed checkpoint.
+        static bool exists(const std::string &directory)
+        {
+            return std::filesystem::exists(std::filesystem::path(directory) / "manifest.ckpt");
+        }
+
+        /// @brief Read (and verify) the committed checkpoint of `directory`: the manifest's counters and the tensors of all shards, in the order they were saved.
+        /// @details Works with any number of readers, independent of the number of ranks that wrote the checkpoint.
+        static Checkpoint<Dim, DT> load(const std::string &directory)
+        {
+            Checkpoint<Dim, DT> checkpoint = loadCheckpoint<Dim, DT>((std::filesystem::path(directory) / "manifest.ckpt").string());
+            const int64_t step = checkpoint.counter("step");
+            const int64_t numShards = checkpoint.counter("numShards");
+            for (int64_t shard = 0; shard < numShards; shard++)
+            {
+                Checkpoint<Dim, DT> part = loadCheckpoint<Dim, DT>(shardPath(directory, step, shard, numShards));
+                checkpoint.tensors.insert(checkpoint.tensors.end(), part.tensors.begin(), part.tensors.end());
+            }
+            return checkpoint;
+        }
+    };
+
+} // namespace PPNN
@@ -0,0 +1,467 @@
+/** @file
+ * @brief Memory-mappable binary checkpoints of named tensors (parameters, optimizer state) and integer counters (e.g., the position in the training data).
+ * @details Layout (native byte order):
+ * - 64-byte header: magic `PPGRADCK`, `uint32` version, `uint32` reserved, `uint64` number of counters, `uint64` number of tensors, `uint64` size of the index in bytes,
+ *   `uint64` checksum of the index, `uint64` file size, `uint64` reserved.
+ * - Index: every counter as (`uint32` name length, name, `int64` value), every tensor as (`uint32` name length, name, `uint32` dtype, `uint32` number of dimensions,
+ *   `int64` extent of every dimension, `uint64` payload offset, `uint64` payload size in bytes, `uint64` payload checksum).
+ * - Payloads: the raw tensor data in Eigen's column-major order, every payload starting at a multiple of 64 bytes.
+ *
+ * Loading maps the file into memory (`MappedCheckpoint`), so only the index is parsed up front and every tensor can be viewed in place.
+ */
+
+#pragma once
+
+#include "Tensor/TensorBase.hpp"
+#include "NN/Model.hpp"
+#include "NN/Optimizer.hpp"
+#include "Checksum.hpp"
+#include "MappedFile.hpp"
+#include <unsupported/Eigen/CXX11/Tensor>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+#include <numeric>
+#include <type_traits>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace PPNN
+{
+
+    /// @brief Element types of the tensors in a checkpoint.
+    enum class DTypes : uint32_t
+    {
+        FLOAT32 = 1,
+        FLOAT64 = 2
+    };
+
+    /// @brief Element type code of `DT`.
+    template <typename DT>
+    constexpr DTypes dtypeOf()
+    {
+        static_assert(std::is_same_v<DT, float> || std::is_same_v<DT, double>, "Checkpoints hold float or double tensors.");
+        return std::is_same_v<DT, float> ? DTypes::FLOAT32 : DTypes::FLOAT64;
+    }
+
+    /// @brief Fixed-size header at the start of a checkpoint file.
+    struct CheckpointHeader
+    {
+        static constexpr char MAGIC[8] = {'P', 'P', 'G', 'R', 'A', 'D', 'C', 'K'};
+        static constexpr uint32_t VERSION = 2;
+        static constexpr size_t ALIGNMENT = 64; ///< Alignment of the header, the index and every payload.
+
+        char magic[8];
+        uint32_t version;
+        uint32_t reserved0;
+        uint64_t numCounters;
+        uint64_t numTensors;
+        uint64_t indexBytes;
+        uint64_t indexChecksum;
+        uint64_t fileBytes;
+        uint64_t reserved1;
+    };
+    static_assert(sizeof(CheckpointHeader) == CheckpointHeader::ALIGNMENT, "The checkpoint header has to fill exactly one alignment unit.");
+
+    /// @brief Index entry of a tensor in a checkpoint file.
+    struct CheckpointEntry
+    {
+        std::string name;
+        DTypes dtype;
+        std::vector<int64_t> dims; ///< Extent of every dimension.
+        uint64_t offset;           ///< Offset of the payload in the file (multiple of `CheckpointHeader::ALIGNMENT`).
+        uint64_t bytes;            ///< Size of the payload.
+        uint64_t checksum;         ///< `PPGrad::checksum64` of the payload.
+    };
+
+    /// @brief In-memory contents of a checkpoint file.
+    template <int Dim, typename DT>
+    struct Checkpoint
+    {
+        std::vector<std::pair<std::string, int64_t>> counters;                                 ///< Named integers, e.g., epoch and position in the data.
+        std::vector<std::pair<std::string, std::shared_ptr<Eigen::Tensor<DT, Dim>>>> tensors; ///< Named tensors, e.g., parameters and optimizer state.
+
+        /// @brief Value of the counter `name` (throws if missing).
+        int64_t counter(const std::string &name) const
+        {
+            for (const std::pair<std::string, int64_t> &entry : counters)
+            {
+                if (entry.first == name)
+                    return entry.second;
+            }
+            throw std::runtime_error("Checkpoint has no counter " + name + ".");
+        }
+
+        /// @brief All tensors whose name starts with `prefix`, in stored order and with the prefix removed.
+        OptimizerState<Dim, DT> tensorsWithPrefix(const std::string &prefix) const
+        {
+            OptimizerState<Dim, DT> result;
+            for (const std::pair<std::string, std::shared_ptr<Eigen::Tensor<DT, Dim>>> &entry : tensors)
+            {
+                if (entry.first.compare(0, prefix.size(), prefix) == 0)
+                    result.emplace_back(entry.first.substr(prefix.size()), entry.second);
+            }
+            return result;
+        }
+
+        /// @brief Add (copies of) the parameter values as `param0`, `param1`, ...
+        void addParams(std::vector<std::shared_ptr<PPGrad::TensorBase<Dim, DT>>> &params)
+        {
+            for (size_t i = 0; i < params.size(); i++)
+            {
+                tensors.emplace_back("param" + std::to_string(i), std::make_shared<Eigen::Tensor<DT, Dim>>(*params[i]->getData()));
+            }
+        }
+
+        /// @brief Overwrite the parameter values with the ones added by `addParams()`.
+        void restoreParams(std::vector<std::shared_ptr<PPGrad::TensorBase<Dim, DT>>> &params) const
+        {
+            OptimizerState<Dim, DT> stored = tensorsWithPrefix("param");
+            if (stored.size() != params.size())
+            {
+                throw std::runtime_error("Checkpoint holds " + std::to_string(stored.size()) + " parameters, the model has " + std::to_string(params.size()) + ".");
+            }
+            for (size_t i = 0; i < params.size(); i++)
+            {
+                if (stored[i].first != std::to_string(i) || stored[i].second->dimensions() != params[i]->getData()->dimensions())
+                {
+                    throw std::runtime_error("Parameter " + std::to_string(i) + " of the checkpoint does not match the model.");
+                }
+                *params[i]->getData() = *stored[i].second;
+            }
+        }
+
+        /// @brief Add (copies of) the state of `optimizer` as `<prefix>.<state name>` and its step counter as `<prefix>.step`.
+        void addOptimizer(const std::string &prefix, Optimizer<Dim, DT> &optimizer)
+        {
+            for (std::pair<std::string, std::shared_ptr<Eigen::Tensor<DT, Dim>>> &entry : optimizer.getState())
+            {
+                tensors.emplace_back(prefix + "." + entry.first, std::make_shared<Eigen::Tensor<DT, Dim>>(*entry.second));
+            }
+            counters.emplace_back(prefix + ".step", optimizer.getStep());
+        }
+
+        /// @brief Restore the state of `optimizer` added by `addOptimizer()`.
+        void restoreOptimizer(const std::string &prefix, Optimizer<Dim, DT> &optimizer) const
+        {
+            optimizer.resetState();
+            optimizer.setState(tensorsWithPrefix(prefix + "."));
+            optimizer.setStep(counter(prefix + ".step"));
+        }
+    };
+
+    /// @brief Flush `path` (a file or a directory, e.g., after renaming an entry of it) from the page cache to the disk (`fsync`).
+    inline void syncToDisk(const std::string &path)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            throw std::runtime_error("Cannot open " + path + " to sync it.");
+        }
+        const int result = ::fsync(fd);
+        ::close(fd);
+        if (result != 0)
+        {
+            throw std::runtime_error("Failed syncing " + path + " to disk.");
+        }
+    }
+
+    /// @brief Write a checkpoint file. The file is written and synced to disk next to `path` first and then renamed (and the rename synced), so `path` always holds a
+    /// complete checkpoint, also after a crash of the node.
+    /// @param path File to (atomically) replace.
+    /// @param checkpoint Checkpoint to store.
+    template <int Dim, typename DT>
+    void saveCheckpoint(const std::string &path, const Checkpoint<Dim, DT> &checkpoint)
+    {
+        constexpr size_t ALIGNMENT = CheckpointHeader::ALIGNMENT;
+        auto appendBytes = [](std::vector<char> &buffer, const void *bytes, size_t count)
+        {
+            buffer.insert(buffer.end(), static_cast<const char *>(bytes), static_cast<const char *>(bytes) + count);
+        };
+        auto appendName = [&appendBytes](std::vector<char> &buffer, const std::string &name)
+        {
+            const uint32_t length = name.size();
+            appendBytes(buffer, &length, sizeof(length));
+            appendBytes(buffer, name.data(), length);
+        };
+
+        // Index: the payload offsets follow from the (fixed) size of the index itself.
+        size_t indexBytes = 0;
+        for (const std::pair<std::string, int64_t> &entry : checkpoint.counters)
+            indexBytes += sizeof(uint32_t) + entry.first.size() + sizeof(int64_t);
+        for (const std::pair<std::string, std::shared_ptr<Eigen::Tensor<DT, Dim>>> &entry : checkpoint.tensors)
+            indexBytes += sizeof(uint32_t) + entry.first.size() + 2 * sizeof(uint32_t) + Dim * sizeof(int64_t) + 3 * sizeof(uint64_t);
+
+        std::vector<char> index;
+        index.reserve(indexBytes);
+        for (const std::pair<std::string, int64_t> &entry : checkpoint.counters)
+        {
+            appendName(index, entry.first);
+            appendBytes(index, &entry.second, sizeof(entry.second));
+        }
+        uint64_t offset = (sizeof(CheckpointHeader) + indexBytes + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+        for (const std::pair<std::string, std::shared_ptr<Eigen::Tensor<DT, Dim>>> &entry : checkpoint.tensors)
+        {
+            const uint32_t typeAndDims[2] = {(uint32_t)dtypeOf<DT>(), (uint32_t)Dim};
+            const uint64_t bytes = entry.second->size() * sizeof(DT);
+            const uint64_t payload[3] = {offset, bytes, PPGrad::checksum64(entry.second->data(), bytes)};
+            appendName(index, entry.first);
+            appendBytes(index, typeAndDims, sizeof(typeAndDims));
+            for (int i = 0; i < Dim; i++)
+            {
+                const int64_t extent = entry.second->dimension(i);
+                appendBytes(index, &extent, sizeof(extent));
+            }
+            appendBytes(index, payload, sizeof(payload));
+            offset = (offset + bytes + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+        }
+
+        CheckpointHeader header = {};
+        std::memcpy(header.magic, CheckpointHeader::MAGIC, sizeof(header.magic));
+        header.version = CheckpointHeader::VERSION;
+        header.numCounters = checkpoint.counters.size();
+        header.numTensors = checkpoint.tensors.size();
+        header.indexBytes = index.size();
+        header.indexChecksum = PPGrad::checksum64(index.data(), index.size());
+        header.fileBytes = offset;
+
+        const std::string tmpPath = path + ".tmp";
+        {
+            std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+            if (!file)
+            {
+                throw std::runtime_error("Cannot open " + tmpPath + " for writing.");
+            }
+            const char padding[ALIGNMENT] = {};
+            file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+            file.write(index.data(), index.size());
+            size_t written = sizeof(header) + index.size();
+            for (const std::pair<std::string, std::shared_ptr<Eigen::Tensor<DT, Dim>>> &entry : checkpoint.tensors)
+            {
+                file.write(padding, (ALIGNMENT - written % ALIGNMENT) % ALIGNMENT);
+                written = (written + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+                file.write(reinterpret_cast<const char *>(entry.second->data()), entry.second->size() * sizeof(DT));
+                written += entry.second->size() * sizeof(DT);
+            }
+            file.write(padding, header.fileBytes - written);
+            if (!file.flush())
+            {
+                throw std::runtime_error("Failed writing " + tmpPath + ".");
+            }
+        }
+        syncToDisk(tmpPath);
+        std::filesystem::rename(tmpPath, path);
+        const std::filesystem::path parent = std::filesystem::path(path).parent_path();
+        syncToDisk(parent.empty() ? "." : parent.string());
+    }
+
+    /// @brief A checkpoint file mapped into memory: the index is parsed (and verified) on construction, the tensors are read in place.
+    template <int Dim, typename DT>
+    class MappedCheckpoint
+    {
+    private:
+        std::string path;
+        std::shared_ptr<PPGrad::MappedFile> file;
+        std::vector<std::pair<std::string, int64_t>> counters;
+        std::vector<CheckpointEntry> entries;
+
+    public:
+        /// @brief Map `path` and parse its index.
+        /// @param path Checkpoint file.
+        MappedCheckpoint(const std::string &path) : path(path), file(std::make_shared<PPGrad::MappedFile>(path))
+        {
+            CheckpointHeader header;
+            if (file->size() < sizeof(header))
+            {
+                throw std::runtime_error(path + " is not a checkpoint file.");
+            }
+            std::memcpy(&header, file->data(), sizeof(header));
+            if (std::memcmp(header.magic, CheckpointHeader::MAGIC, sizeof(header.magic)) != 0 || header.version != CheckpointHeader::VERSION)
+            {
+                throw std::runtime_error(path + " is not a checkpoint file of version " + std::to_string(CheckpointHeader::VERSION) + ".");
+            }
+            if (header.fileBytes != file->size() || sizeof(header) + header.indexBytes > file->size() ||
+                PPGrad::checksum64(file->data() + sizeof(header), header.indexBytes) != header.indexChecksum)
+            {
+                throw std::runtime_error(path + " is truncated or corrupted.");
+            }
+
+            const unsigned char *cursor = file->data() + sizeof(header);
+            const unsigned char *end = cursor + header.indexBytes;
+            auto read = [&cursor, end, &path](void *dest, size_t bytes)
+            {
+                if (cursor + bytes > end)
+                {
+                    throw std::runtime_error("The index of " + path + " is malformed.");
+                }
+                std::memcpy(dest, cursor, bytes);
+                cursor += bytes;
+            };
+            auto readName = [&read]()
+            {
+                uint32_t length;
+                read(&length, sizeof(length));
+                std::string name(length, '\0');
+                read(name.data(), length);
+                return name;
+            };
+
+            for (uint64_t i = 0; i < header.numCounters; i++)
+            {
+                std::string name = readName();
+                int64_t value;
+                read(&value, sizeof(value));
+                counters.emplace_back(name, value);
+            }
+            for (uint64_t i = 0; i < header.numTensors; i++)
+            {
+                CheckpointEntry entry;
+                uint32_t typeAndDims[2];
+                uint64_t payload[3];
+                entry.name = readName();
+                read(typeAndDims, sizeof(typeAndDims));
+                entry.dtype = (DTypes)typeAndDims[0];
+                entry.dims.resize(typeAndDims[1]);
+                read(entry.dims.data(), entry.dims.size() * sizeof(int64_t));
+                read(payload, sizeof(payload));
+                entry.offset = payload[0];
+                entry.bytes = payload[1];
+                entry.checksum = payload[2];
+                if (entry.offset % CheckpointHeader::ALIGNMENT != 0 || entry.offset + entry.bytes > file->size())
+                {
+                    throw std::runtime_error("Tensor " + entry.name + " lies outside of " + path + ".");
+                }
+                entries.push_back(entry);
+            }
+        }
+
+        /// @brief Value of the counter `name` (throws if missing).
+        int64_t counter(const std::string &name) const
+        {
+            for (const std::pair<std::string, int64_t> &entry : counters)
+            {
+                if (entry.first == name)
+                    return entry.second;
+            }
+            throw std::runtime_error(path + " has no counter " + name + ".");
+        }
+
+        /// @brief Index entries of all tensors, in stored order.
+        const std::vector<CheckpointEntry> &getEntries() const
+        {
+            return entries;
+        }
+
+        /// @brief Index entry of the tensor `name` (throws if missing).
+        const CheckpointEntry &find(const std::string &name) const
+        {
+            for (const CheckpointEntry &entry : entries)
+            {
+                if (entry.name == name)
+                    return entry;
+            }
+            throw std::runtime_error(path + " has no tensor " + name + ".");
+        }
+
+        /// @brief View a tensor in place (valid as long as this object lives), after checking its type and number of dimensions.
+        Eigen::TensorMap<const Eigen::Tensor<DT, Dim>> view(const CheckpointEntry &entry) const
+        {
+            if (entry.dtype != dtypeOf<DT>() || entry.dims.size() != (size_t)Dim || entry.bytes != (uint64_t)std::accumulate(entry.dims.begin(), entry.dims.end(), (int64_t)1, std::multiplies<int64_t>()) * sizeof(DT))
+            {
+                throw std::runtime_error("Tensor " + entry.name + " in " + path + " is not a " + std::to_string(Dim) + "-D tensor of " + std::to_string(sizeof(DT)) + "-byte elements.");
+            }
+            Eigen::array<Eigen::Index, Dim> dimensions;
+            for (int i = 0; i < Dim; i++)
+                dimensions[i] = entry.dims[i];
+            return Eigen::TensorMap<const Eigen::Tensor<DT, Dim>>(reinterpret_cast<const DT *>(file->data() + entry.offset), dimensions);
+        }
+
+        /// @brief View the tensor `name` in place (see `view(const CheckpointEntry &)`).
+        Eigen::TensorMap<const Eigen::Tensor<DT, Dim>> view(const std::string &name) const
+        {
+            return view(find(name));
+        }
+
+        /// @brief Check the payload of `entry` against its checksum (reads the whole payload).
+        bool verify(const CheckpointEntry &entry) const
+        {
+            return PPGrad::checksum64(file->data() + entry.offset, entry.bytes) == entry.checksum;
+        }
+
+        /// @brief Copy (and verify) all counters and tensors into memory.
+        Checkpoint<Dim, DT> load() const
+        {
+            Checkpoint<Dim, DT> checkpoint;
+            checkpoint.counters = counters;
+            for (const CheckpointEntry &entry : entries)
+            {
+                if (!verify(entry))
+                {
+                    throw std::runtime_error("Checksum mismatch of tensor " + entry.name + " in " + path + ".");
+                }
+                checkpoint.tensors.emplace_back(entry.name, std::make_shared<Eigen::Tensor<DT, Dim>>(view(entry)));
+            }
+            return checkpoint;
+        }
+    };
+
+    /// @brief Read (and verify) a checkpoint file written by `saveCheckpoint()`.
+    /// @param path Checkpoint file.
+    /// @return The checkpoint.
+    template <int Dim, typename DT>
+    Checkpoint<Dim, DT> loadCheckpoint(const std::string &path)
+    {
+        return MappedCheckpoint<Dim, DT>(path).load();
+    }
+
+    /// @brief Save the parameters of `model` (and the state of `optimizer`, if given) to a checkpoint file.
+    /// @param path File to (atomically) replace.
+    /// @param model Model to save.
+    /// @param optimizer Optional optimizer whose state to save along.
+    template <int Dim, typename DT>
+    void saveModel(const std::string &path, Model<Dim, DT> &model, std::shared_ptr<Optimizer<Dim, DT>> optimizer = nullptr)
+    {
+        Checkpoint<Dim, DT> checkpoint;
+        checkpoint.addParams(model.getParams());
+        if (optimizer)
+        {
+            checkpoint.addOptimizer("optimizer", *optimizer);
+        }
+        saveCheckpoint(path, checkpoint);
+    }
+
+    /// @brief Load the parameters of `model` (and the state of `optimizer`, if given) from a checkpoint file written by `saveModel()`.
+    /// @details Parameters are copied straight from the mapped file (verifying every checksum), the model has to have the same parameter shapes.
+    /// @param path Checkpoint file.
+    /// @param model Model to overwrite the parameters of.
+    /// @param optimizer Optional optimizer whose state to restore.
+    template <int Dim, typename DT>
+    void loadModel(const std::string &path, Model<Dim, DT> &model, std::shared_ptr<Optimizer<Dim, DT>> optimizer = nullptr)
+    {
+        MappedCheckpoint<Dim, DT> mapped(path);
+        std::vector<std::shared_ptr<PPGrad::TensorBase<Dim, DT>>> &params = model.getParams();
+        for (size_t i = 0; i < params.size(); i++)
+        {
+            const CheckpointEntry &entry = mapped.find("param" + std::to_string(i));
+            Eigen::TensorMap<const Eigen::Tensor<DT, Dim>> stored = mapped.view(entry);
+            if (stored.dimensions() != params[i]->getData()->dimensions() || !mapped.verify(entry))
+            {
+                throw std::runtime_error("Parameter " + std::to_string(i) + " of " + path + " does not match the model or is corrupted.");
+            }
+            *params[i]->getData() = stored;
+        }
+        if (optimizer)
+        {
+            mapped.load().restoreOptimizer("optimizer", *optimizer);
+        }
+    }
+
+} // namespace PPNN
@@ -7,12 +7,24 @@
 #include "NN/Model.hpp"
 #include "NN/Optimizer.hpp"
 #include "NN/Loss.hpp"
+#include "NN/GradSynchronizer.hpp"
+#include "NN/ShardedOptimizer.hpp"
+#include "NN/AsyncCheckpointer.hpp"
+#include "NN/DistributedSampler.hpp"
+#include "NN/DatasetView.hpp"
+#include "TensorDataset.hpp"
 #include <vector>
 #include <memory>
 #include <iostream>
 #include <omp.h>
 #include <mpi.h>
 #include <algorithm>
+#include <numeric>
+#include <atomic>
+#include <thread>
+#include <stdexcept>
+#include <string>
+#include <filesystem>
 
 namespace PPNN
 {
@@ -32,35 +44,188 @@ namespace PPNN
         int32_t gradSyncFreq;
         bool gradientAccumulation = false;
 
-    public:
-        DPTrainer(
-            std::shared_ptr<Model<Dim, DT>> model,
-            std::shared_ptr<Optimizer<Dim, DT>> optimizer,
-            std::shared_ptr<Loss<Dim, DT>> loss,
-            int32_t gradSyncFreq = 16, // very conservative default value (see DiLoCo paper)
-            bool gradientAccumulation = false)
+        MPI_Comm comm; ///< Ranks training replicas of the model (duplicated), i.e., the data-parallel dimension.
+
+        std::unique_ptr<GradSynchronizer<Dim, DT>> synchronizer; ///< Bucketed gradient allreduce overlapped with backward().
+        std::vector<SyncStats> syncStats;                         ///< Overlap report of every gradient synchronization.
+
+        std::shared_ptr<Optimizer<Dim, DT>> outerOptimizer; ///< Local SGD (DiLoCo) outer optimizer, `nullptr` = gradient synchronization.
+        std::shared_ptr<ShardedOptimizer<Dim, DT>> sharded; ///< ZeRO wrapper of `optimizer` that also sums the gradients, `nullptr` = replicated optimizer state.
+        std::vector<Eigen::Tensor<DT, Dim>> anchors;        ///< Parameters shared by all ranks after the last outer step.
+
+        std::string checkpointDirectory;                          ///< Checkpoint directory (empty = no checkpointing).
+        std::unique_ptr<AsyncCheckpointer<Dim, DT>> checkpointer; ///< Background writer of the checkpoints.
+        int32_t checkpointInterval = 0;                           ///< Checkpoint every this many syncs.
+        int32_t syncsSinceCheckpoint = 0;                         ///< Syncs since the last checkpoint.
+        int64_t checkpointStep = 0;                               ///< Number of the last checkpoint (continued across restarts).
+
+        std::shared_ptr<DistributedSampler> sampler;                                ///< Per-epoch shuffling of a dataset every rank holds in full (`nullptr` = train on the local samples in order).
+        std::vector<size_t> epochOrder;                                             ///< Samples of the current epoch drawn by the sampler.
+        std::vector<size_t> batchIndices;                                           ///< Dataset indices of the current batch (mapped datasets).
+        std::vector<std::shared_ptr<PPGrad::TensorBase<Dim, DT>>> loadedInputs;     ///< Inputs of the current batch loaded from a mapped dataset (storage reused across batches).
+        std::vector<std::shared_ptr<PPGrad::TensorBase<Dim, DT>>> loadedTargets;    ///< Targets of the current batch loaded from a mapped dataset (storage reused across batches).
+        std::vector<std::shared_ptr<PPGrad::TensorBase<Dim, DT>>> batchPredictions; ///< Outputs of the current batch (storage reused across batches).
+
+        bool threadReplicas = false;                                   ///< Whether every OpenMP thread accumulates its gradients privately (see `setThreadReplicas()`).
+        std::vector<std::vector<Eigen::Tensor<DT, Dim>>> replicaGrads; ///< Private gradient of every parameter, per thread.
+        std::vector<PPGrad::GradSink<Dim, DT>> replicaSinks;           ///< Routes every thread's parameter gradients to its `replicaGrads`.
+
+        /// @brief Allocate (zeroed) private gradients for `omp_get_max_threads()` threads, unless they exist already.
+        void allocateReplicas()
         {
-            this->model = model;
-            this->optimizer = optimizer;
-            this->loss = loss;
-            this->params = model->getParams(); // TODO: Return by reference
-            this->gradSyncFreq = gradSyncFreq;
-            this->gradientAccumulation = gradientAccumulation;
+            const size_t numThreads = omp_get_max_threads();
+            if (replicaGrads.size() == numThreads)
+            {
+                return;
+            }
+            replicaGrads.assign(numThreads, std::vector<Eigen::Tensor<DT, Dim>>());
+            replicaSinks.assign(numThreads, PPGrad::GradSink<Dim, DT>());
+            for (size_t t = 0; t < numThreads; t++)
+            {
+                replicaGrads[t].reserve(params.size());
+                for (std::shared_ptr<PPGrad::TensorBase<Dim, DT>> &param : params)
+                {
+                    replicaGrads[t].emplace_back(param->getGrad()->dimensions());
+                    replicaGrads[t].back().setZero();
+                    replicaSinks[t].grads[param.get()] = &replicaGrads[t].back();
+                }
+            }
         }
 
-        void train(std::vector<std::shared_ptr<PPGrad::TensorBase<Dim, DT>>> inputs,
-                   std::vector<std::shared_ptr<PPGrad::TensorBase<Dim, DT>>> targets,
-                   size_t epochs,
-                   size_t batchSize,
-                   bool verbose = false)
+        /// @brief backward() of the current batch with thread-private gradients, followed by their reduction into the parameter gradients.
+        /// @details The samples are split statically, and every gradient element sums the threads' contributions in thread order, so the result only depends on the
+        /// number of threads, not on the timing. Buckets are only launched once the reduction is done (by the following sync).
+        void backwardReplicas(bool delayedSync)
+        {
+            synchronizer->beginBackward(batchPredictions.size(), false, false);
+#pragma omp parallel default(shared)
+            {
+                PPGrad::TensorBase<Dim, DT>::setThreadGradSink(&replicaSinks[omp_get_thread_num()]);
+#pragma omp for schedule(static)
+                for (size_t predIdx = 0; predIdx < batchPredictions.size(); predIdx++)
+                {
+                    PPGrad::TensorBase<Dim, DT>::backward(batchPredictions[predIdx]);
+                    if (delayedSync && omp_get_thread_num() == 0)
+                    {
+                        synchronizer->progress();
+                    }
+                }
+                PPGrad::TensorBase<Dim, DT>::setThreadGradSink(nullptr);
+
+                // Deterministic reduction, split across the threads by element.
+                for (size_t i = 0; i < params.size(); i++)
+                {
+                    DT *grad = params[i]->getGrad()->data();
+                    const Eigen::Index size = params[i]->getGrad()->size();
+#pragma omp for schedule(static) nowait
+                    for (Eigen::Index k = 0; k < size; k++)
+                    {
+                        DT sum = grad[k];
+                        for (std::vector<Eigen::Tensor<DT, Dim>> &replica : replicaGrads)
+                        {
+                            sum += replica[i].data()[k];
+                            replica[i].data()[k] = 0;
+                        }
+                        grad[k] = sum;
+                    }
+                }
+            }
+            synchronizer->endBackward();
+        }
+
+        /// @brief Count a completed sync and, every `checkpointInterval` syncs, start checkpointing the state reached with the batches up to local sample `nextSample` of `epoch` done.
+        void checkpointAfterSync(size_t epoch, size_t nextSample, size_t numSamples, int worldSize)
+        {
+            if (!checkpointer)
+            {
+                return;
+            }
+            checkpointer->poll();
+            if (++syncsSinceCheckpoint < checkpointInterval)
+            {
+                return;
+            }
+            syncsSinceCheckpoint = 0;
+
+            // The position is stored in global samples, so it can be mapped back to a different number of ranks.
+            if (nextSample >= numSamples)
+            {
+                epoch++;
+                nextSample = 0;
+            }
+
+            // Stage copies of the state, the checkpointer writes them in the background while training goes on.
+            Checkpoint<Dim, DT> snapshot;
+            snapshot.counters.emplace_back("epoch", epoch);
+            snapshot.counters.emplace_back("position", nextSample * worldSize);
+            snapshot.counters.emplace_back("worldSize", worldSize);
+            snapshot.addParams(params);
+            snapshot.addOptimizer("optimizer", *optimizer);
+            if (outerOptimizer)
+            {
+                snapshot.addOptimizer("outer", *outerOptimizer);
+            }
+            checkpointer->save(++checkpointStep, std::move(snapshot));
+        }
+
+        /// @brief Resume from the committed checkpoint if there is one: restore the parameters and optimizer state(s) on all ranks and return the epoch and global sample to continue at.
+        bool resumeFromCheckpoint(size_t &epoch, size_t &position, int worldRank, bool verbose)
+        {
+            int exists = worldRank == 0 && AsyncCheckpointer<Dim, DT>::exists(checkpointDirectory);
+            MPI_Bcast(&exists, 1, MPI_INT, 0, comm);
+            if (!exists)
+            {
+                return false;
+            }
+
+            Checkpoint<Dim, DT> checkpoint = AsyncCheckpointer<Dim, DT>::load(checkpointDirectory);
+            checkpoint.restoreParams(params);
+            checkpoint.restoreOptimizer("optimizer", *optimizer);
+            if (outerOptimizer)
+            {
+                checkpoint.restoreOptimizer("outer", *outerOptimizer);
+            }
+            epoch = checkpoint.counter("epoch");
+            position = checkpoint.counter("position");
+            checkpointStep = checkpoint.counter("step");
+            if (verbose)
+            {
+                std::cout << "[Rank: " << worldRank << "] "
+                          << "Resuming from " << checkpointDirectory << " (written by " << checkpoint.counter("worldSize") << " ranks) at epoch " << epoch << ", sample " << position << "." << std::endl;
+            }
+            return true;
+        }
+
+        /// @brief DiLoCo outer step: average the parameter deltas since the last outer step across all ranks and apply them to the shared parameters with the outer optimizer.
+        void outerStep(int worldSize)
+        {
+            for (size_t i = 0; i < params.size(); i++)
+            {
+                // Outer gradient: how far this rank moved away from the shared parameters.
+                *params[i]->getGrad() = anchors[i] - *params[i]->getData();
+                *params[i]->getData() = anchors[i];
+            }
+            synchronizer->finish((DT)1 / (DT)worldSize);
+            syncStats.push_back(synchronizer->getStats());
+            outerOptimizer->update(params);
+            for (size_t i = 0; i < params.size(); i++)
+            {
+                anchors[i] = *params[i]->getData();
+            }
+        }
+
+        /// @brief Training loop over the `numLocalSamples` samples of this rank; `fetchBatch(begin, end, batchInputs, batchTargets)` sets the two `DatasetView`s to the local samples [begin, end).
+        /// @details With an `epochSampler`, the local samples of every epoch are drawn into `epochOrder` first.
+        template <typename FetchBatch>
+        void trainLoop(DistributedSampler *epochSampler, size_t numLocalSamples, FetchBatch fetchBatch, size_t epochs, size_t batchSize, bool verbose)
         {
 
             int worldSize, worldRank;
-            MPI_Comm_size(MPI_COMM_WORLD, &worldSize);
-            MPI_Comm_rank(MPI_COMM_WORLD, &worldRank);
+            MPI_Comm_size(comm, &worldSize);
+            MPI_Comm_rank(comm, &worldRank);
 
             const size_t localDataStart = 0;
-            const size_t localDataEnd = inputs.size();
+            const size_t localDataEnd = numLocalSamples;
 
             if (verbose)
             {
@@ -68,69 +233,200 @@ namespace PPNN
                           << "Training on " << localDataEnd - localDataStart << " samples." << std::endl;
             }
 
+            // Every batch may end in a collective sync, so all ranks run as many batches as the largest shard needs (shards may differ in size, e.g., from
+            // `tensorScatterv()`): ranks out of samples run empty batches, which contribute no gradient but take part in the syncs.
+            unsigned long long maxLocalSamples = numLocalSamples;
+            MPI_Allreduce(MPI_IN_PLACE, &maxLocalSamples, 1, MPI_UNSIGNED_LONG_LONG, MPI_MAX, comm);
+            const size_t numBatches = (maxLocalSamples + batchSize - 1) / batchSize;
+
+            // Resume from the last checkpoint (at the first batch boundary not past the checkpointed position).
+            size_t startEpoch = 0;
+            size_t resumeBatch = 0;
+            size_t position = 0;
+            if (checkpointer && resumeFromCheckpoint(startEpoch, position, worldRank, verbose))
+            {
+                resumeBatch = std::min(position / worldSize / batchSize, numBatches);
+            }
+
+            // Local SGD starts from the (broadcast) parameters all ranks share.
+            const bool localSGD = outerOptimizer != nullptr;
+            if (localSGD)
+            {
+                anchors.clear();
+                for (std::shared_ptr<PPGrad::TensorBase<Dim, DT>> &param : params)
+                {
+                    anchors.push_back(*param->getData());
+                }
+            }
+
+            // Models running collectives (e.g., tensor-parallel layers) get their samples one after the other on the master thread.
+            const bool serialSamples = model->runsCollectives();
+            if (threadReplicas)
+            {
+                if (serialSamples)
+                {
+                    throw std::runtime_error("Per-thread replicas cannot be used with a model that runs collectives.");
+                }
+                allocateReplicas();
+            }
+
             // Train the model
             int32_t gradSyncCounter = 0;
-            for (size_t epoch = 0; epoch < epochs; epoch++)
+            for (size_t epoch = startEpoch; epoch < epochs; epoch++)
             {
                 std::vector<DT> epochLosses;
-                for (size_t batchStart = localDataStart; batchStart < localDataEnd; batchStart += batchSize)
+                if (epochSampler)
+                {
+                    epochSampler->indices(epoch, epochOrder);
+                }
+                for (size_t batch = epoch == startEpoch ? resumeBatch : 0; batch < numBatches; batch++)
                 {
+                    const size_t batchStart = std::min(localDataStart + batch * batchSize, localDataEnd);
+                    const size_t batchEnd = std::min(batchStart + batchSize, localDataEnd);
+                    DatasetView<Dim, DT> batchInputs, batchTargets;
+                    fetchBatch(batchStart, batchEnd, batchInputs, batchTargets);
+                    batchPredictions.resize(batchInputs.size());
 
-                    std::vector<std::shared_ptr<PPGrad::TensorBase<Dim, DT>>> batchPredictions(batchSize);
+                    // Delayed gradients are still in flight during forward(), so keep progressing them from the master thread.
+                    const bool delayedSync = synchronizer->getStaleness() > 0;
+#pragma omp parallel for default(shared) if (!serialSamples)
+                    for (size_t batchIdx = 0; batchIdx < batchPredictions.size(); batchIdx++)
+                    {
+                        batchPredictions[batchIdx] = model->forward(batchInputs[batchIdx]);
+                        if (delayedSync && omp_get_thread_num() == 0)
+                        {
+                            synchronizer->progress();
+                        }
+                    }
 
-#pragma omp parallel for default(shared)
-                    for (size_t batchIdx = batchStart; batchIdx < batchStart + batchSize; batchIdx++)
+                    if (!batchPredictions.empty())
                     {
-                        batchPredictions[batchIdx - batchStart] = model->forward(inputs[batchIdx]);
+                        DT batchLoss = 0;
+                        for (size_t batchIdx = 0; batchIdx < batchPredictions.size(); batchIdx++)
+                        {
+                            batchLoss += loss->operator()(batchPredictions[batchIdx], batchTargets[batchIdx], true);
+                        }
+                        batchLoss /= batchPredictions.size();
+                        epochLosses.push_back(batchLoss);
                     }
 
-                    std::vector<std::shared_ptr<PPGrad::TensorBase<Dim, DT>>> batchTargets;
-                    for (size_t batchIdx = batchStart; batchIdx < batchStart + batchSize; batchIdx++)
+                    // Call backward on each output produced by forward() to accumulate gradients in the parameters.
+                    // On sync steps, the master thread starts the allreduce of every bucket whose gradients are final in between its samples.
+                    const bool syncStep = !localSGD && !sharded && gradSyncCounter + 1 == gradSyncFreq;
+                    if (threadReplicas)
                     {
-                        batchTargets.push_back(targets[batchIdx]);
+                        backwardReplicas(delayedSync);
                     }
+                    else
+                    {
+                        synchronizer->beginBackward(batchPredictions.size(), syncStep);
+                        std::atomic<size_t> samplesDone{0};
+#pragma omp parallel default(shared) if (!serialSamples)
+                        {
+#pragma omp for schedule(dynamic, 1) nowait
+                            for (size_t predIdx = 0; predIdx < batchPredictions.size(); predIdx++)
+                            {
+                                PPGrad::TensorBase<Dim, DT>::backward(batchPredictions[predIdx]);
+                                samplesDone++;
+                                if (syncStep && omp_get_thread_num() == 0)
+                                {
+                                    synchronizer->poll();
+                                }
+                            }
 
-                    DT batchLoss = loss->operator()(batchPredictions, batchTargets, true);
-                    epochLosses.push_back(batchLoss);
+                            // Once out of samples, the master thread keeps launching buckets while the other threads finish theirs.
+                            if (syncStep && omp_get_thread_num() == 0)
+                            {
+                                while (samplesDone.load() < batchPredictions.size())
+                                {
+                                    synchronizer->poll();
+                                    std::this_thread::yield();
+                                }
+                            }
+                        }
+                        synchronizer->endBackward();
+                    }
 
-// Call backward on each output produced by forward() to accumulate gradients in the parameters.
-#pragma omp parallel for default(shared)
-                    for (std::shared_ptr<PPGrad::TensorBase<Dim, DT>> &prediction : batchPredictions)
+                    // Local SGD: inner step on the local copy every batch, outer step across all ranks every Nth batch.
+                    if (localSGD)
                     {
-                        PPGrad::TensorBase<Dim, DT>::backward(prediction);
+                        if (!batchPredictions.empty())
+                        {
+                            optimizer->update(params);
+                        }
+                        if (++gradSyncCounter == gradSyncFreq)
+                        {
+                            if (verbose)
+                            {
+                                std::cout << "[Rank: " << worldRank << "] "
+                                          << " Outer step: averaging the deltas of " << params.size() << " parameters." << std::endl;
+                            }
+                            outerStep(worldSize);
+                            gradSyncCounter = 0;
+                            checkpointAfterSync(epoch, (batch + 1) * batchSize, numBatches * batchSize, worldSize);
+                        }
+                        continue;
                     }
 
-                    // Allreduce the gradients across all processes (MPI_Allreduce) every Nth batch.
+                    // Allreduce the gradients across all processes every Nth batch.
+                    bool applyGrad = true;
                     if (++gradSyncCounter == gradSyncFreq)
                     {
                         if (verbose)
                         {
                             std::cout << "[Rank: " << worldRank << "] "
-                                      << " Syncing " << params.size() << " parameters." << std::endl;
+                                      << " Syncing " << params.size() << " parameters in " << synchronizer->numBuckets() << " buckets." << std::endl;
                         }
 
-                        for (std::shared_ptr<PPGrad::TensorBase<Dim, DT>> &param : params)
+                        DT scale = (DT)1 / (DT)worldSize;
+                        if (this->gradientAccumulation)
+                            scale /= (DT)gradSyncFreq;
+                        if (sharded)
                         {
-                            MPI_Allreduce(MPI_IN_PLACE, param->getGrad()->data(), param->getGrad()->size(), MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-                            *param->getGrad() = *param->getGrad() / (DT)worldSize;
-
-                            if (this->gradientAccumulation)
-                                *param->getGrad() = *param->getGrad() / (DT)gradSyncFreq;
+                            // The sharded optimizer reduce-scatters the gradients itself.
+                            sharded->setGradScale(scale);
+                        }
+                        else if (delayedSync)
+                        {
+                            // Apply the (stale) gradient launched `staleness` syncs ago, nothing while the pipeline fills up.
+                            applyGrad = synchronizer->finishDelayed(scale);
+                        }
+                        else
+                        {
+                            synchronizer->finish(scale);
                         }
                         gradSyncCounter = 0;
 
-                        if (this->gradientAccumulation)
+                        const SyncStats &stats = synchronizer->getStats();
+                        if (!sharded)
+                        {
+                            syncStats.push_back(stats);
+                        }
+                        if (verbose && !sharded)
+                        {
+                            std::cout << "[Rank: " << worldRank << "] "
+                                      << " Step " << syncStats.size() << ": " << stats.bucketsLaunchedEarly << "/" << stats.buckets << " buckets launched during backward, "
+                                      << "backward " << stats.backwardTime * 1e3 << " ms, overlapped " << stats.overlapTime * 1e3 << " ms, exposed " << stats.exposedTime * 1e3 << " ms "
+                                      << "(" << stats.overlapRatio() * 100.0 << "% overlap)." << std::endl;
+                        }
+
+                        if (this->gradientAccumulation && applyGrad)
                         {
                             // Update the parameters
                             optimizer->update(params);
                         }
                     }
 
-                    if (!this->gradientAccumulation)
+                    if (!this->gradientAccumulation && applyGrad)
                     {
                         // Update the parameters
                         optimizer->update(params);
                     }
+
+                    if (gradSyncCounter == 0)
+                    {
+                        checkpointAfterSync(epoch, (batch + 1) * batchSize, numBatches * batchSize, worldSize);
+                    }
                 }
 
                 if (verbose)
@@ -141,12 +437,38 @@ namespace PPNN
             }
 
             // Last sync
-            for (std::shared_ptr<PPGrad::TensorBase<Dim, DT>> &param : params)
+            if (localSGD)
+            {
+                if (gradSyncCounter > 0)
+                {
+                    outerStep(worldSize);
+                }
+            }
+            else if (synchronizer->getStaleness() > 0)
             {
-                MPI_Allreduce(MPI_IN_PLACE, param->getGrad()->data(), param->getGrad()->size(), MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-                *param->getGrad() = *param->getGrad() / (DT)worldSize;
+                if (synchronizer->finishDelayed((DT)1 / (DT)worldSize))
+                {
+                    optimizer->update(params);
+                }
+
+                // Flush the delayed gradients still in flight
+                while (synchronizer->drain())
+                {
+                    optimizer->update(params);
+                }
+            }
+            else
+            {
+                if (sharded)
+                {
+                    sharded->setGradScale((DT)1 / (DT)worldSize);
+                }
+                else
+                {
+                    synchronizer->finish((DT)1 / (DT)worldSize);
+                }
+                optimizer->update(params);
             }
-            optimizer->update(params);
 
 #ifdef PPGRAD_DEBUG
             // print 10 params from each parameter tensor
@@ -159,8 +481,263 @@ namespace PPNN
             }
 #endif
 
+            // Commit the checkpoint still being written
+            if (checkpointer)
+            {
+                checkpointer->complete();
+            }
+
             // Finalize the training across nodes
-            MPI_Barrier(MPI_COMM_WORLD);
+            MPI_Barrier(comm);
+        }
+
+    public:
+        /// @brief Construct the trainer.
+        /// @param model Model to train (should be the same on all ranks, see `PPGrad::modelBroadcast`).
+        /// @param optimizer Optimizer used to update the parameters after the gradients have been synchronized.
+        /// @param loss Loss function.
+        /// @param gradSyncFreq Synchronize the gradients every `gradSyncFreq` batches.
+        /// @param gradientAccumulation Accumulate gradients between synchronizations and only update then (otherwise update locally after every batch).
+        /// @param bucketSizeBytes Maximum size of a gradient bucket, i.e., granularity at which allreduce is overlapped with backward().
+        /// @param comm Ranks to synchronize with. Pass a sub-communicator to combine data parallelism with model parallelism inside the model, e.g., one communicator per
+        /// shard of tensor-parallel layers (see `NN/TensorParallel.hpp`), each holding the ranks with the same shard, for 2-D parallelism.
+        DPTrainer(
+            std::shared_ptr<Model<Dim, DT>> model,
+            std::shared_ptr<Optimizer<Dim, DT>> optimizer,
+            std::shared_ptr<Loss<Dim, DT>> loss,
+            int32_t gradSyncFreq = 16, // very conservative default value (see DiLoCo paper)
+            bool gradientAccumulation = false,
+            size_t bucketSizeBytes = 25 * 1024 * 1024, // PyTorch DDP default
+            MPI_Comm comm = MPI_COMM_WORLD)
+        {
+            this->model = model;
+            this->optimizer = optimizer;
+            this->loss = loss;
+            this->params = model->getParams(); // TODO: Return by reference
+            this->gradSyncFreq = gradSyncFreq;
+            this->gradientAccumulation = gradientAccumulation;
+            MPI_Comm_dup(comm, &this->comm);
+            this->synchronizer = std::make_unique<GradSynchronizer<Dim, DT>>(this->params, bucketSizeBytes, this->comm);
+        }
+
+        ~DPTrainer()
+        {
+            int finalized;
+            MPI_Finalized(&finalized);
+            if (!finalized)
+            {
+                MPI_Comm_free(&comm);
+            }
+        }
+
+        /// @brief Enable delayed gradient synchronization: the gradient launched at sync `t` is only applied at sync `t + staleness`, so its allreduce runs behind the following batches instead of on the critical path.
+        /// @details Builds on `gradSyncFreq`, i.e., the delay is counted in syncs, not batches. The remaining in-flight gradients are applied at the end of `train()`.
+        /// @param staleness Staleness bound in syncs (0 = synchronous, 1 = one-step stale).
+        /// @param compensation Optional delay compensation strength `lambda` for `g + lambda * g * g * (w_now - w_then)` (0 = off).
+        void setDelayedSync(int32_t staleness = 1, DT compensation = 0)
+        {
+            if (staleness > 0 && outerOptimizer)
+            {
+                throw std::runtime_error("Delayed synchronization cannot be combined with local SGD.");
+            }
+            if (staleness > 0 && sharded)
+            {
+                throw std::runtime_error("Delayed synchronization cannot be combined with optimizer sharding.");
+            }
+            synchronizer->setStaleness(staleness, compensation);
+        }
+
+        /// @brief Switch to DiLoCo-style local SGD: every rank takes `gradSyncFreq` inner optimizer steps on its own copy of the model, then the parameter deltas are averaged across ranks and applied by `outerOptimizer`.
+        /// @details Only the deltas are communicated (through the configured gradient reducer), i.e., once every `gradSyncFreq` batches instead of every batch. `gradientAccumulation` is ignored in this mode.
+        /// @param outerOptimizer Optimizer applied to the averaged deltas, e.g., `NesterovSGD(0.7, 0.9)` as in the DiLoCo paper (`nullptr` switches back to gradient synchronization).
+        void setLocalSGD(std::shared_ptr<Optimizer<Dim, DT>> outerOptimizer)
+        {
+            if (outerOptimizer && synchronizer->getStaleness() > 0)
+            {
+                throw std::runtime_error("Local SGD cannot be combined with delayed synchronization.");
+            }
+            if (outerOptimizer && sharded)
+            {
+                throw std::runtime_error("Local SGD cannot be combined with optimizer sharding.");
+            }
+            this->outerOptimizer = outerOptimizer;
+        }
+
+        /// @brief Shard the optimizer state across the ranks (ZeRO): the gradients are reduce-scattered instead of allreduced, every rank updates its 1/N slice of the
+        /// flattened parameters with the optimizer and the updated slices are allgathered (see `ShardedOptimizer`).
+        /// @details The optimizer state per rank (e.g., Adam's moments) then shrinks linearly with the number of ranks. Every optimizer step is a synchronization, so
+        /// either the gradients are accumulated between syncs or synchronized every batch (`gradSyncFreq = 1`). The gradient communication no longer overlaps with backward(), and the gradient buckets' buffers are freed.
+        /// Checkpoints hold the gathered optimizer state. Collective over all ranks.
+        /// @param sharding Whether to shard the optimizer state (switching resets the optimizer state).
+        void setOptimizerSharding(bool sharding = true)
+        {
+            if (sharding == (sharded != nullptr))
+            {
+                return;
+            }
+            if (!sharding)
+            {
+                optimizer = sharded->getOptimizer();
+                optimizer->resetState();
+                sharded = nullptr;
+                return;
+            }
+            if (outerOptimizer || synchronizer->getStaleness() > 0)
+            {
+                throw std::runtime_error("Optimizer sharding cannot be combined with local SGD or delayed synchronization.");
+            }
+            if (!gradientAccumulation && gradSyncFreq != 1)
+            {
+                throw std::invalid_argument("Optimizer sharding needs gradient accumulation or a gradient sync every batch.");
+            }
+            optimizer->resetState();
+            sharded = std::make_shared<ShardedOptimizer<Dim, DT>>(optimizer, comm);
+            optimizer = sharded;
+            // The buckets are not launched while sharding, so their buffers would only hold a full copy of the gradients.
+            synchronizer->releaseBuffers();
+        }
+
+        /// @brief Give every OpenMP thread its own lightweight replica of the model for backward(): the parameter values are shared read-only, but every thread
+        /// accumulates its parameter gradients in private buffers, which are reduced deterministically once per batch, before the gradient synchronization.
+        /// @details Removes the lock every gradient contribution otherwise takes and the cache line transfers of the shared gradients. The buckets' allreduce then
+        /// starts after backward() instead of overlapping with it. Uses one set of gradient buffers per thread.
+        /// @param threadReplicas Whether to use per-thread replicas.
+        void setThreadReplicas(bool threadReplicas = true)
+        {
+            this->threadReplicas = threadReplicas;
+            if (!threadReplicas)
+            {
+                replicaGrads.clear();
+                replicaSinks.clear();
+            }
+        }
+
+        /// @brief Checkpoint the training state periodically and resume from it automatically.
+        /// @details Every `interval` syncs (outer steps with local SGD), the parameters, the optimizer state(s) and the position in the data are staged (copied) and written
+        /// in the background by an `AsyncCheckpointer`, every rank its own shard, while training continues; a checkpoint only counts once rank 0 committed its manifest.
+        /// If `directory` holds a committed checkpoint when `train()` starts, all ranks (which must see the same file system) resume from it instead of starting over,
+        /// so a failed job loses at most `interval` syncs plus the checkpoint in flight.
+        /// The position is stored in global samples and mapped back with the current number of ranks, so the job can be restarted with a different world size
+        /// as long as every rank gets its strided shard of the data (see `PPGrad::ShardModes::STRIDED`). Gradient reducer state (e.g., error feedback residuals) and delayed
+        /// gradients still in flight are not part of a checkpoint. Collective over all ranks.
+        /// @param directory Checkpoint directory (empty disables checkpointing).
+        /// @param interval Checkpoint every this many syncs.
+        void setCheckpointing(const std::string &directory, int32_t interval = 100)
+        {
+            if (interval < 1)
+            {
+                throw std::invalid_argument("Checkpoint interval must be at least 1.");
+            }
+            checkpointDirectory = directory;
+            checkpointInterval = interval;
+            syncsSinceCheckpoint = 0;
+            checkpointer = directory.empty() ? nullptr : std::make_unique<AsyncCheckpointer<Dim, DT>>(directory, comm);
+        }
+
+        /// @brief Statistics of the background checkpoint writes (`nullptr` if checkpointing is off).
+        const CheckpointStats *getCheckpointStats() const
+        {
+            return checkpointer ? &checkpointer->getStats() : nullptr;
+        }
+
+        /// @brief Replace the stage that sums the gradient buckets across ranks, e.g., by a compressing one like `TopKReducer`.
+        /// @param reducer Reducer used for every bucket from now on (dense `AllreduceReducer` by default).
+        void setGradReducer(std::shared_ptr<GradReducer<DT>> reducer)
+        {
+            synchronizer->setReducer(reducer);
+        }
+
+        /// @brief Bytes of the gradient synchronization buffers this rank holds: the bucket buffers, or with optimizer sharding the slice and reduce-scatter buffer of `ShardedOptimizer`.
+        size_t getSyncBufferBytes() const
+        {
+            return synchronizer->bufferBytes() + (sharded ? sharded->workspaceBytes() : 0);
+        }
+
+        /// @brief Stage that sums the gradient buckets across ranks (e.g., to query the bytes it sent).
+        std::shared_ptr<GradReducer<DT>> getGradReducer() const
+        {
+            return synchronizer->getReducer();
+        }
+
+        /// @brief Overlap report of every gradient synchronization done so far (one entry per synced step).
+        const std::vector<SyncStats> &getSyncStats() const
+        {
+            return syncStats;
+        }
+
+        /// @brief Shuffle the samples every epoch with `sampler`: `train()` then expects the whole dataset on every rank (cheaply with `PPGrad::MappedTensorDataset`) and
+        /// trains on the samples the sampler assigns to this rank, a different share every epoch.
+        /// @param sampler Sampler for this rank (`nullptr` switches back to training on the given, already distributed samples in order).
+        void setSampler(std::shared_ptr<DistributedSampler> sampler)
+        {
+            this->sampler = sampler;
+        }
+
+        /// @brief Train the model on `inputs` and `targets` (e.g., `std::vector`s of tensors, which are viewed, not copied), which are this rank's shard of the data,
+        /// or the whole dataset if a sampler is set (see `setSampler()`).
+        /// @details Every batch is a slice of the views (through the sampler's order, if set), the last batch of an epoch may be smaller than `batchSize`.
+        /// The shards of the ranks may differ in size: all ranks run the number of batches of the largest one, empty ones once out of samples.
+        void train(DatasetView<Dim, DT> inputs,
+                   DatasetView<Dim, DT> targets,
+                   size_t epochs,
+                   size_t batchSize,
+                   bool verbose = false)
+        {
+            if (inputs.size() != targets.size())
+            {
+                throw std::invalid_argument("Inputs and targets must have the same number of samples.");
+            }
+            if (sampler && sampler->getNumSamples() != inputs.size())
+            {
+                throw std::invalid_argument("The sampler expects " + std::to_string(sampler->getNumSamples()) + " samples, got " + std::to_string(inputs.size()) + ".");
+            }
+            trainLoop(
+                sampler.get(), sampler ? sampler->getNumLocalSamples() : inputs.size(), [&](size_t begin, size_t end, DatasetView<Dim, DT> &batchInputs, DatasetView<Dim, DT> &batchTargets)
+                {
+                    batchInputs = (sampler ? inputs.gather(epochOrder) : inputs).slice(begin, end);
+                    batchTargets = (sampler ? targets.gather(epochOrder) : targets).slice(begin, end); },
+                epochs, batchSize, verbose);
+        }
+
+        /// @brief Train the model on memory-mapped `inputs` and `targets`, which every rank maps in full.
+        /// @details Every batch is copied out of the mapping into reused tensors while the next one is prefetched in the background. The samples of this rank come from the
+        /// sampler (see `setSampler()`); without one, a strided shard is used in order (through an unshuffled `DistributedSampler` for this call only).
+        void train(PPGrad::MappedTensorDataset<Dim, DT> &inputs,
+                   PPGrad::MappedTensorDataset<Dim, DT> &targets,
+                   size_t epochs,
+                   size_t batchSize,
+                   bool verbose = false)
+        {
+            if (inputs.size() != targets.size())
+            {
+                throw std::invalid_argument("Inputs and targets must have the same number of samples.");
+            }
+            std::shared_ptr<DistributedSampler> epochSampler = sampler;
+            if (!epochSampler)
+            {
+                int worldSize, worldRank;
+                MPI_Comm_size(comm, &worldSize);
+                MPI_Comm_rank(comm, &worldRank);
+                epochSampler = std::make_shared<DistributedSampler>(inputs.size(), worldSize, worldRank, 0, false);
+            }
+            if (epochSampler->getNumSamples() != inputs.size())
+            {
+                throw std::invalid_argument("The sampler expects " + std::to_string(epochSampler->getNumSamples()) + " samples, got " + std::to_string(inputs.size()) + ".");
+            }
+            trainLoop(
+                epochSampler.get(), epochSampler->getNumLocalSamples(), [&](size_t begin, size_t end, DatasetView<Dim, DT> &batchInputs, DatasetView<Dim, DT> &batchTargets)
+                {
+                    batchIndices.assign(epochOrder.begin() + begin, epochOrder.begin() + end);
+                    inputs.load(batchIndices, loadedInputs);
+                    targets.load(batchIndices, loadedTargets);
+                    batchInputs = loadedInputs;
+                    batchTargets = loadedTargets;
+
+                    // Fault in the next batch of this epoch while this one is computed.
+                    batchIndices.assign(epochOrder.begin() + end, epochOrder.begin() + std::min(end + (end - begin), epochOrder.size()));
+                    inputs.prefetch(batchIndices);
+                    targets.prefetch(batchIndices); },
+                epochs, batchSize, verbose);
         }
     };
 
@@ -0,0 +1,86 @@
+/** @file
+ * @brief Non-owning, span-like view of a dataset of tensors, so trainers can iterate batches without copying `shared_ptr`s.
+ */
+
+#pragma once
+
+#include "Tensor/TensorBase.hpp"
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+namespace PPNN
+{
+
+    /// @brief View of a sequence of samples owned by someone else (e.g., a `std::vector` of tensors), optionally visited through an index array.
+    /// @details Copying a view or taking a slice of it only copies two pointers and a size, never the samples or their reference counts.
+    /// The viewed samples (and indices) have to outlive the view.
+    template <int Dim, typename DT>
+    class DatasetView
+    {
+    public:
+        using Sample = std::shared_ptr<PPGrad::TensorBase<Dim, DT>>;
+
+    private:
+        const Sample *samples = nullptr; ///< First sample (of the underlying storage if `indices` is set).
+        const size_t *indices = nullptr; ///< Positions of the viewed samples in `samples` (`nullptr` = contiguous).
+        size_t count = 0;                ///< Number of viewed samples.
+
+    public:
+        DatasetView() = default;
+
+        /// @brief View all samples of `samples`.
+        DatasetView(const std::vector<Sample> &samples) : samples(samples.data()), count(samples.size()) {}
+
+        /// @brief View `count` samples starting at `samples`, or, given `indices`, the samples `samples[indices[0]]`, ..., `samples[indices[count - 1]]`.
+        DatasetView(const Sample *samples, size_t count, const size_t *indices = nullptr) : samples(samples), indices(indices), count(count) {}
+
+        /// @brief Number of viewed samples.
+        size_t size() const
+        {
+            return count;
+        }
+
+        bool empty() const
+        {
+            return count == 0;
+        }
+
+        const Sample &operator[](size_t i) const
+        {
+            return samples[indices ? indices[i] : i];
+        }
+
+        /// @brief View of the samples [begin, end) of this view (clamped to its size).
+        DatasetView slice(size_t begin, size_t end) const
+        {
+            end = std::min(end, count);
+            begin = std::min(begin, end);
+            return indices ? DatasetView(samples, end - begin, indices + begin) : DatasetView(samples + begin, end - begin);
+        }
+
+        /// @brief Number of batches of (at most) `batchSize` samples, the last one may be partial.
+        size_t numBatches(size_t batchSize) const
+        {
+            return (count + batchSize - 1) / batchSize;
+        }
+
+        /// @brief View of batch `b` (see `numBatches()`).
+        DatasetView batch(size_t b, size_t batchSize) const
+        {
+            return slice(b * batchSize, (b + 1) * batchSize);
+        }
+
+        /// @brief View of the samples `indices` of this (contiguous) view, in that order, e.g., a shuffled epoch.
+        DatasetView gather(const std::vector<size_t> &indices) const
+        {
+            if (this->indices)
+            {
+                throw std::invalid_argument("Only contiguous dataset views can be gathered.");
+            }
+            return DatasetView(samples, indices.size(), indices.data());
+        }
+    };
+
+} // namespace PPNN
@@ -0,0 +1,92 @@
+/** @file
+ * @brief Per-epoch shuffling of a dataset shared by all ranks, without any communication.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+namespace PPNN
+{
+
+    /// @brief Gives every rank its share of a fresh global permutation of the samples each epoch.
+    /// @details All ranks construct the sampler with the same seed, so they derive the same permutation of [0, `numSamples`) for an epoch independently (Fisher-Yates
+    /// driven by `std::mt19937_64`, seeded from the seed and the epoch, which is reproducible across platforms). Rank `r` gets every `numReplicas`-th entry starting at `r`
+    /// (the strided split `DPTrainer` checkpoints assume); the permutation is repeated from its beginning until all ranks have the same number of samples, so they run the
+    /// same number of batches. The samples themselves are not moved: the dataset has to be available on every rank, ideally memory-mapped (see `PPGrad::MappedTensorDataset`),
+    /// so reshuffling only costs the index computation.
+    class DistributedSampler
+    {
+    private:
+        size_t numSamples;
+        int numReplicas;
+        int rank;
+        uint64_t seed;
+        bool shuffle;
+
+    public:
+        /// @brief Construct the sampler.
+        /// @param numSamples Number of samples of the (global) dataset.
+        /// @param numReplicas Number of ranks sharing the dataset.
+        /// @param rank Rank to sample for.
+        /// @param seed Seed shared by all ranks.
+        /// @param shuffle Whether to permute the samples (otherwise every rank gets the same strided shard every epoch).
+        DistributedSampler(size_t numSamples, int numReplicas, int rank, uint64_t seed = 0, bool shuffle = true)
+            : numSamples(numSamples), numReplicas(numReplicas), rank(rank), seed(seed), shuffle(shuffle)
+        {
+            if (numSamples == 0 || numReplicas < 1 || rank < 0 || rank >= numReplicas)
+            {
+                throw std::invalid_argument("DistributedSampler needs at least one sample and a rank in [0, numReplicas).");
+            }
+        }
+
+        /// @brief Number of samples of the (global) dataset.
+        size_t getNumSamples() const
+        {
+            return numSamples;
+        }
+
+        /// @brief Number of samples every rank gets per epoch.
+        size_t getNumLocalSamples() const
+        {
+            return (numSamples + numReplicas - 1) / numReplicas;
+        }
+
+        /// @brief Compute this rank's samples of `epoch`, in the order to visit them.
+        /// @param epoch Epoch to sample.
+        /// @param indices Overwritten with the `getNumLocalSamples()` global sample indices (reuses its storage).
+        void indices(size_t epoch, std::vector<size_t> &indices) const
+        {
+            std::vector<size_t> permutation(numSamples);
+            for (size_t i = 0; i < numSamples; i++)
+                permutation[i] = i;
+            if (shuffle)
+            {
+                std::seed_seq sequence{(uint32_t)seed, (uint32_t)(seed >> 32), (uint32_t)epoch, (uint32_t)((uint64_t)epoch >> 32)};
+                std::mt19937_64 generator(sequence);
+                for (size_t i = numSamples - 1; i > 0; i--)
+                {
+                    std::swap(permutation[i], permutation[generator() % (i + 1)]);
+                }
+            }
+
+            indices.resize(getNumLocalSamples());
+            for (size_t i = 0; i < indices.size(); i++)
+            {
+                indices[i] = permutation[(i * numReplicas + rank) % numSamples];
+            }
+        }
+
+        /// @brief Compute this rank's samples of `epoch`, in the order to visit them.
+        std::vector<size_t> indices(size_t epoch) const
+        {
+            std::vector<size_t> result;
+            indices(epoch, result);
+            return result;
+        }
+    };
+
+} // namespace PPNN
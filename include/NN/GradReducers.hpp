@@ -0,0 +1,1165 @@
+/** @file
+ * @brief Pluggable reduction (and compression) stages used by `GradSynchronizer` to sum gradient buckets across ranks.
+ */
+
+#pragma once
+
+#include "TensorMPI.hpp"
+#include "HalfPrecision.hpp"
+#include <Eigen/Dense>
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <atomic>
+#include <random>
+#include <unordered_set>
+#include <deque>
+#include <memory>
+#include <mpi.h>
+
+namespace PPNN
+{
+
+    /// @brief 16-bit floating point formats gradients can be sent in.
+    enum class CommPrecisions
+    {
+        BF16,
+        FP16
+    };
+
+    /// @brief Group of parameters whose gradients are packed into one flat buffer and allreduced together.
+    /// @details Every bucket has one buffer per in-flight step (a single one unless delayed synchronization is enabled).
+    /// @tparam DT Data type of the gradients.
+    template <typename DT>
+    struct GradBucket
+    {
+        std::vector<size_t> paramIdx;           ///< Indices (into the synchronizer's parameter list) of the parameters in this bucket.
+        std::vector<size_t> offsets;            ///< Offset of each parameter's gradient in the flat buffers.
+        std::vector<size_t> rows;               ///< Leading dimension of each parameter's gradient (i.e., it is a `rows x (elements / rows)` column-major matrix).
+        size_t size = 0;                        ///< Number of elements in the bucket.
+        std::vector<std::vector<DT>> buffers;   ///< Flat communication buffer of every in-flight step.
+        std::vector<std::vector<DT>> snapshots; ///< Parameter values the gradient of every in-flight step was computed at (delay compensation only).
+        std::atomic<int32_t> pending{0};        ///< Parameters whose gradient is not final yet in the current step.
+    };
+
+    /// @brief Base class for all gradient reducers, i.e., the stage that sums a packed gradient bucket across the ranks of a communicator.
+    /// @details `start()` and `finish()` are always called from the same (master) thread, in the same bucket order on every rank. Between the two, the bucket's buffer of the given slot belongs to the reducer.
+    /// @tparam DT Data type of the gradients.
+    template <typename DT>
+    class GradReducer
+    {
+    private:
+        std::vector<std::vector<std::vector<MPI_Request>>> requests; ///< Outstanding requests of every [bucket][slot].
+
+    protected:
+        size_t bytesSent = 0; ///< Payload bytes this rank handed to MPI so far.
+
+        /// @brief Per [bucket][slot] state of a reducer (grown on demand).
+        template <typename T>
+        static T &slotState(std::vector<std::vector<T>> &store, size_t bucketIdx, size_t slot)
+        {
+            if (store.size() <= bucketIdx)
+                store.resize(bucketIdx + 1);
+            if (store[bucketIdx].size() <= slot)
+                store[bucketIdx].resize(slot + 1);
+            return store[bucketIdx][slot];
+        }
+
+        /// @brief Requests of the given bucket & slot.
+        std::vector<MPI_Request> &requestsFor(size_t bucketIdx, size_t slot)
+        {
+            return slotState(requests, bucketIdx, slot);
+        }
+
+        /// @brief Wait for (and forget) all requests of the given bucket & slot.
+        void waitFor(size_t bucketIdx, size_t slot)
+        {
+            std::vector<MPI_Request> &reqs = requestsFor(bucketIdx, slot);
+            MPI_Waitall(reqs.size(), reqs.data(), MPI_STATUSES_IGNORE);
+            reqs.clear();
+        }
+
+    public:
+        virtual ~GradReducer() = default;
+
+        /// @brief Allocate the per-bucket resources of the reducer up front, so `start()` does not have to (collectively) allocate them in the middle of backward().
+        /// @details Collective over `comm`: called on every rank by `GradSynchronizer` whenever the reducer is installed or the number of in-flight slots changes.
+        /// @param buckets Buckets that will be passed to `start()` (their index is the bucket index).
+        /// @param numSlots Number of in-flight slots of every bucket.
+        /// @param comm Communicator that will be passed to `start()`.
+        virtual void prepare(const std::vector<std::unique_ptr<GradBucket<DT>>> & /*buckets*/, size_t /*numSlots*/, MPI_Comm /*comm*/)
+        {
+        }
+
+        /// @brief Start summing the bucket's buffer of `slot` across `comm`.
+        /// @param bucket Bucket whose `buffers[slot]` holds the packed local gradients.
+        /// @param bucketIdx Index of the bucket (stable across steps, used to keep per-bucket state).
+        /// @param slot In-flight slot of the step being launched.
+        /// @param comm Communicator to reduce over.
+        virtual void start(GradBucket<DT> &bucket, size_t bucketIdx, size_t slot, MPI_Comm comm) = 0;
+
+        /// @brief Finish the reduction started by `start()`, leaving the sum in `bucket.buffers[slot]`.
+        virtual void finish(GradBucket<DT> &bucket, size_t bucketIdx, size_t slot) = 0;
+
+        /// @brief Progress the outstanding requests (MPI implementations without an asynchronous progress thread only advance them inside MPI calls).
+        virtual void progress()
+        {
+            int done;
+            for (std::vector<std::vector<MPI_Request>> &bucketRequests : requests)
+                for (std::vector<MPI_Request> &slotRequests : bucketRequests)
+                    for (MPI_Request &request : slotRequests)
+                        if (request != MPI_REQUEST_NULL)
+                            MPI_Test(&request, &done, MPI_STATUS_IGNORE);
+        }
+
+        /// @brief Payload bytes this rank handed to MPI so far (i.e., what a compressor saves on).
+        size_t getBytesSent() const
+        {
+            return bytesSent;
+        }
+    };
+
+    /// @brief Plain dense sum using a nonblocking `MPI_Iallreduce` per bucket.
+    /// @tparam DT Data type of the gradients.
+    template <typename DT>
+    class AllreduceReducer : public GradReducer<DT>
+    {
+    public:
+        void start(GradBucket<DT> &bucket, size_t bucketIdx, size_t slot, MPI_Comm comm) override
+        {
+            std::vector<MPI_Request> &reqs = this->requestsFor(bucketIdx, slot);
+            reqs.resize(1);
+            MPI_Iallreduce(MPI_IN_PLACE, bucket.buffers[slot].data(), bucket.size, PPGrad::mpiDatatype<DT>(), MPI_SUM, comm, &reqs[0]);
+            this->bytesSent += bucket.size * sizeof(DT);
+        }
+
+        void finish(GradBucket<DT> & /*bucket*/, size_t bucketIdx, size_t slot) override
+        {
+            this->waitFor(bucketIdx, slot);
+        }
+    };
+
+    /// @brief Top-k sparsification with error feedback.
+    /// @details Every rank adds its residual (the part of the gradient it did not send so far) to the bucket, keeps only the `k = ceil(ratio * size)` entries of largest magnitude and stores the rest back as the residual.
+    /// The (index, value) pairs of all ranks are exchanged with `MPI_Iallgather` and scattered-added into the dense result, so the reduction stays unbiased over time while only `k` entries per rank travel over the network.
+    /// @tparam DT Data type of the gradients.
+    template <typename DT>
+    class TopKReducer : public GradReducer<DT>
+    {
+    private:
+        double ratio;
+        std::vector<std::vector<DT>> residuals;                 ///< Error feedback of every bucket.
+        std::vector<std::vector<std::vector<int32_t>>> sendIdx; ///< Selected indices of every [bucket][slot].
+        std::vector<std::vector<std::vector<DT>>> sendVal;      ///< Selected values of every [bucket][slot].
+        std::vector<std::vector<std::vector<int32_t>>> recvIdx; ///< Gathered indices of every [bucket][slot].
+        std::vector<std::vector<std::vector<DT>>> recvVal;      ///< Gathered values of every [bucket][slot].
+
+    public:
+        /// @brief Construct the top-k reducer.
+        /// @param ratio Fraction of every bucket's entries to send (e.g., 0.01 sends 1%), at least one entry is always sent.
+        TopKReducer(double ratio)
+        {
+            if (ratio <= 0.0 || ratio > 1.0)
+            {
+                throw std::invalid_argument("Top-k ratio must be in (0, 1].");
+            }
+            this->ratio = ratio;
+        }
+
+        /// @brief Number of entries sent for a bucket of `size` elements.
+        size_t k(size_t size) const
+        {
+            return std::max<size_t>(1, std::min<size_t>(size, (size_t)std::ceil(ratio * size)));
+        }
+
+        void start(GradBucket<DT> &bucket, size_t bucketIdx, size_t slot, MPI_Comm comm) override
+        {
+            if (residuals.size() <= bucketIdx)
+                residuals.resize(bucketIdx + 1);
+            std::vector<DT> &residual = residuals[bucketIdx];
+            residual.resize(bucket.size, (DT)0);
+
+            // Error feedback: compress the gradient plus everything not sent so far.
+            std::vector<DT> &buffer = bucket.buffers[slot];
+            for (size_t i = 0; i < bucket.size; i++)
+            {
+                residual[i] += buffer[i];
+            }
+
+            const size_t count = k(bucket.size);
+            std::vector<int32_t> &idx = this->slotState(sendIdx, bucketIdx, slot);
+            idx.resize(bucket.size);
+            std::iota(idx.begin(), idx.end(), 0);
+            std::nth_element(idx.begin(), idx.begin() + (count - 1), idx.end(), [&](int32_t a, int32_t b)
+                             { return std::abs(residual[a]) > std::abs(residual[b]); });
+            idx.resize(count);
+
+            std::vector<DT> &val = this->slotState(sendVal, bucketIdx, slot);
+            val.resize(count);
+            for (size_t i = 0; i < count; i++)
+            {
+                val[i] = residual[idx[i]];
+                residual[idx[i]] = 0;
+            }
+
+            int worldSize;
+            MPI_Comm_size(comm, &worldSize);
+            std::vector<int32_t> &gatheredIdx = this->slotState(recvIdx, bucketIdx, slot);
+            std::vector<DT> &gatheredVal = this->slotState(recvVal, bucketIdx, slot);
+            gatheredIdx.resize(count * worldSize);
+            gatheredVal.resize(count * worldSize);
+
+            std::vector<MPI_Request> &reqs = this->requestsFor(bucketIdx, slot);
+            reqs.resize(2);
+            MPI_Iallgather(idx.data(), count, MPI_INT32_T, gatheredIdx.data(), count, MPI_INT32_T, comm, &reqs[0]);
+            MPI_Iallgather(val.data(), count, PPGrad::mpiDatatype<DT>(), gatheredVal.data(), count, PPGrad::mpiDatatype<DT>(), comm, &reqs[1]);
+            this->bytesSent += count * (sizeof(int32_t) + sizeof(DT));
+        }
+
+        void finish(GradBucket<DT> &bucket, size_t bucketIdx, size_t slot) override
+        {
+            this->waitFor(bucketIdx, slot);
+
+            // Sparse reduction: scatter-add the entries of all ranks.
+            std::vector<DT> &buffer = bucket.buffers[slot];
+            std::fill(buffer.begin(), buffer.end(), (DT)0);
+            const std::vector<int32_t> &gatheredIdx = this->slotState(recvIdx, bucketIdx, slot);
+            const std::vector<DT> &gatheredVal = this->slotState(recvVal, bucketIdx, slot);
+            for (size_t i = 0; i < gatheredIdx.size(); i++)
+            {
+                buffer[gatheredIdx[i]] += gatheredVal[i];
+            }
+        }
+    };
+
+    /// @brief Low-precision dense sum: every bucket is cast to bfloat16 or half precision for the wire and reduced in two phases that accumulate in fp32.
+    /// @details Parameters and optimizer state stay in full precision, only the communication is 16-bit (a 4x reduction of the exchanged bytes for `double` models).
+    /// The reduction is a reduce-scatter followed by an allgather: rank `r` owns the `r`-th chunk of the bucket (split like `tensorScatterv`), receives every rank's 16-bit copy of it and sums them in fp32.
+    /// Each gradient is thus rounded to 16 bits once on the way in and the owner's result once on the way out, independently of the number of ranks.
+    /// The owner rounds the mean rather than the sum (which stays within the range of the inputs, so half precision does not overflow) and `finish()` multiplies it back.
+    /// The allgathers run on a duplicate of the communicator and are started in launch order (by `progress()` or at the latest by `finish()`), so every rank issues both phases' collectives in the same order.
+    /// @tparam DT Data type of the gradients.
+    template <typename DT>
+    class LowPrecisionReducer : public GradReducer<DT>
+    {
+    private:
+        /// @brief Two-phase exchange of one [bucket][slot].
+        struct Exchange
+        {
+            int rank = 0;
+            int worldSize = 1;
+            bool reduced = true;            ///< Whether the owned chunk was summed and its allgather started.
+            std::vector<int> counts;        ///< Chunk sizes of every rank.
+            std::vector<int> displs;        ///< Chunk offsets of every rank.
+            std::vector<int> recvCounts;    ///< Size of the owned chunk, once per rank.
+            std::vector<int> recvDispls;    ///< Offset of every rank's copy of the owned chunk in `received`.
+            std::vector<uint16_t> packed;   ///< 16-bit copy of the local bucket, overwritten with the reduced bucket by the allgather.
+            std::vector<uint16_t> received; ///< Every rank's copy of the owned chunk.
+        };
+
+        CommPrecisions precision;
+        MPI_Comm gatherComm = MPI_COMM_NULL;                 ///< Duplicate of the reduction communicator for the allgathers.
+        std::vector<std::vector<Exchange>> exchanges;        ///< Exchange of every [bucket][slot].
+        std::deque<std::pair<size_t, size_t>> awaitingGather; ///< [bucket, slot] of the started exchanges whose allgather is not started yet, in launch order.
+
+        float decode(uint16_t value) const
+        {
+            return precision == CommPrecisions::BF16 ? PPGrad::bf16ToFloat(value) : PPGrad::fp16ToFloat(value);
+        }
+
+        uint16_t encode(float value) const
+        {
+            return precision == CommPrecisions::BF16 ? PPGrad::floatToBF16(value) : PPGrad::floatToFP16(value);
+        }
+
+        /// @brief Sum the owned chunk of the oldest exchange in fp32 (once its reduce-scatter completed) and start the allgather of the rounded mean.
+        void reduceOldest()
+        {
+            const std::pair<size_t, size_t> oldest = awaitingGather.front();
+            awaitingGather.pop_front();
+            Exchange &exchange = exchanges[oldest.first][oldest.second];
+            MPI_Request &request = this->requestsFor(oldest.first, oldest.second)[0];
+            const int count = exchange.counts[exchange.rank];
+            uint16_t *owned = exchange.packed.data() + exchange.displs[exchange.rank];
+            for (int i = 0; i < count; i++)
+            {
+                float sum = 0.0f;
+                for (int r = 0; r < exchange.worldSize; r++)
+                {
+                    sum += decode(exchange.received[(size_t)r * count + i]);
+                }
+                owned[i] = encode(sum / (float)exchange.worldSize);
+            }
+            MPI_Iallgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, exchange.packed.data(), exchange.counts.data(), exchange.displs.data(), MPI_UINT16_T, gatherComm, &request);
+            this->bytesSent += count * sizeof(uint16_t);
+            exchange.reduced = true;
+        }
+
+    public:
+        /// @brief Construct the low-precision reducer.
+        /// @param precision Format used on the wire.
+        LowPrecisionReducer(CommPrecisions precision = CommPrecisions::BF16)
+        {
+            this->precision = precision;
+        }
+
+        LowPrecisionReducer(const LowPrecisionReducer &) = delete;
+        LowPrecisionReducer &operator=(const LowPrecisionReducer &) = delete;
+
+        ~LowPrecisionReducer()
+        {
+            int finalized;
+            MPI_Finalized(&finalized);
+            if (gatherComm != MPI_COMM_NULL && !finalized)
+            {
+                MPI_Comm_free(&gatherComm);
+            }
+        }
+
+        void start(GradBucket<DT> &bucket, size_t bucketIdx, size_t slot, MPI_Comm comm) override
+        {
+            if (gatherComm == MPI_COMM_NULL)
+            {
+                MPI_Comm_dup(comm, &gatherComm);
+            }
+            Exchange &exchange = this->slotState(exchanges, bucketIdx, slot);
+            MPI_Comm_rank(comm, &exchange.rank);
+            MPI_Comm_size(comm, &exchange.worldSize);
+            const int worldSize = exchange.worldSize;
+            if (exchange.counts.size() != (size_t)worldSize || exchange.packed.size() != bucket.size)
+            {
+                exchange.counts.resize(worldSize);
+                exchange.displs.resize(worldSize);
+                int offset = 0;
+                for (int r = 0; r < worldSize; r++)
+                {
+                    exchange.counts[r] = (int)(bucket.size / worldSize) + (r < (int)(bucket.size % worldSize) ? 1 : 0);
+                    exchange.displs[r] = offset;
+                    offset += exchange.counts[r];
+                }
+                const int owned = exchange.counts[exchange.rank];
+                exchange.recvCounts.assign(worldSize, owned);
+                exchange.recvDispls.resize(worldSize);
+                for (int r = 0; r < worldSize; r++)
+                {
+                    exchange.recvDispls[r] = r * owned;
+                }
+                exchange.packed.resize(bucket.size);
+                exchange.received.resize((size_t)owned * worldSize);
+            }
+
+            const std::vector<DT> &buffer = bucket.buffers[slot];
+            for (size_t i = 0; i < bucket.size; i++)
+            {
+                exchange.packed[i] = encode((float)buffer[i]);
+            }
+
+            // Reduce-scatter as an all-to-all of 16-bit chunks, so the owner can accumulate in fp32.
+            std::vector<MPI_Request> &reqs = this->requestsFor(bucketIdx, slot);
+            reqs.resize(1);
+            MPI_Ialltoallv(exchange.packed.data(), exchange.counts.data(), exchange.displs.data(), MPI_UINT16_T,
+                           exchange.received.data(), exchange.recvCounts.data(), exchange.recvDispls.data(), MPI_UINT16_T, comm, &reqs[0]);
+            exchange.reduced = false;
+            awaitingGather.emplace_back(bucketIdx, slot);
+            this->bytesSent += bucket.size * sizeof(uint16_t);
+        }
+
+        void finish(GradBucket<DT> &bucket, size_t bucketIdx, size_t slot) override
+        {
+            Exchange &exchange = this->slotState(exchanges, bucketIdx, slot);
+            while (!exchange.reduced)
+            {
+                const std::pair<size_t, size_t> oldest = awaitingGather.front();
+                MPI_Wait(&this->requestsFor(oldest.first, oldest.second)[0], MPI_STATUS_IGNORE);
+                reduceOldest();
+            }
+            this->waitFor(bucketIdx, slot);
+
+            std::vector<DT> &buffer = bucket.buffers[slot];
+            for (size_t i = 0; i < bucket.size; i++)
+            {
+                buffer[i] = (DT)decode(exchange.packed[i]) * (DT)exchange.worldSize;
+            }
+        }
+
+        /// @brief Progress the outstanding requests and start the allgathers of the oldest exchanges whose reduce-scatter completed.
+        void progress() override
+        {
+            GradReducer<DT>::progress();
+            int done = 1;
+            while (!awaitingGather.empty() && done)
+            {
+                const std::pair<size_t, size_t> oldest = awaitingGather.front();
+                MPI_Test(&this->requestsFor(oldest.first, oldest.second)[0], &done, MPI_STATUS_IGNORE);
+                if (done)
+                    reduceOldest();
+            }
+        }
+    };
+
+    /// @brief PowerSGD low-rank compression with error feedback (Vogels et al., 2019).
+    /// @details Every gradient matrix `M` (gradient plus residual) of size `n x m` is approximated by rank-`r` factors: `P = M Q` is summed across ranks and orthonormalized, then `Q = M^T P` is summed and the reduced gradient is `P Q^T`.
+    /// Only `P` and `Q`, i.e., `(n + m) * r` instead of `n * m` values, travel over the network. `Q` is warm-started from the previous step, so a single power iteration per step is usually enough.
+    /// What the rank-`r` projection of the local gradient misses is kept as residual and added to the next step's gradient.
+    /// Vectors (e.g., biases) and matrices too small to benefit are summed densely, together with the first round of factors.
+    /// @tparam DT Data type of the gradients.
+    template <typename DT>
+    class PowerSGDReducer : public GradReducer<DT>
+    {
+    private:
+        using Matrix = Eigen::Matrix<DT, Eigen::Dynamic, Eigen::Dynamic>;
+        using MatrixMap = Eigen::Map<Matrix>;
+
+        /// @brief Split of a bucket into compressed matrices and dense leftovers (fixed on the first step).
+        struct Layout
+        {
+            bool initialized = false;
+            std::vector<size_t> matrices; ///< Positions (in the bucket) of the parameters sent as low-rank factors.
+            std::vector<size_t> dense;    ///< Positions (in the bucket) of the parameters sent as they are.
+            size_t denseSize = 0;         ///< Elements of all dense parameters.
+            size_t pSize = 0;             ///< Elements of all `P` factors.
+            size_t qSize = 0;             ///< Elements of all `Q` factors.
+        };
+
+        size_t rank;
+        size_t powerIterations;
+        MPI_Comm comm = MPI_COMM_NULL;
+        std::mt19937 gen{42}; ///< Same seed and same sequence of draws on every rank, so all ranks start from identical `Q`s.
+        std::vector<Layout> layouts;
+        std::vector<std::vector<DT>> residuals;          ///< Error feedback of every bucket.
+        std::vector<std::vector<DT>> qs;                 ///< Summed (warm start) `Q` factors of every bucket.
+        std::vector<std::vector<std::vector<DT>>> wireP; ///< Dense entries and `P` factors of every [bucket][slot].
+        std::vector<std::vector<std::vector<DT>>> wireQ; ///< Local `Q` factors of every [bucket][slot].
+
+        static size_t paramSize(const GradBucket<DT> &bucket, size_t pos)
+        {
+            return (pos + 1 < bucket.offsets.size() ? bucket.offsets[pos + 1] : bucket.size) - bucket.offsets[pos];
+        }
+
+        Layout &layoutFor(const GradBucket<DT> &bucket, size_t bucketIdx)
+        {
+            if (layouts.size() <= bucketIdx)
+            {
+                layouts.resize(bucketIdx + 1);
+                residuals.resize(bucketIdx + 1);
+                qs.resize(bucketIdx + 1);
+            }
+            Layout &layout = layouts[bucketIdx];
+            if (layout.initialized)
+            {
+                return layout;
+            }
+
+            for (size_t pos = 0; pos < bucket.paramIdx.size(); pos++)
+            {
+                const size_t n = bucket.rows[pos];
+                const size_t m = paramSize(bucket, pos) / n;
+                if (n > 1 && m > 1 && (n + m) * rank < n * m)
+                {
+                    layout.matrices.push_back(pos);
+                    layout.pSize += n * rank;
+                    layout.qSize += m * rank;
+                }
+                else
+                {
+                    layout.dense.push_back(pos);
+                    layout.denseSize += paramSize(bucket, pos);
+                }
+            }
+            residuals[bucketIdx].assign(bucket.size, (DT)0);
+            qs[bucketIdx].assign(layout.qSize, (DT)0);
+            layout.initialized = true;
+            return layout;
+        }
+
+        /// @brief Gram-Schmidt orthonormalization of the columns of `p` (all-zero columns stay zero).
+        static void orthogonalize(MatrixMap &p)
+        {
+            for (Eigen::Index j = 0; j < p.cols(); j++)
+            {
+                for (Eigen::Index k = 0; k < j; k++)
+                {
+                    p.col(j) -= p.col(k).dot(p.col(j)) * p.col(k);
+                }
+                DT norm = p.col(j).norm();
+                if (norm > (DT)1e-12)
+                {
+                    p.col(j) /= norm;
+                }
+                else
+                {
+                    p.col(j).setZero();
+                }
+            }
+        }
+
+        /// @brief `P = M Q` for every matrix of the bucket, written behind the dense entries of `wire`.
+        void computeP(GradBucket<DT> &bucket, const Layout &layout, std::vector<DT> &q, size_t slot, std::vector<DT> &wire)
+        {
+            size_t pOffset = layout.denseSize;
+            size_t qOffset = 0;
+            for (size_t pos : layout.matrices)
+            {
+                const Eigen::Index n = bucket.rows[pos];
+                const Eigen::Index m = paramSize(bucket, pos) / n;
+                MatrixMap M(bucket.buffers[slot].data() + bucket.offsets[pos], n, m);
+                MatrixMap Q(q.data() + qOffset, m, rank);
+                MatrixMap P(wire.data() + pOffset, n, rank);
+
+                // (Re-)seed columns that carry no direction, e.g., on the first step or after all-zero gradients.
+                std::normal_distribution<double> dist(0.0, 1.0);
+                for (Eigen::Index j = 0; j < Q.cols(); j++)
+                {
+                    if (Q.col(j).squaredNorm() == (DT)0)
+                    {
+                        for (Eigen::Index k = 0; k < m; k++)
+                        {
+                            Q(k, j) = (DT)dist(gen);
+                        }
+                    }
+                }
+
+                P.noalias() = M * Q;
+                pOffset += n * rank;
+                qOffset += m * rank;
+            }
+        }
+
+        /// @brief Orthonormalize the summed `P`s and compute the local `Q = M^T P` of every matrix of the bucket.
+        void computeQ(GradBucket<DT> &bucket, const Layout &layout, size_t slot, std::vector<DT> &wire, std::vector<DT> &q)
+        {
+            size_t pOffset = layout.denseSize;
+            size_t qOffset = 0;
+            for (size_t pos : layout.matrices)
+            {
+                const Eigen::Index n = bucket.rows[pos];
+                const Eigen::Index m = paramSize(bucket, pos) / n;
+                MatrixMap M(bucket.buffers[slot].data() + bucket.offsets[pos], n, m);
+                MatrixMap P(wire.data() + pOffset, n, rank);
+                MatrixMap Q(q.data() + qOffset, m, rank);
+                orthogonalize(P);
+                Q.noalias() = M.transpose() * P;
+                pOffset += n * rank;
+                qOffset += m * rank;
+            }
+        }
+
+    public:
+        /// @brief Construct the PowerSGD reducer.
+        /// @param rank Rank of the gradient approximation (higher is more accurate but sends more).
+        /// @param powerIterations Power iterations per step (each one beyond the first costs another round of communication).
+        PowerSGDReducer(size_t rank = 2, size_t powerIterations = 1)
+        {
+            if (rank == 0 || powerIterations == 0)
+            {
+                throw std::invalid_argument("PowerSGD rank and power iterations must be positive.");
+            }
+            this->rank = rank;
+            this->powerIterations = powerIterations;
+        }
+
+        void start(GradBucket<DT> &bucket, size_t bucketIdx, size_t slot, MPI_Comm comm) override
+        {
+            this->comm = comm;
+            Layout &layout = layoutFor(bucket, bucketIdx);
+            std::vector<DT> &buffer = bucket.buffers[slot];
+            std::vector<DT> &residual = residuals[bucketIdx];
+
+            // Error feedback: compress the gradient plus everything the previous approximations missed.
+            // The buffer belongs to the reducer until finish(), so it holds M in the meantime.
+            for (size_t pos : layout.matrices)
+            {
+                for (size_t k = bucket.offsets[pos]; k < bucket.offsets[pos] + paramSize(bucket, pos); k++)
+                {
+                    buffer[k] += residual[k];
+                    residual[k] = 0;
+                }
+            }
+
+            std::vector<DT> &wire = this->slotState(wireP, bucketIdx, slot);
+            wire.resize(layout.denseSize + layout.pSize);
+            size_t offset = 0;
+            for (size_t pos : layout.dense)
+            {
+                std::copy(buffer.begin() + bucket.offsets[pos], buffer.begin() + bucket.offsets[pos] + paramSize(bucket, pos), wire.begin() + offset);
+                offset += paramSize(bucket, pos);
+            }
+            computeP(bucket, layout, qs[bucketIdx], slot, wire);
+
+            std::vector<MPI_Request> &reqs = this->requestsFor(bucketIdx, slot);
+            reqs.resize(1);
+            MPI_Iallreduce(MPI_IN_PLACE, wire.data(), wire.size(), PPGrad::mpiDatatype<DT>(), MPI_SUM, comm, &reqs[0]);
+            this->bytesSent += wire.size() * sizeof(DT);
+        }
+
+        /// @details The second round (the `Q` factors depend on the summed `P`s) is a blocking allreduce. `finish()` is called in the same bucket order on every rank, so the collectives match.
+        void finish(GradBucket<DT> &bucket, size_t bucketIdx, size_t slot) override
+        {
+            this->waitFor(bucketIdx, slot);
+            Layout &layout = layouts[bucketIdx];
+            std::vector<DT> &buffer = bucket.buffers[slot];
+            std::vector<DT> &pWire = this->slotState(wireP, bucketIdx, slot);
+
+            size_t offset = 0;
+            for (size_t pos : layout.dense)
+            {
+                std::copy(pWire.begin() + offset, pWire.begin() + offset + paramSize(bucket, pos), buffer.begin() + bucket.offsets[pos]);
+                offset += paramSize(bucket, pos);
+            }
+            if (layout.matrices.empty())
+            {
+                return;
+            }
+
+            std::vector<DT> &qLocal = this->slotState(wireQ, bucketIdx, slot);
+            std::vector<DT> &qSum = qs[bucketIdx];
+            qLocal.resize(layout.qSize);
+            for (size_t iteration = 0; iteration < powerIterations; iteration++)
+            {
+                if (iteration > 0)
+                {
+                    computeP(bucket, layout, qSum, slot, pWire);
+                    MPI_Allreduce(MPI_IN_PLACE, pWire.data() + layout.denseSize, layout.pSize, PPGrad::mpiDatatype<DT>(), MPI_SUM, comm);
+                    this->bytesSent += layout.pSize * sizeof(DT);
+                }
+                computeQ(bucket, layout, slot, pWire, qLocal);
+                MPI_Allreduce(qLocal.data(), qSum.data(), layout.qSize, PPGrad::mpiDatatype<DT>(), MPI_SUM, comm);
+                this->bytesSent += layout.qSize * sizeof(DT);
+            }
+
+            // Residual = what the projection of the local M misses, result = sum of all projections.
+            std::vector<DT> &residual = residuals[bucketIdx];
+            size_t pOffset = layout.denseSize;
+            size_t qOffset = 0;
+            for (size_t pos : layout.matrices)
+            {
+                const Eigen::Index n = bucket.rows[pos];
+                const Eigen::Index m = paramSize(bucket, pos) / n;
+                MatrixMap M(buffer.data() + bucket.offsets[pos], n, m);
+                MatrixMap E(residual.data() + bucket.offsets[pos], n, m);
+                MatrixMap P(pWire.data() + pOffset, n, rank);
+                MatrixMap QLocal(qLocal.data() + qOffset, m, rank);
+                MatrixMap QSum(qSum.data() + qOffset, m, rank);
+                E += M - P * QLocal.transpose();
+                M.noalias() = P * QSum.transpose();
+                pOffset += n * rank;
+                qOffset += m * rank;
+            }
+        }
+    };
+
+    /// @brief Two-level (intra-node / inter-node) dense sum.
+    /// @details The ranks of a node copy their bucket into a shared-memory window (`MPI_Win_allocate_shared` on an `MPI_COMM_TYPE_SHARED` communicator) and each sums a chunk of it.
+    /// Only the node leaders then allreduce the node sums over the network (nonblocking, overlapping backward), and the result is read back from the window by all ranks of the node.
+    /// Nodes can be simulated on a single machine by limiting the number of ranks per node.
+    ///
+    /// The windows are allocated by `prepare()`, and the steps of a bucket are chained by nonblocking barriers: `start()` only copies the bucket and posts the first barrier,
+    /// `progress()` and `finish()` advance the bucket through its stages once the outstanding barrier (or allreduce) completed. Every stage has a communicator of its own
+    /// and the buckets enter each stage in launch order, so all ranks post the collectives of every communicator in the same order.
+    /// @tparam DT Data type of the gradients.
+    template <typename DT>
+    class HierarchicalReducer : public GradReducer<DT>
+    {
+    private:
+        /// @brief Stages of a bucket; the request of a [bucket][slot] is the one its current stage waits for.
+        enum Stages
+        {
+            IDLE,     ///< Not in flight.
+            COPIED,   ///< The bucket is in the window, waiting for the other ranks of the node to copy theirs.
+            SUMMED,   ///< The owned chunk of the node sum is written, waiting for the other ranks of the node.
+            REDUCING, ///< The leader allreduces the node sum with the other leaders.
+            REDUCED   ///< The global sum is in the window, waiting for the other ranks of the node to see it.
+        };
+
+        /// @brief Shared window of a [bucket][slot]: `nodeSize` input segments followed by the node sum.
+        struct Window
+        {
+            MPI_Win win = MPI_WIN_NULL;
+            DT *base = nullptr;
+            size_t size = 0;
+            Stages stage = IDLE;
+        };
+
+        int ranksPerNode;
+        MPI_Comm nodeComm = MPI_COMM_NULL;
+        MPI_Comm sumComm = MPI_COMM_NULL;     ///< Duplicate of `nodeComm` for the barriers after the summation.
+        MPI_Comm reducedComm = MPI_COMM_NULL; ///< Duplicate of `nodeComm` for the barriers after the inter-node allreduce.
+        MPI_Comm leaderComm = MPI_COMM_NULL;
+        int nodeRank = 0;
+        int nodeSize = 1;
+        std::vector<std::vector<Window>> windows;
+        std::deque<std::pair<size_t, size_t>> inFlight; ///< [bucket, slot] of the buckets in flight, in launch order.
+
+        void setup(MPI_Comm comm)
+        {
+            int worldRank;
+            MPI_Comm_rank(comm, &worldRank);
+            MPI_Comm sharedComm;
+            MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, worldRank, MPI_INFO_NULL, &sharedComm);
+            if (ranksPerNode > 0)
+            {
+                // Simulated nodes: consecutive groups of `ranksPerNode` ranks of a physical node.
+                int sharedRank;
+                MPI_Comm_rank(sharedComm, &sharedRank);
+                MPI_Comm_split(sharedComm, sharedRank / ranksPerNode, sharedRank, &nodeComm);
+                MPI_Comm_free(&sharedComm);
+            }
+            else
+            {
+                nodeComm = sharedComm;
+            }
+            MPI_Comm_rank(nodeComm, &nodeRank);
+            MPI_Comm_size(nodeComm, &nodeSize);
+            MPI_Comm_dup(nodeComm, &sumComm);
+            MPI_Comm_dup(nodeComm, &reducedComm);
+            MPI_Comm_split(comm, nodeRank == 0 ? 0 : MPI_UNDEFINED, worldRank, &leaderComm);
+        }
+
+        /// @brief Window of the given bucket & slot, allocated (collectively over the node) if `prepare()` did not do so already.
+        Window &windowFor(size_t size, size_t bucketIdx, size_t slot)
+        {
+            Window &window = this->slotState(windows, bucketIdx, slot);
+            if (window.win == MPI_WIN_NULL)
+            {
+                // All memory lives with the node leader, so the window is one contiguous array.
+                MPI_Aint bytes = nodeRank == 0 ? (MPI_Aint)((nodeSize + 1) * size * sizeof(DT)) : 0;
+                void *base;
+                MPI_Win_allocate_shared(bytes, sizeof(DT), MPI_INFO_NULL, nodeComm, &base, &window.win);
+                MPI_Aint windowBytes;
+                int dispUnit;
+                MPI_Win_shared_query(window.win, 0, &windowBytes, &dispUnit, &base);
+                window.base = static_cast<DT *>(base);
+                window.size = size;
+                MPI_Win_lock_all(MPI_MODE_NOCHECK, window.win);
+            }
+            return window;
+        }
+
+        /// @brief Move the given bucket to its next stage (its outstanding request has completed), posting the request the new stage waits for.
+        void advance(size_t bucketIdx, size_t slot)
+        {
+            Window &window = windows[bucketIdx][slot];
+            MPI_Request &request = this->requestsFor(bucketIdx, slot)[0];
+            // Make the window writes of the other ranks of the node (before their barrier) visible.
+            MPI_Win_sync(window.win);
+            switch (window.stage)
+            {
+            case COPIED:
+            {
+                // Intra-node reduction: every rank sums its chunk of all input segments into the node sum.
+                DT *sum = window.base + nodeSize * window.size;
+                const size_t begin = window.size * nodeRank / nodeSize;
+                const size_t end = window.size * (nodeRank + 1) / nodeSize;
+                for (size_t i = begin; i < end; i++)
+                {
+                    DT value = 0;
+                    for (int r = 0; r < nodeSize; r++)
+                    {
+                        value += window.base[r * window.size + i];
+                    }
+                    sum[i] = value;
+                }
+                MPI_Win_sync(window.win);
+                MPI_Ibarrier(sumComm, &request);
+                window.stage = SUMMED;
+                break;
+            }
+            case SUMMED:
+                // Inter-node reduction between the leaders only.
+                if (leaderComm != MPI_COMM_NULL)
+                {
+                    MPI_Iallreduce(MPI_IN_PLACE, window.base + nodeSize * window.size, window.size, PPGrad::mpiDatatype<DT>(), MPI_SUM, leaderComm, &request);
+                    this->bytesSent += window.size * sizeof(DT);
+                }
+                window.stage = REDUCING;
+                break;
+            case REDUCING:
+                MPI_Win_sync(window.win);
+                MPI_Ibarrier(reducedComm, &request);
+                window.stage = REDUCED;
+                break;
+            default:
+                window.stage = IDLE;
+                break;
+            }
+        }
+
+        /// @brief Advance the buckets in flight in launch order; a bucket only enters a stage after all buckets launched before it did.
+        /// @param target Bucket & slot to wait for until it is reduced (`nullptr` to only advance what has completed).
+        void advanceInOrder(const std::pair<size_t, size_t> *target)
+        {
+            Stages previous = REDUCED;
+            for (const std::pair<size_t, size_t> &entry : inFlight)
+            {
+                Window &window = windows[entry.first][entry.second];
+                MPI_Request &request = this->requestsFor(entry.first, entry.second)[0];
+                const bool blocking = target != nullptr;
+                while (window.stage != IDLE && (window.stage < previous || previous == REDUCED))
+                {
+                    int done;
+                    if (blocking)
+                    {
+                        MPI_Wait(&request, MPI_STATUS_IGNORE);
+                        done = 1;
+                    }
+                    else
+                    {
+                        MPI_Test(&request, &done, MPI_STATUS_IGNORE);
+                    }
+                    if (!done)
+                        break;
+                    advance(entry.first, entry.second);
+                }
+                previous = window.stage == IDLE ? REDUCED : window.stage;
+                if (target != nullptr && entry == *target)
+                    break;
+            }
+            while (!inFlight.empty() && windows[inFlight.front().first][inFlight.front().second].stage == IDLE)
+            {
+                inFlight.pop_front();
+            }
+        }
+
+    public:
+        /// @brief Construct the hierarchical reducer.
+        /// @param ranksPerNode Ranks per (simulated) node, 0 uses the physical nodes as reported by `MPI_COMM_TYPE_SHARED`.
+        HierarchicalReducer(int ranksPerNode = 0)
+        {
+            if (ranksPerNode < 0)
+            {
+                throw std::invalid_argument("Ranks per node must not be negative.");
+            }
+            this->ranksPerNode = ranksPerNode;
+        }
+
+        HierarchicalReducer(const HierarchicalReducer &) = delete;
+        HierarchicalReducer &operator=(const HierarchicalReducer &) = delete;
+
+        ~HierarchicalReducer()
+        {
+            int finalized;
+            MPI_Finalized(&finalized);
+            if (finalized)
+            {
+                return;
+            }
+            for (std::vector<Window> &bucketWindows : windows)
+            {
+                for (Window &window : bucketWindows)
+                {
+                    if (window.win != MPI_WIN_NULL)
+                    {
+                        MPI_Win_unlock_all(window.win);
+                        MPI_Win_free(&window.win);
+                    }
+                }
+            }
+            for (MPI_Comm *c : {&leaderComm, &reducedComm, &sumComm, &nodeComm})
+            {
+                if (*c != MPI_COMM_NULL)
+                    MPI_Comm_free(c);
+            }
+        }
+
+        /// @brief Split the communicator into nodes and allocate the shared windows of all buckets & slots.
+        void prepare(const std::vector<std::unique_ptr<GradBucket<DT>>> &buckets, size_t numSlots, MPI_Comm comm) override
+        {
+            if (nodeComm == MPI_COMM_NULL)
+            {
+                setup(comm);
+            }
+            for (size_t b = 0; b < buckets.size(); b++)
+            {
+                for (size_t s = 0; s < numSlots; s++)
+                {
+                    windowFor(buckets[b]->size, b, s);
+                }
+            }
+        }
+
+        void start(GradBucket<DT> &bucket, size_t bucketIdx, size_t slot, MPI_Comm comm) override
+        {
+            if (nodeComm == MPI_COMM_NULL)
+            {
+                setup(comm);
+            }
+            Window &window = windowFor(bucket.size, bucketIdx, slot);
+            const std::vector<DT> &buffer = bucket.buffers[slot];
+            std::copy(buffer.begin(), buffer.end(), window.base + nodeRank * bucket.size);
+            MPI_Win_sync(window.win);
+
+            std::vector<MPI_Request> &reqs = this->requestsFor(bucketIdx, slot);
+            reqs.resize(1);
+            MPI_Ibarrier(nodeComm, &reqs[0]);
+            window.stage = COPIED;
+            inFlight.emplace_back(bucketIdx, slot);
+        }
+
+        void finish(GradBucket<DT> &bucket, size_t bucketIdx, size_t slot) override
+        {
+            const std::pair<size_t, size_t> target(bucketIdx, slot);
+            advanceInOrder(&target);
+            this->waitFor(bucketIdx, slot);
+
+            // Intra-node broadcast: read the global sum back from the node's window.
+            const Window &window = windows[bucketIdx][slot];
+            const DT *sum = window.base + nodeSize * bucket.size;
+            std::copy(sum, sum + bucket.size, bucket.buffers[slot].begin());
+        }
+
+        /// @brief Advance every bucket in flight whose outstanding barrier or allreduce completed.
+        void progress() override
+        {
+            advanceInOrder(nullptr);
+        }
+    };
+
+    /// @brief Ring allreduce (reduce-scatter followed by allgather) on point-to-point messages, with segmentation and pipelining.
+    /// @details The bucket is split into one chunk per rank and every chunk into segments of at most `segmentBytes`. Each segment travels around the ring on its own:
+    /// as soon as a segment has arrived and has been added to the local chunk, it is forwarded to the next rank, so the local reduction overlaps with the transfers of the other segments.
+    /// Every rank sends `2 * (worldSize - 1) / worldSize` times the bucket, independent of the number of ranks.
+    /// Messages are matched on a private duplicate of the communicator by a tag unique among the rings in flight, handed out in the order the rings are started
+    /// (the same on every rank).
+    /// @tparam DT Data type of the gradients.
+    template <typename DT>
+    class RingReducer : public GradReducer<DT>
+    {
+    private:
+        /// @brief In-flight ring of a [bucket][slot]. Message `m` is segment `m % segments` of ring step `m / segments` (`2 * (worldSize - 1)` steps).
+        struct Ring
+        {
+            bool active = false;
+            DT *data = nullptr;
+            size_t size = 0;
+            size_t segments = 0;             ///< Segments per chunk.
+            size_t nextSend = 0;             ///< Messages are sent in order, each once its data is final.
+            size_t pending = 0;              ///< Messages not received & processed yet.
+            int tag = 0;
+            std::vector<DT> recv;            ///< Receive buffer of all messages.
+            std::vector<size_t> recvOffsets; ///< Start of every message in `recv`.
+            std::vector<MPI_Request> recvReqs;
+            std::vector<MPI_Request> sendReqs;
+            std::vector<char> processed;
+            std::vector<int> indices;        ///< Scratch for `MPI_Testsome`/`MPI_Waitsome`.
+        };
+
+        size_t segmentBytes;
+        size_t segmentElems;
+        MPI_Comm ringComm = MPI_COMM_NULL;
+        int worldSize = 1;
+        int worldRank = 0;
+        int tagUpperBound = 32767;   ///< `MPI_TAG_UB` of `ringComm` (32767 is the smallest the standard allows).
+        int nextTag = 0;             ///< Tag of the next ring started.
+        std::unordered_set<int> activeTags;
+        std::vector<std::vector<Ring>> rings;
+
+        size_t steps() const
+        {
+            return 2 * ((size_t)worldSize - 1);
+        }
+
+        size_t chunkBegin(const Ring &ring, size_t chunk) const
+        {
+            return ring.size * chunk / worldSize;
+        }
+
+        /// @brief Chunk sent (`send = true`) or received in ring step `step`.
+        size_t chunkOf(size_t step, bool send) const
+        {
+            const size_t n = worldSize;
+            // Reduce-scatter: send chunk (rank - step), receive (rank - step - 1). Allgather: send (rank + 1 - step'), receive (rank - step').
+            const size_t shift = step < n - 1 ? step + (send ? 0 : 1) : step - (n - 1) + (send ? n - 1 : 0);
+            return ((size_t)worldRank + n * 2 - shift % n) % n;
+        }
+
+        /// @brief Element range [begin, end) of message `m` in the bucket.
+        std::pair<size_t, size_t> range(const Ring &ring, size_t m, bool send) const
+        {
+            const size_t chunk = chunkOf(m / ring.segments, send);
+            const size_t end = chunkBegin(ring, chunk + 1);
+            const size_t begin = std::min(end, chunkBegin(ring, chunk) + (m % ring.segments) * segmentElems);
+            return {begin, std::min(end, begin + segmentElems)};
+        }
+
+        /// @brief Post every send whose data is final (in message order, so both ends agree on the order per tag).
+        void postSends(Ring &ring)
+        {
+            const int next = (worldRank + 1) % worldSize;
+            const size_t total = ring.recvReqs.size();
+            while (ring.nextSend < total && (ring.nextSend < ring.segments || ring.processed[ring.nextSend - ring.segments]))
+            {
+                auto [begin, end] = range(ring, ring.nextSend, true);
+                MPI_Isend(ring.data + begin, (int)(end - begin), PPGrad::mpiDatatype<DT>(), next, ring.tag, ringComm, &ring.sendReqs[ring.nextSend]);
+                this->bytesSent += (end - begin) * sizeof(DT);
+                ring.nextSend++;
+            }
+        }
+
+        /// @brief Add (reduce-scatter) or copy (allgather) the received segment into the bucket.
+        void process(Ring &ring, size_t m)
+        {
+            auto [begin, end] = range(ring, m, false);
+            const DT *src = ring.recv.data() + ring.recvOffsets[m];
+            const size_t step = m / ring.segments;
+            if (step < (size_t)worldSize - 1)
+            {
+                for (size_t i = begin; i < end; i++)
+                {
+                    ring.data[i] += src[i - begin];
+                }
+            }
+            else
+            {
+                // The same segment left this rank during reduce-scatter, make sure that send is done before overwriting it.
+                const size_t chunk = chunkOf(step, false);
+                const size_t rsStep = ((size_t)worldRank + worldSize - chunk) % worldSize;
+                if (rsStep < (size_t)worldSize - 1)
+                {
+                    MPI_Wait(&ring.sendReqs[rsStep * ring.segments + m % ring.segments], MPI_STATUS_IGNORE);
+                }
+                std::copy(src, src + (end - begin), ring.data + begin);
+            }
+            ring.processed[m] = 1;
+            ring.pending--;
+        }
+
+        /// @brief Process the arrived segments and forward what became final.
+        void advance(Ring &ring, bool block)
+        {
+            while (ring.pending > 0)
+            {
+                int count;
+                if (block)
+                    MPI_Waitsome(ring.recvReqs.size(), ring.recvReqs.data(), &count, ring.indices.data(), MPI_STATUSES_IGNORE);
+                else
+                    MPI_Testsome(ring.recvReqs.size(), ring.recvReqs.data(), &count, ring.indices.data(), MPI_STATUSES_IGNORE);
+                if (count == MPI_UNDEFINED || count == 0)
+                {
+                    break;
+                }
+                for (int i = 0; i < count; i++)
+                {
+                    process(ring, ring.indices[i]);
+                }
+                postSends(ring);
+                if (!block)
+                {
+                    break;
+                }
+            }
+        }
+
+    public:
+        /// @brief Construct the ring reducer.
+        /// @param segmentBytes Maximum size of a message, i.e., the pipelining granularity (smaller segments overlap more but cost more messages).
+        RingReducer(size_t segmentBytes = 256 * 1024)
+        {
+            if (segmentBytes < sizeof(DT))
+            {
+                throw std::invalid_argument("Ring segments must hold at least one element.");
+            }
+            this->segmentBytes = segmentBytes;
+            this->segmentElems = segmentBytes / sizeof(DT);
+        }
+
+        RingReducer(const RingReducer &) = delete;
+        RingReducer &operator=(const RingReducer &) = delete;
+
+        ~RingReducer()
+        {
+            int finalized;
+            MPI_Finalized(&finalized);
+            if (ringComm != MPI_COMM_NULL && !finalized)
+            {
+                MPI_Comm_free(&ringComm);
+            }
+        }
+
+        void start(GradBucket<DT> &bucket, size_t bucketIdx, size_t slot, MPI_Comm comm) override
+        {
+            if (ringComm == MPI_COMM_NULL)
+            {
+                MPI_Comm_dup(comm, &ringComm);
+                MPI_Comm_size(ringComm, &worldSize);
+                MPI_Comm_rank(ringComm, &worldRank);
+                int *tagUB;
+                int flag;
+                MPI_Comm_get_attr(ringComm, MPI_TAG_UB, &tagUB, &flag);
+                if (flag)
+                {
+                    tagUpperBound = *tagUB;
+                }
+            }
+            if (worldSize == 1)
+            {
+                return;
+            }
+
+            // All ranks start the rings in the same order, so they agree on the tags without communication.
+            const int tag = nextTag;
+            if (!activeTags.insert(tag).second)
+            {
+                throw std::runtime_error("More than MPI_TAG_UB ring allreduces in flight.");
+            }
+            nextTag = nextTag == tagUpperBound ? 0 : nextTag + 1;
+
+            Ring &ring = this->slotState(rings, bucketIdx, slot);
+            ring.active = true;
+            ring.tag = tag;
+            ring.data = bucket.buffers[slot].data();
+            ring.size = bucket.size;
+            const size_t maxChunk = (bucket.size + worldSize - 1) / worldSize;
+            ring.segments = std::max<size_t>(1, (maxChunk + segmentElems - 1) / segmentElems);
+
+            const size_t total = steps() * ring.segments;
+            ring.recvOffsets.resize(total);
+            size_t recvSize = 0;
+            for (size_t m = 0; m < total; m++)
+            {
+                auto [begin, end] = range(ring, m, false);
+                ring.recvOffsets[m] = recvSize;
+                recvSize += end - begin;
+            }
+            ring.recv.resize(recvSize);
+            ring.recvReqs.assign(total, MPI_REQUEST_NULL);
+            ring.sendReqs.assign(total, MPI_REQUEST_NULL);
+            ring.processed.assign(total, 0);
+            ring.indices.resize(total);
+            ring.nextSend = 0;
+            ring.pending = total;
+
+            const int prev = (worldRank + worldSize - 1) % worldSize;
+            for (size_t m = 0; m < total; m++)
+            {
+                auto [begin, end] = range(ring, m, false);
+                MPI_Irecv(ring.recv.data() + ring.recvOffsets[m], (int)(end - begin), PPGrad::mpiDatatype<DT>(), prev, ring.tag, ringComm, &ring.recvReqs[m]);
+            }
+            postSends(ring);
+        }
+
+        void finish(GradBucket<DT> & /*bucket*/, size_t bucketIdx, size_t slot) override
+        {
+            if (worldSize == 1)
+            {
+                return;
+            }
+            Ring &ring = this->slotState(rings, bucketIdx, slot);
+            advance(ring, true);
+            MPI_Waitall(ring.sendReqs.size(), ring.sendReqs.data(), MPI_STATUSES_IGNORE);
+            ring.active = false;
+            activeTags.erase(ring.tag);
+        }
+
+        void progress() override
+        {
+            for (std::vector<Ring> &bucketRings : rings)
+                for (Ring &ring : bucketRings)
+                    if (ring.active)
+                        advance(ring, false);
+        }
+    };
+
+} // namespace PPNN
@@ -0,0 +1,443 @@
+/** @file
+ * @brief Bucketed gradient allreduce that overlaps communication with backward().
+ */
+
+#pragma once
+
+#include "Tensor/TensorBase.hpp"
+#include "TensorMPI.hpp"
+#include "NN/GradReducers.hpp"
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+#include <stdexcept>
+#include <mpi.h>
+
+namespace PPNN
+{
+
+    /// @brief Timing of a single gradient synchronization, used to report how much of the communication was hidden behind computation.
+    struct SyncStats
+    {
+        size_t buckets = 0;              ///< Number of buckets reduced in the step.
+        size_t bucketsLaunchedEarly = 0; ///< Buckets whose allreduce was started while backward() was still running.
+        double backwardTime = 0.0;       ///< Seconds spent in backward().
+        double overlapTime = 0.0;        ///< Seconds during which the applied communication was in flight concurrently with computation.
+        double exposedTime = 0.0;        ///< Seconds spent finishing the communication after backward() returned.
+
+        /// @brief Fraction of the communication window that overlapped with computation (0 = fully exposed, 1 = fully hidden).
+        double overlapRatio() const
+        {
+            double window = overlapTime + exposedTime;
+            return window > 0.0 ? overlapTime / window : 0.0;
+        }
+    };
+
+    /// @brief DDP-style gradient synchronizer: parameters are grouped into size-capped buckets (in reverse order, i.e., the order backward() finishes them) and each bucket's reduction (by default an `MPI_Iallreduce`, see `GradReducer`) is started as soon as all of its gradients are final.
+    /// @details Gradient readiness is tracked through `TensorBase::setGradHook()`. The number of gradient contributions each parameter receives per sample is learned on the first batch (static graph assumption), after which a parameter is final once it received `uses * samples` contributions.
+    /// All MPI calls are issued from the thread that calls `poll()` / `finish()` (the OpenMP master thread), so `MPI_THREAD_FUNNELED` is sufficient.
+    ///
+    /// With `setStaleness(s)` for `s > 0`, `finishDelayed()` does not wait for the step it launches but applies the result of the step launched `s` syncs ago instead, so its allreduce runs behind the following forward/backward passes.
+    /// @tparam Dim Dimension of the parameter tensors.
+    /// @tparam DT Data type of the parameter tensors.
+    template <int Dim, typename DT>
+    class GradSynchronizer
+    {
+    private:
+        std::vector<std::shared_ptr<PPGrad::TensorBase<Dim, DT>>> params;
+        std::vector<std::unique_ptr<GradBucket<DT>>> buckets;
+        std::vector<size_t> paramBucket; ///< Bucket index of each parameter.
+
+        std::unique_ptr<std::atomic<int32_t>[]> gradCounts; ///< addGrad() calls received by each parameter in the current batch.
+        std::vector<int32_t> usesPerSample;                 ///< Gradient contributions per sample (-1 if not a whole multiple).
+        std::vector<int32_t> expected;                      ///< Contributions after which each parameter is final (-1 = unknown).
+        bool usesKnown = false;
+        bool tracking = false; ///< Whether the readiness of the current batch is tracked (see `beginBackward()`).
+        size_t batchSamples = 0;
+
+        MPI_Comm comm;
+        std::shared_ptr<GradReducer<DT>> reducer;
+        size_t nextBucket = 0; ///< Buckets have to be launched in the same order on every rank.
+        bool backwardRunning = false;
+        double tBackwardStart = 0.0;
+        double tBackwardEnd = 0.0;
+        SyncStats stats;
+
+        int32_t staleness = 0;          ///< Maximum number of syncs a gradient may be delayed by (0 = synchronous).
+        DT compensation = 0;            ///< Delay compensation strength (0 = off).
+        size_t slot = 0;                ///< Ring slot of the step being launched.
+        size_t inFlight = 0;            ///< Launched steps whose result was not applied yet.
+        std::vector<DT> slotScale;      ///< Scale to apply to the reduced gradients of every slot.
+        std::vector<double> slotLaunch; ///< Time the first bucket of every slot was launched (-1 = not yet).
+        bool buffersReleased = false;   ///< Whether the bucket buffers were freed by `releaseBuffers()` (reallocated by the next launch).
+
+        size_t numSlots() const
+        {
+            return (size_t)staleness + 1;
+        }
+
+        /// @brief (Re-)allocate the buffers of every bucket for the current number of slots.
+        void allocateBuffers()
+        {
+            for (std::unique_ptr<GradBucket<DT>> &bucket : buckets)
+            {
+                bucket->buffers.assign(numSlots(), std::vector<DT>(bucket->size));
+                bucket->snapshots.assign(compensation != 0 ? numSlots() : 0, std::vector<DT>(bucket->size));
+            }
+            buffersReleased = false;
+        }
+
+        void launch(size_t bucketIdx)
+        {
+            if (buffersReleased)
+            {
+                allocateBuffers();
+            }
+            GradBucket<DT> &bucket = *buckets[bucketIdx];
+            if (slotLaunch[slot] < 0.0)
+            {
+                slotLaunch[slot] = MPI_Wtime();
+            }
+            if (backwardRunning)
+            {
+                stats.bucketsLaunchedEarly++;
+            }
+
+            std::vector<DT> &buffer = bucket.buffers[slot];
+            for (size_t i = 0; i < bucket.paramIdx.size(); i++)
+            {
+                std::shared_ptr<Eigen::Tensor<DT, Dim>> grad = params[bucket.paramIdx[i]]->getGrad();
+                std::copy(grad->data(), grad->data() + grad->size(), buffer.data() + bucket.offsets[i]);
+
+                if (compensation != 0)
+                {
+                    std::shared_ptr<Eigen::Tensor<DT, Dim>> data = params[bucket.paramIdx[i]]->getData();
+                    std::copy(data->data(), data->data() + data->size(), bucket.snapshots[slot].data() + bucket.offsets[i]);
+                }
+            }
+
+            reducer->start(bucket, bucketIdx, slot, comm);
+        }
+
+        /// @brief Wait for all buckets of `s` and overwrite the parameter gradients with the (scaled and, if enabled, delay-compensated) result.
+        void complete(size_t s)
+        {
+            for (size_t b = 0; b < buckets.size(); b++)
+            {
+                std::unique_ptr<GradBucket<DT>> &bucket = buckets[b];
+                reducer->finish(*bucket, b, s);
+                for (size_t i = 0; i < bucket->paramIdx.size(); i++)
+                {
+                    std::shared_ptr<PPGrad::TensorBase<Dim, DT>> &param = params[bucket->paramIdx[i]];
+                    DT *grad = param->getGrad()->data();
+                    const DT *src = bucket->buffers[s].data() + bucket->offsets[i];
+                    const Eigen::Index size = param->getGrad()->size();
+                    for (Eigen::Index k = 0; k < size; k++)
+                    {
+                        grad[k] = src[k] * slotScale[s];
+                    }
+
+                    // DC-ASGD style first-order correction: g + lambda * g * g * (w_now - w_then).
+                    if (compensation != 0)
+                    {
+                        const DT *now = param->getData()->data();
+                        const DT *then = bucket->snapshots[s].data() + bucket->offsets[i];
+                        for (Eigen::Index k = 0; k < size; k++)
+                        {
+                            grad[k] += compensation * grad[k] * grad[k] * (now[k] - then[k]);
+                        }
+                    }
+                }
+            }
+            slotLaunch[s] = -1.0;
+            inFlight--;
+        }
+
+        void launchRemaining(DT scale)
+        {
+            while (nextBucket < buckets.size())
+            {
+                launch(nextBucket++);
+            }
+            // A following sync without a backward() in between has to launch (the then current gradients) again.
+            nextBucket = 0;
+            slotScale[slot] = scale;
+            inFlight++;
+        }
+
+        void recordStats(double tLaunched)
+        {
+            double tEnd = MPI_Wtime();
+            stats.buckets = buckets.size();
+            stats.backwardTime = tBackwardEnd - tBackwardStart;
+            stats.overlapTime = std::max(0.0, tBackwardEnd - tLaunched);
+            stats.exposedTime = tEnd - std::max(tBackwardEnd, tLaunched);
+        }
+
+    public:
+        /// @brief Split the parameters into buckets and install the gradient readiness hooks.
+        /// @param params List of [trainable] parameters of the model.
+        /// @param bucketSizeBytes Maximum size of a bucket in bytes (a single parameter larger than this gets a bucket of its own).
+        /// @param comm Communicator to reduce the gradients over.
+        GradSynchronizer(std::vector<std::shared_ptr<PPGrad::TensorBase<Dim, DT>>> params, size_t bucketSizeBytes, MPI_Comm comm = MPI_COMM_WORLD)
+        {
+            this->params = params;
+            this->comm = comm;
+            this->reducer = std::make_shared<AllreduceReducer<DT>>();
+            this->paramBucket.resize(params.size());
+            this->gradCounts = std::make_unique<std::atomic<int32_t>[]>(params.size());
+            this->usesPerSample.assign(params.size(), -1);
+            this->expected.assign(params.size(), -1);
+
+            // Reverse order: the last layers receive their gradients first during backward().
+            size_t bucketBytes = 0;
+            for (size_t i = params.size(); i-- > 0;)
+            {
+                size_t paramBytes = params[i]->getGrad()->size() * sizeof(DT);
+                if (buckets.empty() || (bucketBytes > 0 && bucketBytes + paramBytes > bucketSizeBytes))
+                {
+                    buckets.push_back(std::make_unique<GradBucket<DT>>());
+                    bucketBytes = 0;
+                }
+                GradBucket<DT> &bucket = *buckets.back();
+                bucket.paramIdx.push_back(i);
+                bucket.offsets.push_back(bucket.size);
+                bucket.rows.push_back(params[i]->getGrad()->dimension(0));
+                bucket.size += params[i]->getGrad()->size();
+                bucketBytes += paramBytes;
+                paramBucket[i] = buckets.size() - 1;
+            }
+            setStaleness(0);
+
+            for (size_t i = 0; i < params.size(); i++)
+            {
+                params[i]->setGradHook([this, i]()
+                                       {
+                    int32_t count = this->gradCounts[i].fetch_add(1) + 1;
+                    if (count == this->expected[i])
+                    {
+                        this->buckets[this->paramBucket[i]]->pending.fetch_sub(1);
+                    } });
+            }
+        }
+
+        GradSynchronizer(const GradSynchronizer &) = delete;
+        GradSynchronizer &operator=(const GradSynchronizer &) = delete;
+
+        ~GradSynchronizer()
+        {
+            for (std::shared_ptr<PPGrad::TensorBase<Dim, DT>> &param : params)
+            {
+                param->setGradHook(nullptr);
+            }
+        }
+
+        /// @brief Configure delayed synchronization (can only be changed while no step is in flight). Collective over the communicator.
+        /// @param staleness Number of syncs a gradient is delayed by, i.e., the staleness bound (0 = synchronous).
+        /// @param compensation Strength `lambda` of the delay compensation `g + lambda * g * g * (w_now - w_then)` applied to stale gradients (0 = off).
+        void setStaleness(int32_t staleness, DT compensation = 0)
+        {
+            if (staleness < 0)
+            {
+                throw std::invalid_argument("Staleness must be non-negative.");
+            }
+            if (inFlight > 0)
+            {
+                throw std::runtime_error("Cannot change staleness while gradients are in flight.");
+            }
+
+            this->staleness = staleness;
+            this->compensation = compensation;
+            this->slot = 0;
+            this->slotScale.assign(numSlots(), (DT)1);
+            this->slotLaunch.assign(numSlots(), -1.0);
+            allocateBuffers();
+            reducer->prepare(buckets, numSlots(), comm);
+        }
+
+        /// @brief Replace the reduction stage (e.g., by a compressing one) - can only be changed while no step is in flight. Collective over the communicator (see `GradReducer::prepare()`).
+        /// @param reducer Reducer used for all buckets from now on.
+        void setReducer(std::shared_ptr<GradReducer<DT>> reducer)
+        {
+            if (inFlight > 0)
+            {
+                throw std::runtime_error("Cannot change the reducer while gradients are in flight.");
+            }
+            this->reducer = reducer;
+            this->reducer->prepare(buckets, numSlots(), comm);
+        }
+
+        /// @brief Free the bucket buffers while the gradients are synchronized elsewhere (e.g., by `ShardedOptimizer`), they are reallocated by the next launch.
+        void releaseBuffers()
+        {
+            if (inFlight > 0)
+            {
+                throw std::runtime_error("Cannot release the bucket buffers while gradients are in flight.");
+            }
+            for (std::unique_ptr<GradBucket<DT>> &bucket : buckets)
+            {
+                std::vector<std::vector<DT>>().swap(bucket->buffers);
+                std::vector<std::vector<DT>>().swap(bucket->snapshots);
+            }
+            buffersReleased = true;
+        }
+
+        /// @brief Bytes of the bucket buffers this rank currently holds (0 after `releaseBuffers()`).
+        size_t bufferBytes() const
+        {
+            size_t bytes = 0;
+            for (const std::unique_ptr<GradBucket<DT>> &bucket : buckets)
+            {
+                bytes += (bucket->buffers.size() + bucket->snapshots.size()) * bucket->size * sizeof(DT);
+            }
+            return bytes;
+        }
+
+        /// @brief Reduction stage used for all buckets.
+        std::shared_ptr<GradReducer<DT>> getReducer() const
+        {
+            return reducer;
+        }
+
+        /// @brief Number of syncs a gradient is delayed by (0 = synchronous).
+        int32_t getStaleness() const
+        {
+            return staleness;
+        }
+
+        /// @brief Arm the readiness tracking right before backward() is run on a batch.
+        /// @param samples Number of samples whose backward() will be run.
+        /// @param syncStep Whether the gradients will be synchronized after this batch (buckets are only launched early on sync steps).
+        /// @param trackReadiness Whether the gradients arrive through the hooks; `false` if backward() accumulates them elsewhere (e.g., thread-private buffers reduced afterwards),
+        /// then no bucket is launched before `finish()`.
+        void beginBackward(size_t samples, bool syncStep, bool trackReadiness = true)
+        {
+            batchSamples = samples;
+            tracking = trackReadiness;
+            for (size_t i = 0; i < params.size(); i++)
+            {
+                gradCounts[i].store(0);
+                expected[i] = (trackReadiness && syncStep && usesKnown && usesPerSample[i] >= 0) ? usesPerSample[i] * (int32_t)samples : -1;
+            }
+            for (std::unique_ptr<GradBucket<DT>> &bucket : buckets)
+            {
+                int32_t pending = 0;
+                for (size_t idx : bucket->paramIdx)
+                {
+                    pending += expected[idx] != 0 ? 1 : 0;
+                }
+                bucket->pending.store(pending);
+            }
+
+            nextBucket = 0;
+            stats = SyncStats();
+            backwardRunning = true;
+            tBackwardStart = MPI_Wtime();
+        }
+
+        /// @brief Progress the outstanding reductions without launching new ones. Must be called from the master thread only.
+        void progress()
+        {
+            reducer->progress();
+        }
+
+        /// @brief Launch the reduction of every bucket whose gradients are final and progress the outstanding ones. Must be called from the master thread only.
+        void poll()
+        {
+            while (nextBucket < buckets.size() && buckets[nextBucket]->pending.load() == 0)
+            {
+                launch(nextBucket++);
+            }
+            progress();
+        }
+
+        /// @brief Mark the end of backward() for the current batch (and learn the per-sample gradient contributions on the first batch).
+        void endBackward()
+        {
+            tBackwardEnd = MPI_Wtime();
+            backwardRunning = false;
+
+            if (tracking && !usesKnown && batchSamples > 0)
+            {
+                for (size_t i = 0; i < params.size(); i++)
+                {
+                    int32_t count = gradCounts[i].load();
+                    usesPerSample[i] = (count % (int32_t)batchSamples == 0) ? count / (int32_t)batchSamples : -1;
+                }
+                usesKnown = true;
+            }
+        }
+
+        /// @brief Launch the remaining buckets, wait for all of them and write the reduced gradients (multiplied by `scale`) back into the parameters.
+        /// @details Synchronous regardless of the configured staleness, delayed steps still in flight have to be `drain()`ed first.
+        /// @param scale Factor applied to the summed gradients (e.g., `1 / worldSize` to average them).
+        void finish(DT scale)
+        {
+            if (inFlight > 0)
+            {
+                throw std::runtime_error("Delayed gradients still in flight, drain() them first.");
+            }
+
+            double tLaunched = slotLaunch[slot] >= 0.0 ? slotLaunch[slot] : MPI_Wtime();
+            launchRemaining(scale);
+            complete(slot);
+            recordStats(tLaunched);
+        }
+
+        /// @brief Launch the remaining buckets without waiting for them and, once more than `staleness` steps are in flight, apply the oldest one.
+        /// @details The current (local) gradients have been handed over to the allreduce, so they are either replaced by the stale reduced ones or zeroed.
+        /// @param scale Factor applied to the summed gradients of the launched step once it is applied.
+        /// @return `true` if the parameters hold a (stale) reduced gradient that should be applied, `false` while the pipeline is still filling up.
+        bool finishDelayed(DT scale)
+        {
+            launchRemaining(scale);
+            slot = (slot + 1) % numSlots();
+
+            if (inFlight <= (size_t)staleness)
+            {
+                for (std::shared_ptr<PPGrad::TensorBase<Dim, DT>> &param : params)
+                {
+                    param->zeroGrad();
+                }
+                stats.buckets = buckets.size();
+                stats.backwardTime = tBackwardEnd - tBackwardStart;
+                return false;
+            }
+
+            // The oldest in-flight step lives in the slot that will be launched next.
+            double tLaunched = slotLaunch[slot];
+            complete(slot);
+            recordStats(tLaunched);
+            return true;
+        }
+
+        /// @brief Apply the oldest delayed step still in flight (used to flush the pipeline at the end of training).
+        /// @return `true` if the parameters hold a reduced gradient that should be applied, `false` if nothing was in flight.
+        bool drain()
+        {
+            if (inFlight == 0)
+            {
+                return false;
+            }
+
+            // Oldest in-flight step: inFlight slots back from the one to be launched next.
+            size_t oldest = (slot + numSlots() - inFlight) % numSlots();
+            complete(oldest);
+            return true;
+        }
+
+        /// @brief Statistics of the last finished synchronization.
+        const SyncStats &getStats() const
+        {
+            return stats;
+        }
+
+        /// @brief Number of gradient buckets the parameters were split into.
+        size_t numBuckets() const
+        {
+            return buckets.size();
+        }
+    };
+
+} // namespace PPNN
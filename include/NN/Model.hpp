@@ -34,6 +34,14 @@ namespace PPNN
         /// @brief Set list of [trainable] parameters of the model (intended to contain updated parameters after running optimizer).
         /// @param params List of (updated) [trainable] parameters of the model.
         virtual void setParams(std::vector<std::shared_ptr<PPGrad::TensorBase<Dim, DT>>> &params) = 0;
+
+        /// @brief Whether `forward()` and backward() of the outputs run MPI collectives (e.g., tensor-parallel layers, see `NN/TensorParallel.hpp`).
+        /// @details All ranks have to issue those in the same order from the master thread, so trainers then process the samples one after the other.
+        /// @return `true` if the samples must not be processed concurrently.
+        virtual bool runsCollectives() const
+        {
+            return false;
+        }
     };
 
 }
\ No newline at end of file
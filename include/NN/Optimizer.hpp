@@ -6,6 +6,12 @@
 #include "Tensor/TensorBase.hpp"
 #include <vector>
 #include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <cstdint>
+#include <cmath>
+#include <omp.h>
 
 namespace PPNN
 {
@@ -13,9 +19,15 @@ namespace PPNN
     enum class Optimizers
     {
         SGD,
-        ADAM
+        NESTEROV,
+        ADAM,
+        ADAMW
     };
 
+    /// @brief Named state tensors of an optimizer (see `Optimizer::getState()`).
+    template <int Dim, typename DT>
+    using OptimizerState = std::vector<std::pair<std::string, std::shared_ptr<Eigen::Tensor<DT, Dim>>>>;
+
     template <int Dim, typename DT>
     class Optimizer
     {
@@ -27,8 +39,50 @@ namespace PPNN
 
         /// @brief Reset the state of the optimizer (e.g., momentum, velocity, etc.)
         virtual void resetState() = 0;
+
+        /// @brief Named state tensors of the optimizer (e.g., Adam's moments) for checkpointing, empty before the first update.
+        virtual OptimizerState<Dim, DT> getState()
+        {
+            return {};
+        }
+
+        /// @brief Restore the state tensors from `getState()` of an optimizer of the same kind (e.g., loaded from a checkpoint).
+        virtual void setState(const OptimizerState<Dim, DT> &state)
+        {
+            if (!state.empty())
+            {
+                throw std::invalid_argument("This optimizer has no state tensors.");
+            }
+        }
+
+        /// @brief Number of updates done so far (e.g., Adam's bias correction step `t`), 0 if the optimizer does not count them.
+        virtual int64_t getStep() const
+        {
+            return 0;
+        }
+
+        /// @brief Restore the number of updates done so far.
+        virtual void setStep(int64_t step)
+        {
+            (void)step;
+        }
     };
 
+    /// @brief Restore the tensors `prefix0`, `prefix1`, ... of `state` into `tensors` (helper of `Optimizer::setState()`).
+    template <int Dim, typename DT>
+    void restoreStateTensors(const OptimizerState<Dim, DT> &state, size_t begin, size_t count, const std::string &prefix, std::vector<std::shared_ptr<Eigen::Tensor<DT, Dim>>> &tensors)
+    {
+        tensors.clear();
+        for (size_t i = 0; i < count; i++)
+        {
+            if (begin + i >= state.size() || state[begin + i].first != prefix + std::to_string(i))
+            {
+                throw std::invalid_argument("Optimizer state is missing " + prefix + std::to_string(i) + ".");
+            }
+            tensors.push_back(std::make_shared<Eigen::Tensor<DT, Dim>>(*state[begin + i].second));
+        }
+    }
+
     template <int Dim, typename DT>
     class SGD : public Optimizer<Dim, DT>
     {
@@ -54,8 +108,81 @@ namespace PPNN
         {
             // Nothing to reset for SGD.
         }
+
+        /// @brief Get the learning rate (e.g., for trainers applying the SGD step themselves).
+        double getLearningRate() const
+        {
+            return learningRate;
+        }
+    };
+
+    /// @brief SGD with Nesterov momentum (PyTorch formulation): `v = momentum * v + g`, `w -= learningRate * (g + momentum * v)`.
+    /// @details Used e.g. as DiLoCo's outer optimizer, where the "gradient" is the averaged parameter delta of the workers.
+    template <int Dim, typename DT>
+    class NesterovSGD : public Optimizer<Dim, DT>
+    {
+    private:
+        double learningRate;
+        double momentum;
+
+        std::vector<std::shared_ptr<Eigen::Tensor<DT, Dim>>> velocity;
+
+    public:
+        NesterovSGD(double learningRate, double momentum = 0.9)
+        {
+            this->learningRate = learningRate;
+            this->momentum = momentum;
+        }
+
+        void update(std::vector<std::shared_ptr<PPGrad::TensorBase<Dim, DT>>> params) override
+        {
+            if (velocity.size() == 0)
+            {
+                for (std::shared_ptr<PPGrad::TensorBase<Dim, DT>> &param : params)
+                {
+                    std::shared_ptr<Eigen::Tensor<DT, Dim>> v0 = std::make_shared<Eigen::Tensor<DT, Dim>>(param->getData()->dimensions());
+                    v0->setZero();
+                    velocity.push_back(v0);
+                }
+            }
+            else if (velocity.size() != params.size())
+            {
+                throw std::runtime_error("Number of parameters changed between updates!");
+            }
+
+            for (size_t i = 0; i < params.size(); i++)
+            {
+                *velocity[i] = (momentum * *velocity[i]) + *params[i]->getGrad();
+                *params[i]->getData() = *params[i]->getData() - (learningRate * (*params[i]->getGrad() + (momentum * *velocity[i])));
+                params[i]->zeroGrad();
+            }
+        }
+
+        void resetState() override
+        {
+            velocity.clear();
+        }
+
+        OptimizerState<Dim, DT> getState() override
+        {
+            OptimizerState<Dim, DT> state;
+            for (size_t i = 0; i < velocity.size(); i++)
+            {
+                state.emplace_back("velocity" + std::to_string(i), velocity[i]);
+            }
+            return state;
+        }
+
+        void setState(const OptimizerState<Dim, DT> &state) override
+        {
+            restoreStateTensors<Dim, DT>(state, 0, state.size(), "velocity", velocity);
+        }
     };
 
+    /// @brief Adam (Kingma & Ba), optionally with decoupled weight decay (AdamW, Loshchilov & Hutter).
+    /// @details Every update is a single fused pass over each parameter: the moments, the parameter and the zeroing of the gradient are done element by element,
+    /// vectorized and, for large models, split across OpenMP threads (statically, so the result does not depend on the number of threads). The bias corrections
+    /// are computed once per update.
     template <int Dim, typename DT>
     class Adam : public Optimizer<Dim, DT>
     {
@@ -64,6 +191,7 @@ namespace PPNN
         double beta1;
         double beta2;
         double epsilon;
+        double weightDecay;
 
         std::vector<std::shared_ptr<Eigen::Tensor<DT, Dim>>> m;
         std::vector<std::shared_ptr<Eigen::Tensor<DT, Dim>>> v;
@@ -71,12 +199,17 @@ namespace PPNN
         int32_t numParams;
 
     public:
-        Adam(double learningRate, double beta1 = 0.9, double beta2 = 0.999, double epsilon = 1e-8)
+        static inline size_t parallelMinElements = 1 << 15; ///< Updates of fewer parameter elements in total run on the calling thread only.
+
+        /// @brief Construct the optimizer.
+        /// @param weightDecay Decoupled weight decay: every update first scales the parameters by `1 - learningRate * weightDecay` (0 = plain Adam).
+        Adam(double learningRate, double beta1 = 0.9, double beta2 = 0.999, double epsilon = 1e-8, double weightDecay = 0)
         {
             this->learningRate = learningRate;
             this->beta1 = beta1;
             this->beta2 = beta2;
             this->epsilon = epsilon;
+            this->weightDecay = weightDecay;
         }
 
         void update(std::vector<std::shared_ptr<PPGrad::TensorBase<Dim, DT>>> params) override
@@ -84,7 +217,7 @@ namespace PPNN
             if (m.size() == 0)
             {
                 numParams = params.size();
-                for (std::shared_ptr<Eigen::Tensor<DT, Dim>> &param : params)
+                for (std::shared_ptr<PPGrad::TensorBase<Dim, DT>> &param : params)
                 {
                     std::shared_ptr<Eigen::Tensor<DT, Dim>> m0 = std::make_shared<Eigen::Tensor<DT, Dim>>(param->getData()->dimensions());
                     m0->setZero();
@@ -102,16 +235,37 @@ namespace PPNN
 
             t++;
 
-            for (int32_t i = 0; i < numParams; i++)
-            {
-                *m[i] = (beta1 * *m[i]) + ((1 - beta1) * *params[i]->getGrad());
-                *v[i] = (beta2 * *v[i]) + ((1 - beta2) * (params[i]->getGrad()->pow(2)));
+            // w = w * (1 - lr * wd) - lr * mHat / (sqrt(vHat) + eps), with mHat = m / (1 - beta1^t) and sqrt(vHat) = sqrt(v) / sqrt(1 - beta2^t).
+            const DT b1 = beta1;
+            const DT b2 = beta2;
+            const DT eps = epsilon;
+            const DT decay = 1 - learningRate * weightDecay;
+            const DT stepSize = learningRate / (1 - std::pow(beta1, t));
+            const DT invSqrtCorrection2 = 1 / std::sqrt(1 - std::pow(beta2, t));
 
-                Eigen::Tensor<DT, Dim> mHat = *m[i] / (1 - std::pow(beta1, t));
-                Eigen::Tensor<DT, Dim> vHat = *v[i] / (1 - std::pow(beta2, t));
+            size_t totalElements = 0;
+            for (std::shared_ptr<PPGrad::TensorBase<Dim, DT>> &param : params)
+                totalElements += param->getData()->size();
 
-                *params[i]->getData() = *params[i]->getData() - (learningRate * (mHat / (vHat.sqrt() + epsilon)));
-                params[i]->zeroGrad();
+#pragma omp parallel default(shared) if (totalElements >= parallelMinElements)
+            for (int32_t i = 0; i < numParams; i++)
+            {
+                DT *w = params[i]->getData()->data();
+                DT *g = params[i]->getGrad()->data();
+                DT *mi = m[i]->data();
+                DT *vi = v[i]->data();
+                const Eigen::Index size = params[i]->getData()->size();
+#pragma omp for simd schedule(static) nowait
+                for (Eigen::Index k = 0; k < size; k++)
+                {
+                    const DT grad = g[k];
+                    const DT mk = b1 * mi[k] + (1 - b1) * grad;
+                    const DT vk = b2 * vi[k] + (1 - b2) * grad * grad;
+                    mi[k] = mk;
+                    vi[k] = vk;
+                    w[k] = w[k] * decay - stepSize * mk / (std::sqrt(vk) * invSqrtCorrection2 + eps);
+                    g[k] = 0;
+                }
             }
         }
 
@@ -121,6 +275,52 @@ namespace PPNN
             v.clear();
             t = 0;
         }
+
+        OptimizerState<Dim, DT> getState() override
+        {
+            OptimizerState<Dim, DT> state;
+            for (size_t i = 0; i < m.size(); i++)
+            {
+                state.emplace_back("m" + std::to_string(i), m[i]);
+            }
+            for (size_t i = 0; i < v.size(); i++)
+            {
+                state.emplace_back("v" + std::to_string(i), v[i]);
+            }
+            return state;
+        }
+
+        void setState(const OptimizerState<Dim, DT> &state) override
+        {
+            if (state.size() % 2 != 0)
+            {
+                throw std::invalid_argument("Adam state needs as many second moments as first moments.");
+            }
+            restoreStateTensors<Dim, DT>(state, 0, state.size() / 2, "m", m);
+            restoreStateTensors<Dim, DT>(state, state.size() / 2, state.size() / 2, "v", v);
+            numParams = m.size();
+        }
+
+        int64_t getStep() const override
+        {
+            return t;
+        }
+
+        void setStep(int64_t step) override
+        {
+            t = step;
+        }
+    };
+
+    /// @brief Adam with decoupled weight decay (PyTorch defaults).
+    template <int Dim, typename DT>
+    class AdamW : public Adam<Dim, DT>
+    {
+    public:
+        AdamW(double learningRate, double weightDecay = 0.01, double beta1 = 0.9, double beta2 = 0.999, double epsilon = 1e-8)
+            : Adam<Dim, DT>(learningRate, beta1, beta2, epsilon, weightDecay)
+        {
+        }
     };
 
 }
\ No newline at end of file
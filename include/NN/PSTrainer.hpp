@@ -0,0 +1,377 @@
+/** @file */
+
+#pragma once
+
+#include "Tensor/TensorBase.hpp"
+#include "Tensor/Tensor.hpp"
+#include "NN/Model.hpp"
+#include "NN/Optimizer.hpp"
+#include "NN/Loss.hpp"
+#include "NN/DatasetView.hpp"
+#include "TensorMPI.hpp"
+#include <vector>
+#include <deque>
+#include <memory>
+#include <iostream>
+#include <numeric>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <omp.h>
+#include <mpi.h>
+
+namespace PPNN
+{
+
+    /// @brief Statistics of a parameter-server training run (of the calling rank).
+    struct PSStats
+    {
+        size_t steps = 0;        ///< Gradients pushed (workers) or applied (servers).
+        size_t samples = 0;      ///< Samples trained on (workers).
+        double waitTime = 0.0;   ///< Time spent waiting for parameters (workers), including time held back by the staleness bound.
+        size_t heldBack = 0;     ///< Replies delayed because the worker ran ahead of the staleness bound (servers).
+        double trainTime = 0.0;  ///< Wall time of the calling rank's training loop (without the final parameter broadcast).
+    };
+
+    /// @brief Asynchronous parameter-server trainer with a stale-synchronous-parallel (SSP) bound.
+    /// @details The first `numServers` ranks are parameter servers, each holding a contiguous shard of the flattened parameters (and the optimizer state for it); all other ranks are workers.
+    /// After every batch a worker pushes its gradient shards to the servers and waits for the updated parameter shards; servers apply every push as it arrives (scaled by `1 / numWorkers`, so a round of pushes equals one averaged step) and answer it with their current shard.
+    /// There is no global barrier, so a slow worker does not hold the others back - unless a worker gets more than `staleness` steps ahead of the slowest unfinished one, in which case the servers delay its reply (SSP).
+    /// Communication uses nonblocking point-to-point messages on a private duplicate of the communicator.
+    /// @tparam DT Data type of the model.
+    /// @tparam Dim Dimension of the model's tensors.
+    template <int Dim, typename DT>
+    class PSTrainer
+    {
+    private:
+        static constexpr int TAG_PUSH = 1;
+        static constexpr int TAG_PARAMS = 2;
+        static constexpr int TAG_DONE = 3;
+
+        std::shared_ptr<Model<Dim, DT>> model;
+        std::shared_ptr<Optimizer<Dim, DT>> optimizer;
+        std::shared_ptr<Loss<Dim, DT>> loss;
+        std::vector<std::shared_ptr<PPGrad::TensorBase<Dim, DT>>> params;
+
+        int numServers;
+        int32_t staleness;
+        MPI_Comm comm;
+        int worldSize = 1;
+        int worldRank = 0;
+        std::vector<size_t> shardBegin; ///< First flat parameter element of every server's shard (plus the total at the end).
+        PSStats stats;
+
+        int numWorkers() const
+        {
+            return worldSize - numServers;
+        }
+
+        void packGrads(std::vector<DT> &flat)
+        {
+            size_t offset = 0;
+            for (std::shared_ptr<PPGrad::TensorBase<Dim, DT>> &param : params)
+            {
+                std::copy(param->getGrad()->data(), param->getGrad()->data() + param->getGrad()->size(), flat.data() + offset);
+                offset += param->getGrad()->size();
+                param->zeroGrad();
+            }
+        }
+
+        void unpackParams(const std::vector<DT> &flat)
+        {
+            size_t offset = 0;
+            for (std::shared_ptr<PPGrad::TensorBase<Dim, DT>> &param : params)
+            {
+                std::copy(flat.data() + offset, flat.data() + offset + param->getData()->size(), param->getData()->data());
+                offset += param->getData()->size();
+            }
+        }
+
+        /// @brief Server loop: apply pushes as they arrive and answer them, holding back workers that are too far ahead.
+        void serve()
+        {
+            const int server = worldRank;
+            const size_t shardSize = shardBegin[server + 1] - shardBegin[server];
+
+            // The shard as a single (flat) parameter, so any optimizer can update it.
+            Eigen::array<Eigen::Index, Dim> dims;
+            dims.fill(1);
+            dims[0] = shardSize;
+            std::shared_ptr<PPGrad::TensorBase<Dim, DT>> shard = std::make_shared<PPGrad::Tensor<Dim, DT>>(std::make_shared<Eigen::Tensor<DT, Dim>>(dims), true);
+            std::vector<DT> flat(shardBegin.back());
+            {
+                size_t offset = 0;
+                for (std::shared_ptr<PPGrad::TensorBase<Dim, DT>> &param : params)
+                {
+                    std::copy(param->getData()->data(), param->getData()->data() + param->getData()->size(), flat.data() + offset);
+                    offset += param->getData()->size();
+                }
+            }
+            std::copy(flat.begin() + shardBegin[server], flat.begin() + shardBegin[server + 1], shard->getData()->data());
+            std::vector<std::shared_ptr<PPGrad::TensorBase<Dim, DT>>> shardParams = {shard};
+
+            std::vector<int64_t> clocks(numWorkers(), 0);
+            std::vector<bool> finished(numWorkers(), false);
+            std::deque<int> heldBack;
+            std::vector<DT> grad(shardSize);
+            const DT scale = (DT)1 / (DT)numWorkers();
+            int done = 0;
+
+            auto slowestClock = [&]()
+            {
+                int64_t slowest = std::numeric_limits<int64_t>::max();
+                for (int w = 0; w < numWorkers(); w++)
+                    if (!finished[w])
+                        slowest = std::min(slowest, clocks[w]);
+                return slowest;
+            };
+            auto reply = [&](int worker)
+            {
+                MPI_Send(shard->getData()->data(), shardSize, PPGrad::mpiDatatype<DT>(), worker + numServers, TAG_PARAMS, comm);
+            };
+            auto releaseHeldBack = [&]()
+            {
+                const int64_t slowest = slowestClock();
+                for (auto it = heldBack.begin(); it != heldBack.end();)
+                {
+                    if (clocks[*it] - slowest <= staleness)
+                    {
+                        reply(*it);
+                        it = heldBack.erase(it);
+                    }
+                    else
+                    {
+                        ++it;
+                    }
+                }
+            };
+
+            while (done < numWorkers())
+            {
+                MPI_Status status;
+                MPI_Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, comm, &status);
+                const int worker = status.MPI_SOURCE - numServers;
+                if (status.MPI_TAG == TAG_DONE)
+                {
+                    MPI_Recv(nullptr, 0, MPI_BYTE, status.MPI_SOURCE, TAG_DONE, comm, MPI_STATUS_IGNORE);
+                    finished[worker] = true;
+                    done++;
+                    releaseHeldBack();
+                    continue;
+                }
+
+                MPI_Recv(grad.data(), shardSize, PPGrad::mpiDatatype<DT>(), status.MPI_SOURCE, TAG_PUSH, comm, MPI_STATUS_IGNORE);
+                DT *shardGrad = shard->getGrad()->data();
+                for (size_t i = 0; i < shardSize; i++)
+                {
+                    shardGrad[i] = grad[i] * scale;
+                }
+                optimizer->update(shardParams);
+                clocks[worker]++;
+                stats.steps++;
+
+                // SSP: answer right away unless the worker is too far ahead of the slowest one.
+                if (clocks[worker] - slowestClock() <= staleness)
+                {
+                    reply(worker);
+                }
+                else
+                {
+                    heldBack.push_back(worker);
+                    stats.heldBack++;
+                }
+                releaseHeldBack();
+            }
+
+            std::copy(shard->getData()->data(), shard->getData()->data() + shardSize, flat.begin() + shardBegin[server]);
+            unpackParams(flat);
+        }
+
+        /// @brief Push the gradient shards to the servers and wait for the updated parameter shards.
+        void pushPull(std::vector<DT> &gradFlat, std::vector<DT> &paramFlat)
+        {
+            packGrads(gradFlat);
+            std::vector<MPI_Request> requests(2 * numServers);
+            for (int s = 0; s < numServers; s++)
+            {
+                const size_t size = shardBegin[s + 1] - shardBegin[s];
+                MPI_Irecv(paramFlat.data() + shardBegin[s], size, PPGrad::mpiDatatype<DT>(), s, TAG_PARAMS, comm, &requests[2 * s]);
+                MPI_Isend(gradFlat.data() + shardBegin[s], size, PPGrad::mpiDatatype<DT>(), s, TAG_PUSH, comm, &requests[2 * s + 1]);
+            }
+            const double begin = MPI_Wtime();
+            MPI_Waitall(requests.size(), requests.data(), MPI_STATUSES_IGNORE);
+            stats.waitTime += MPI_Wtime() - begin;
+            unpackParams(paramFlat);
+            stats.steps++;
+        }
+
+    public:
+        /// @brief Construct the trainer.
+        /// @param model Model to train (should be the same on all ranks, see `PPGrad::modelBroadcast`).
+        /// @param optimizer Optimizer the servers apply to their shards (must work element-wise, e.g., `SGD`, `NesterovSGD` or `Adam`).
+        /// @param loss Loss function.
+        /// @param numServers Number of ranks acting as parameter servers (the first ones of `comm`).
+        /// @param staleness SSP bound: maximum number of steps a worker may be ahead of the slowest unfinished worker.
+        /// @param comm Communicator of all servers and workers.
+        PSTrainer(
+            std::shared_ptr<Model<Dim, DT>> model,
+            std::shared_ptr<Optimizer<Dim, DT>> optimizer,
+            std::shared_ptr<Loss<Dim, DT>> loss,
+            int numServers = 1,
+            int32_t staleness = 2,
+            MPI_Comm comm = MPI_COMM_WORLD)
+        {
+            this->model = model;
+            this->optimizer = optimizer;
+            this->loss = loss;
+            this->params = model->getParams();
+            this->numServers = numServers;
+            this->staleness = staleness;
+
+            // Validate before duplicating the communicator: a throwing constructor skips the destructor, which frees it.
+            MPI_Comm_size(comm, &worldSize);
+            if (numServers < 1 || numServers >= worldSize || staleness < 0)
+            {
+                throw std::invalid_argument("Parameter-server training needs 1 to worldSize - 1 servers and a non-negative staleness bound.");
+            }
+            MPI_Comm_dup(comm, &this->comm);
+            MPI_Comm_rank(this->comm, &worldRank);
+
+            // Balanced contiguous shards of the flattened parameters
+            size_t total = 0;
+            for (std::shared_ptr<PPGrad::TensorBase<Dim, DT>> &param : params)
+            {
+                total += param->getData()->size();
+            }
+            for (int s = 0; s <= numServers; s++)
+            {
+                shardBegin.push_back(total * s / numServers);
+            }
+        }
+
+        PSTrainer(const PSTrainer &) = delete;
+        PSTrainer &operator=(const PSTrainer &) = delete;
+
+        ~PSTrainer()
+        {
+            int finalized;
+            MPI_Finalized(&finalized);
+            if (!finalized)
+            {
+                MPI_Comm_free(&comm);
+            }
+        }
+
+        /// @brief Whether the calling rank is a parameter server (and ignores the data passed to `train()`).
+        bool isServer() const
+        {
+            return worldRank < numServers;
+        }
+
+        /// @brief Index of the calling worker in [0, numWorkers) (e.g., to pick its data shard), -1 on servers.
+        int workerIndex() const
+        {
+            return isServer() ? -1 : worldRank - numServers;
+        }
+
+        /// @brief Number of worker ranks.
+        int getNumWorkers() const
+        {
+            return numWorkers();
+        }
+
+        /// @brief Statistics of the last `train()` on the calling rank.
+        const PSStats &getStats() const
+        {
+            return stats;
+        }
+
+        /// @brief Train until every worker went through its data `epochs` times. All ranks must call this, servers ignore the data.
+        /// @details Workers may hold different amounts of data. At the end, all ranks (servers and workers) hold the final parameters.
+        void train(DatasetView<Dim, DT> inputs,
+                   DatasetView<Dim, DT> targets,
+                   size_t epochs,
+                   size_t batchSize,
+                   bool verbose = false)
+        {
+            stats = PSStats();
+            const double begin = MPI_Wtime();
+
+            if (isServer())
+            {
+                serve();
+            }
+            else
+            {
+                std::vector<DT> gradFlat(shardBegin.back());
+                std::vector<DT> paramFlat(shardBegin.back());
+                std::vector<std::shared_ptr<PPGrad::TensorBase<Dim, DT>>> batchPredictions;
+                for (size_t epoch = 0; epoch < epochs; epoch++)
+                {
+                    std::vector<DT> epochLosses;
+                    for (size_t batch = 0; batch < inputs.numBatches(batchSize); batch++)
+                    {
+                        const DatasetView<Dim, DT> batchInputs = inputs.batch(batch, batchSize);
+                        const DatasetView<Dim, DT> batchTargets = targets.batch(batch, batchSize);
+                        batchPredictions.resize(batchInputs.size());
+#pragma omp parallel for default(shared)
+                        for (size_t batchIdx = 0; batchIdx < batchInputs.size(); batchIdx++)
+                        {
+                            batchPredictions[batchIdx] = model->forward(batchInputs[batchIdx]);
+                        }
+
+                        DT batchLoss = 0;
+                        for (size_t batchIdx = 0; batchIdx < batchPredictions.size(); batchIdx++)
+                        {
+                            batchLoss += loss->operator()(batchPredictions[batchIdx], batchTargets[batchIdx], true);
+                        }
+                        epochLosses.push_back(batchLoss / batchPredictions.size());
+
+#pragma omp parallel for default(shared) schedule(dynamic, 1)
+                        for (size_t predIdx = 0; predIdx < batchPredictions.size(); predIdx++)
+                        {
+                            PPGrad::TensorBase<Dim, DT>::backward(batchPredictions[predIdx]);
+                        }
+
+                        pushPull(gradFlat, paramFlat);
+                        stats.samples += batchInputs.size();
+                    }
+
+                    if (verbose)
+                    {
+                        std::cout << "[Rank: " << worldRank << "] "
+                                  << "Epoch: " << epoch << ", Loss: " << std::accumulate(epochLosses.begin(), epochLosses.end(), 0.0) / epochLosses.size() << std::endl;
+                    }
+                }
+
+                for (int s = 0; s < numServers; s++)
+                {
+                    MPI_Send(nullptr, 0, MPI_BYTE, s, TAG_DONE, comm);
+                }
+            }
+
+            stats.trainTime = MPI_Wtime() - begin;
+
+            // Final parameters: every server broadcasts its shard.
+            std::vector<DT> flat(shardBegin.back());
+            size_t offset = 0;
+            for (std::shared_ptr<PPGrad::TensorBase<Dim, DT>> &param : params)
+            {
+                std::copy(param->getData()->data(), param->getData()->data() + param->getData()->size(), flat.data() + offset);
+                offset += param->getData()->size();
+            }
+            for (int s = 0; s < numServers; s++)
+            {
+                MPI_Bcast(flat.data() + shardBegin[s], shardBegin[s + 1] - shardBegin[s], PPGrad::mpiDatatype<DT>(), s, comm);
+            }
+            unpackParams(flat);
+
+            if (verbose)
+            {
+                std::cout << "[Rank: " << worldRank << "] " << (isServer() ? "Server" : "Worker") << ": " << stats.steps << " steps, "
+                          << stats.samples << " samples, waited " << stats.waitTime * 1e3 << " ms, held back " << stats.heldBack << " replies." << std::endl;
+            }
+        }
+    };
+
+} // namespace PPNN
@@ -0,0 +1,368 @@
+/** @file */
+
+#pragma once
+
+#include "Tensor/TensorBase.hpp"
+#include "Tensor/Tensor.hpp"
+#include "NN/Dense.hpp"
+#include "NN/Optimizer.hpp"
+#include "NN/Loss.hpp"
+#include "NN/DatasetView.hpp"
+#include "TensorMPI.hpp"
+#include <vector>
+#include <memory>
+#include <iostream>
+#include <numeric>
+#include <algorithm>
+#include <utility>
+#include <stdexcept>
+#include <omp.h>
+#include <mpi.h>
+
+namespace PPNN
+{
+
+    /// @brief Statistics of a pipeline-parallel training run (of the calling stage).
+    struct PipelineStats
+    {
+        size_t microBatches = 0;        ///< Micro-batches streamed through the pipeline.
+        double computeTime = 0.0;       ///< Time spent in this stage's forward and backward passes (and the loss on the last stage).
+        double waitTime = 0.0;          ///< Time spent waiting for activations or gradients from the neighboring stages.
+        double trainTime = 0.0;         ///< Wall time of the training loop.
+        double idealBubbleFraction = 0; ///< Idle fraction of the 1F1B schedule with equal stages, `(stages - 1) / (microBatches per batch + stages - 1)`.
+        double loss = 0.0;              ///< Mean training loss of the last epoch (last stage only).
+
+        /// @brief Fraction of the training time this stage spent idle (waiting on its neighbors or the end of the batch).
+        double bubbleFraction() const
+        {
+            return trainTime > 0.0 ? 1.0 - computeTime / trainTime : 0.0;
+        }
+    };
+
+    /// @brief Range [first, last) of the layers stage `stage` of `numStages` holds when `numLayers` sequential layers are split as evenly as possible.
+    /// @details Lets every rank construct only its own layers (see `PipelineTrainer`).
+    inline std::pair<size_t, size_t> pipelineStageLayers(size_t numLayers, int numStages, int stage)
+    {
+        const size_t base = numLayers / numStages;
+        const size_t extra = numLayers % numStages;
+        const size_t first = stage * base + std::min<size_t>(stage, extra);
+        return {first, first + base + ((size_t)stage < extra ? 1 : 0)};
+    }
+
+    /// @brief Pipeline-parallel trainer for a sequential stack of `Dense` layers: every rank (stage) holds consecutive layers, and micro-batches stream through the stages.
+    /// @details Each batch is split into `numMicroBatches` micro-batches that follow the 1F1B schedule (PipeDream-Flush): stage `s` of `S` runs `S - s - 1` warm-up forward passes,
+    /// then alternates one forward and one backward pass, then drains the remaining backward passes, so at most `S - s` micro-batches' activations are held at a time.
+    /// Activations go to the next stage and their gradients back with nonblocking point-to-point messages on a private duplicate of the communicator, all receives of a batch are
+    /// posted up front. After the batch, every stage applies the optimizer to its own layers (with the gradients summed over the batch, as in `Trainer`), so the result equals
+    /// sequential training with the same batches. Within a stage, the samples of a micro-batch run in parallel with OpenMP; MPI is only called from the master thread.
+    /// @tparam DT Data type of the model.
+    /// @tparam Dim Dimension of the model's tensors.
+    template <int Dim, typename DT>
+    class PipelineTrainer
+    {
+    private:
+        static constexpr int TAG_ACTIVATION = 1;
+        static constexpr int TAG_GRADIENT = 2;
+
+        std::vector<std::shared_ptr<Dense<Dim, DT>>> layers;
+        std::shared_ptr<Optimizer<Dim, DT>> optimizer;
+        std::shared_ptr<Loss<Dim, DT>> loss;
+        std::vector<std::shared_ptr<PPGrad::TensorBase<Dim, DT>>> params;
+        size_t numMicroBatches;
+
+        MPI_Comm comm;
+        int numStages = 1;
+        int stage = 0;
+        PipelineStats stats;
+
+        /// @brief State of a micro-batch between its forward and backward pass.
+        struct MicroBatch
+        {
+            size_t begin = 0;                                                  ///< First sample (within the batch).
+            size_t size = 0;                                                   ///< Number of samples.
+            std::vector<DT> activationsIn;                                     ///< Received input activations (not the first stage).
+            std::vector<DT> gradientsIn;                                       ///< Received output gradients (not the last stage).
+            std::vector<DT> activationsOut;                                    ///< Sent output activations (not the last stage).
+            std::vector<DT> gradientsOut;                                      ///< Sent input gradients (not the first stage).
+            std::vector<std::shared_ptr<PPGrad::TensorBase<Dim, DT>>> inputs;  ///< Inputs of this stage (leaves whose gradients go back to the previous stage).
+            std::vector<std::shared_ptr<PPGrad::TensorBase<Dim, DT>>> outputs; ///< Outputs of this stage.
+            MPI_Request activationRecv = MPI_REQUEST_NULL;
+            MPI_Request gradientRecv = MPI_REQUEST_NULL;
+        };
+
+        bool firstStage() const
+        {
+            return stage == 0;
+        }
+
+        bool lastStage() const
+        {
+            return stage == numStages - 1;
+        }
+
+        /// @brief Wait for `request`, accounting the time as pipeline wait.
+        void wait(MPI_Request &request)
+        {
+            const double begin = MPI_Wtime();
+            MPI_Wait(&request, MPI_STATUS_IGNORE);
+            stats.waitTime += MPI_Wtime() - begin;
+        }
+
+        /// @brief Forward pass of micro-batch `mb`: receive (or take) its inputs, run this stage's layers and send the outputs on (or compute the loss on the last stage).
+        DT forward(MicroBatch &mb, DatasetView<Dim, DT> batchInputs, DatasetView<Dim, DT> batchTargets,
+                   const Eigen::array<Eigen::Index, Dim> &inputShape, std::vector<MPI_Request> &sends)
+        {
+            if (!firstStage())
+            {
+                wait(mb.activationRecv);
+            }
+
+            const double begin = MPI_Wtime();
+            const size_t inputElements = mb.activationsIn.size() / std::max<size_t>(mb.size, 1);
+            mb.inputs.resize(mb.size);
+            mb.outputs.resize(mb.size);
+#pragma omp parallel for default(shared)
+            for (size_t i = 0; i < mb.size; i++)
+            {
+                if (firstStage())
+                {
+                    mb.inputs[i] = batchInputs[mb.begin + i];
+                }
+                else
+                {
+                    std::shared_ptr<Eigen::Tensor<DT, Dim>> data = std::make_shared<Eigen::Tensor<DT, Dim>>(inputShape);
+                    std::copy(mb.activationsIn.data() + i * inputElements, mb.activationsIn.data() + (i + 1) * inputElements, data->data());
+                    mb.inputs[i] = std::make_shared<PPGrad::Tensor<Dim, DT>>(data, true);
+                }
+                std::shared_ptr<PPGrad::TensorBase<Dim, DT>> output = mb.inputs[i];
+                for (std::shared_ptr<Dense<Dim, DT>> &layer : layers)
+                {
+                    output = layer->forward(output);
+                }
+                mb.outputs[i] = output;
+            }
+
+            DT mbLoss = 0;
+            if (lastStage())
+            {
+                for (size_t i = 0; i < mb.size; i++)
+                {
+                    mbLoss += loss->operator()(mb.outputs[i], batchTargets[mb.begin + i], true);
+                }
+            }
+            else
+            {
+                const size_t outputElements = mb.size > 0 ? mb.outputs[0]->getData()->size() : 0;
+                mb.activationsOut.resize(mb.size * outputElements);
+                for (size_t i = 0; i < mb.size; i++)
+                {
+                    std::copy(mb.outputs[i]->getData()->data(), mb.outputs[i]->getData()->data() + outputElements, mb.activationsOut.data() + i * outputElements);
+                }
+            }
+            stats.computeTime += MPI_Wtime() - begin;
+
+            if (!lastStage())
+            {
+                sends.emplace_back();
+                MPI_Isend(mb.activationsOut.data(), mb.activationsOut.size(), PPGrad::mpiDatatype<DT>(), stage + 1, TAG_ACTIVATION, comm, &sends.back());
+            }
+            return mbLoss;
+        }
+
+        /// @brief Backward pass of micro-batch `mb`: receive the gradients of its outputs (the last stage seeded them with the loss), backpropagate through this stage and send the input gradients back.
+        void backward(MicroBatch &mb, std::vector<MPI_Request> &sends)
+        {
+            if (!lastStage())
+            {
+                wait(mb.gradientRecv);
+            }
+
+            const double begin = MPI_Wtime();
+            const size_t outputElements = mb.gradientsIn.size() / std::max<size_t>(mb.size, 1);
+#pragma omp parallel for default(shared) schedule(dynamic, 1)
+            for (size_t i = 0; i < mb.size; i++)
+            {
+                if (!lastStage())
+                {
+                    DT *grad = mb.outputs[i]->getGrad()->data();
+                    for (size_t k = 0; k < outputElements; k++)
+                    {
+                        grad[k] += mb.gradientsIn[i * outputElements + k];
+                    }
+                }
+                PPGrad::TensorBase<Dim, DT>::backward(mb.outputs[i]);
+            }
+
+            if (!firstStage())
+            {
+                const size_t inputElements = mb.size > 0 ? mb.inputs[0]->getGrad()->size() : 0;
+                mb.gradientsOut.resize(mb.size * inputElements);
+                for (size_t i = 0; i < mb.size; i++)
+                {
+                    std::copy(mb.inputs[i]->getGrad()->data(), mb.inputs[i]->getGrad()->data() + inputElements, mb.gradientsOut.data() + i * inputElements);
+                }
+            }
+            // The graph of the micro-batch is no longer needed.
+            mb.inputs.clear();
+            mb.outputs.clear();
+            stats.computeTime += MPI_Wtime() - begin;
+
+            if (!firstStage())
+            {
+                sends.emplace_back();
+                MPI_Isend(mb.gradientsOut.data(), mb.gradientsOut.size(), PPGrad::mpiDatatype<DT>(), stage - 1, TAG_GRADIENT, comm, &sends.back());
+            }
+        }
+
+    public:
+        /// @brief Construct the trainer (collective over `comm`). Every rank is one stage, in rank order.
+        /// @param layers This stage's consecutive layers of the model (see `pipelineStageLayers()`); the input size of the first one has to match the output size of the previous stage's last one.
+        /// @param optimizer Optimizer for this stage's parameters.
+        /// @param loss Loss function (only used by the last stage).
+        /// @param numMicroBatches Number of micro-batches every batch is split into (more shrink the pipeline bubble, but each is smaller).
+        /// @param comm Communicator of all stages.
+        PipelineTrainer(std::vector<std::shared_ptr<Dense<Dim, DT>>> layers,
+                        std::shared_ptr<Optimizer<Dim, DT>> optimizer,
+                        std::shared_ptr<Loss<Dim, DT>> loss,
+                        size_t numMicroBatches = 4,
+                        MPI_Comm comm = MPI_COMM_WORLD)
+        {
+            if (layers.empty() || numMicroBatches < 1)
+            {
+                throw std::invalid_argument("Every pipeline stage needs at least one layer and one micro-batch.");
+            }
+            this->layers = layers;
+            this->optimizer = optimizer;
+            this->loss = loss;
+            this->numMicroBatches = numMicroBatches;
+            for (std::shared_ptr<Dense<Dim, DT>> &layer : this->layers)
+            {
+                params.insert(params.end(), layer->getParams().begin(), layer->getParams().end());
+            }
+            MPI_Comm_dup(comm, &this->comm);
+            MPI_Comm_size(this->comm, &numStages);
+            MPI_Comm_rank(this->comm, &stage);
+        }
+
+        PipelineTrainer(const PipelineTrainer &) = delete;
+        PipelineTrainer &operator=(const PipelineTrainer &) = delete;
+
+        ~PipelineTrainer()
+        {
+            int finalized;
+            MPI_Finalized(&finalized);
+            if (!finalized)
+            {
+                MPI_Comm_free(&comm);
+            }
+        }
+
+        /// @brief Statistics of the last `train()` on the calling stage.
+        const PipelineStats &getStats() const
+        {
+            return stats;
+        }
+
+        /// @brief Train the pipeline. All stages must call this with views of the same samples; only the first stage uses the values of `inputs` and only the last stage `targets`.
+        /// @details The last batch of an epoch may be smaller than `batchSize` (and is then split into fewer micro-batches if it has fewer samples than `numMicroBatches`).
+        void train(DatasetView<Dim, DT> inputs,
+                   DatasetView<Dim, DT> targets,
+                   size_t epochs,
+                   size_t batchSize,
+                   bool verbose = false)
+        {
+            if (inputs.size() != targets.size() || inputs.empty())
+            {
+                throw std::invalid_argument("Inputs and targets must have the same (non-zero) number of samples.");
+            }
+            stats = PipelineStats();
+            stats.idealBubbleFraction = (double)(numStages - 1) / (double)(std::min(numMicroBatches, batchSize) + numStages - 1);
+            const double trainBegin = MPI_Wtime();
+
+            // Shapes at the stage boundaries: Dense maps the rows and keeps the other dimensions of a sample.
+            Eigen::array<Eigen::Index, Dim> inputShape = inputs[0]->getData()->dimensions();
+            inputShape[0] = layers.front()->getParams()[0]->getData()->dimension(1);
+            size_t sampleElements = 1;
+            for (int d = 1; d < Dim; d++)
+                sampleElements *= inputShape[d];
+            const size_t inputElements = inputShape[0] * sampleElements;
+            const size_t outputElements = layers.back()->getParams()[0]->getData()->dimension(0) * sampleElements;
+
+            std::vector<MicroBatch> microBatches;
+            std::vector<MPI_Request> sends;
+            for (size_t epoch = 0; epoch < epochs; epoch++)
+            {
+                DT epochLoss = 0;
+                for (size_t b = 0; b < inputs.numBatches(batchSize); b++)
+                {
+                    const DatasetView<Dim, DT> batchInputs = inputs.batch(b, batchSize);
+                    const DatasetView<Dim, DT> batchTargets = targets.batch(b, batchSize);
+
+                    // Split the batch into micro-batches and post all of their receives.
+                    const size_t M = std::min(numMicroBatches, batchInputs.size());
+                    microBatches.assign(M, MicroBatch());
+                    for (size_t m = 0; m < M; m++)
+                    {
+                        MicroBatch &mb = microBatches[m];
+                        mb.begin = m * batchInputs.size() / M;
+                        mb.size = (m + 1) * batchInputs.size() / M - mb.begin;
+                        if (!firstStage())
+                        {
+                            mb.activationsIn.resize(mb.size * inputElements);
+                            MPI_Irecv(mb.activationsIn.data(), mb.activationsIn.size(), PPGrad::mpiDatatype<DT>(), stage - 1, TAG_ACTIVATION, comm, &mb.activationRecv);
+                        }
+                        if (!lastStage())
+                        {
+                            mb.gradientsIn.resize(mb.size * outputElements);
+                            MPI_Irecv(mb.gradientsIn.data(), mb.gradientsIn.size(), PPGrad::mpiDatatype<DT>(), stage + 1, TAG_GRADIENT, comm, &mb.gradientRecv);
+                        }
+                    }
+                    sends.clear();
+                    sends.reserve(2 * M);
+
+                    // 1F1B: warm-up forwards, steady state of one forward and one backward, cool-down backwards.
+                    const size_t warmup = std::min<size_t>(numStages - stage - 1, M);
+                    size_t nextForward = 0;
+                    size_t nextBackward = 0;
+                    while (nextForward < warmup)
+                    {
+                        epochLoss += forward(microBatches[nextForward++], batchInputs, batchTargets, inputShape, sends);
+                    }
+                    while (nextForward < M)
+                    {
+                        epochLoss += forward(microBatches[nextForward++], batchInputs, batchTargets, inputShape, sends);
+                        backward(microBatches[nextBackward++], sends);
+                    }
+                    while (nextBackward < M)
+                    {
+                        backward(microBatches[nextBackward++], sends);
+                    }
+
+                    const double begin = MPI_Wtime();
+                    MPI_Waitall(sends.size(), sends.data(), MPI_STATUSES_IGNORE);
+                    stats.waitTime += MPI_Wtime() - begin;
+                    stats.microBatches += M;
+
+                    const double updateBegin = MPI_Wtime();
+                    optimizer->update(params);
+                    stats.computeTime += MPI_Wtime() - updateBegin;
+                }
+
+                stats.loss = epochLoss / inputs.size();
+                if (verbose && lastStage())
+                {
+                    std::cout << "[Stage: " << stage << "] "
+                              << "Epoch: " << epoch << ", Loss: " << stats.loss << std::endl;
+                }
+            }
+
+            stats.trainTime = MPI_Wtime() - trainBegin;
+            if (verbose)
+            {
+                std::cout << "[Stage: " << stage << "] " << layers.size() << " layers, " << stats.microBatches << " micro-batches, compute " << stats.computeTime * 1e3 << " ms, waited "
+                          << stats.waitTime * 1e3 << " ms, bubble " << stats.bubbleFraction() * 100.0 << "% (1F1B ideal " << stats.idealBubbleFraction * 100.0 << "%)." << std::endl;
+            }
+        }
+    };
+
+} // namespace PPNN
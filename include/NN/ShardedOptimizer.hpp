@@ -0,0 +1,283 @@
+/** @file
+ * @brief ZeRO-style (stage 1) sharding of the optimizer state across data-parallel ranks.
+ */
+
+#pragma once
+
+#include "Tensor/TensorBase.hpp"
+#include "Tensor/Tensor.hpp"
+#include "NN/Optimizer.hpp"
+#include "TensorMPI.hpp"
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <mpi.h>
+
+namespace PPNN
+{
+
+    /// @brief Optimizer wrapper that keeps the state of `optimizer` only for a 1/N slice of the (flattened) parameters on each of the N ranks of a communicator.
+    /// @details Every `update()` reduce-scatters the gradients, so each rank receives the sum over all ranks of its slice only, runs the wrapped optimizer on that slice
+    /// (as a single flat parameter) and allgathers the updated slices into the parameters of all ranks. The optimizer state (e.g., Adam's two moments) thus shrinks
+    /// linearly with the number of ranks, while the communication volume equals that of an allreduce. The wrapped optimizer has to work element-wise (e.g., `SGD`,
+    /// `NesterovSGD` or `Adam`), and `update()` is collective, i.e., all ranks have to call it in lockstep with parameters of the same shapes.
+    ///
+    /// Apart from the slice (parameters and gradients) nothing scales with the model: the gradients are packed into a buffer of at most `chunkBytes` (and at most a slice) and reduce-scattered
+    /// in rounds, each carrying the next piece of every rank's slice, and the updated slices land straight in the parameters through `createTensorsType` datatypes.
+    template <int Dim, typename DT>
+    class ShardedOptimizer : public Optimizer<Dim, DT>
+    {
+    private:
+        std::shared_ptr<Optimizer<Dim, DT>> optimizer; ///< Optimizer applied to this rank's slice.
+        MPI_Comm comm;                                 ///< Ranks sharing the optimizer state (duplicated).
+        int worldSize;
+        int worldRank;
+        DT gradScale = 1; ///< Factor applied to the summed gradients (e.g., 1 / worldSize to average).
+
+        size_t total = 0;                                   ///< Number of flat parameter elements.
+        std::vector<int> shardCounts;                       ///< Number of flat parameter elements in every rank's slice.
+        std::vector<int> shardDispls;                       ///< First flat parameter element of every rank's slice.
+        size_t chunkElements;                               ///< Capacity of the reduce-scatter buffer in elements.
+        size_t pieceElements = 1;                           ///< Elements of every rank's slice reduce-scattered per round.
+        std::vector<DT> chunk;                              ///< Packed gradient pieces of one reduce-scatter round.
+        std::shared_ptr<PPGrad::TensorBase<Dim, DT>> shard; ///< This rank's slice of the parameters as a single flat parameter.
+
+        /// @brief Shape of a flat tensor of `count` elements.
+        static std::array<int, Dim> flatShape(size_t count)
+        {
+            std::array<int, Dim> shape;
+            shape.fill(1);
+            shape[0] = (int)count;
+            return shape;
+        }
+
+        /// @brief Dimensions of a flat tensor of `count` elements.
+        static Eigen::DSizes<Eigen::Index, Dim> flatDims(size_t count)
+        {
+            Eigen::DSizes<Eigen::Index, Dim> dims;
+            for (int d = 0; d < Dim; d++)
+                dims[d] = 1;
+            dims[0] = count;
+            return dims;
+        }
+
+        /// @brief Split the flattened parameters into balanced contiguous slices, unless done already.
+        void layout(std::vector<std::shared_ptr<PPGrad::TensorBase<Dim, DT>>> &params)
+        {
+            size_t count = 0;
+            for (std::shared_ptr<PPGrad::TensorBase<Dim, DT>> &param : params)
+                count += param->getData()->size();
+            if (count == total && shard)
+            {
+                return;
+            }
+            if (shard)
+            {
+                throw std::runtime_error("Number of parameters changed between updates!");
+            }
+
+            total = count;
+            shardCounts.resize(worldSize);
+            shardDispls.resize(worldSize);
+            for (int r = 0; r < worldSize; r++)
+            {
+                shardDispls[r] = total * r / worldSize;
+                shardCounts[r] = total * (r + 1) / worldSize - shardDispls[r];
+            }
+            const size_t largestShard = *std::max_element(shardCounts.begin(), shardCounts.end());
+            // The buffer holds one piece per rank and is no larger than a slice (nor `chunkElements`), so it shrinks with the number of ranks as well.
+            pieceElements = std::max<size_t>(1, std::min((largestShard + worldSize - 1) / worldSize, chunkElements / worldSize));
+            chunk.resize(pieceElements * worldSize);
+            shard = PPGrad::Tensor<Dim, DT>::zeros(flatShape(shardCounts[worldRank]), true);
+        }
+
+        /// @brief Copy elements `[begin, end)` of the flattened gradients to `dst`.
+        static void packGrads(std::vector<std::shared_ptr<PPGrad::TensorBase<Dim, DT>>> &params, size_t begin, size_t end, DT *dst)
+        {
+            size_t offset = 0;
+            for (std::shared_ptr<PPGrad::TensorBase<Dim, DT>> &param : params)
+            {
+                const size_t size = param->getGrad()->size();
+                const size_t first = std::max(begin, offset);
+                const size_t last = std::min(end, offset + size);
+                if (first < last)
+                {
+                    dst = std::copy(param->getGrad()->data() + (first - offset), param->getGrad()->data() + (last - offset), dst);
+                }
+                offset += size;
+            }
+        }
+
+    public:
+        /// @brief Wrap `optimizer` (collective over `comm`).
+        /// @param optimizer Element-wise optimizer to apply to this rank's slice (its state only ever covers that slice).
+        /// @param comm Data-parallel ranks holding replicas of the parameters.
+        /// @param chunkBytes Size of the buffer the gradients are reduce-scattered through.
+        ShardedOptimizer(std::shared_ptr<Optimizer<Dim, DT>> optimizer, MPI_Comm comm = MPI_COMM_WORLD, size_t chunkBytes = 4 * 1024 * 1024)
+        {
+            this->optimizer = optimizer;
+            this->chunkElements = std::max<size_t>(1, chunkBytes / sizeof(DT));
+            MPI_Comm_dup(comm, &this->comm);
+            MPI_Comm_size(this->comm, &worldSize);
+            MPI_Comm_rank(this->comm, &worldRank);
+        }
+
+        ~ShardedOptimizer()
+        {
+            int finalized;
+            MPI_Finalized(&finalized);
+            if (!finalized)
+            {
+                MPI_Comm_free(&comm);
+            }
+        }
+
+        ShardedOptimizer(const ShardedOptimizer &) = delete;
+        ShardedOptimizer &operator=(const ShardedOptimizer &) = delete;
+
+        /// @brief Set the factor the summed gradients are multiplied with before the update (1 = sum, 1 / number of ranks = average).
+        void setGradScale(DT scale)
+        {
+            gradScale = scale;
+        }
+
+        /// @brief The wrapped optimizer.
+        std::shared_ptr<Optimizer<Dim, DT>> getOptimizer() const
+        {
+            return optimizer;
+        }
+
+        /// @brief Number of flat parameter elements whose optimizer state this rank keeps (0 before the first update).
+        size_t shardSize() const
+        {
+            return shard ? shard->getData()->size() : 0;
+        }
+
+        /// @brief Bytes of the buffers this wrapper holds besides the wrapped optimizer's state, i.e., the slice's parameters and gradients and the reduce-scatter buffer.
+        size_t workspaceBytes() const
+        {
+            return (2 * shardSize() + chunk.size()) * sizeof(DT);
+        }
+
+        /// @brief Reduce-scatter the gradients, update this rank's slice of the parameters and allgather all slices (collective).
+        /// @param params List of [trainable] parameters of the model (the same on all ranks, gradients local to every rank).
+        void update(std::vector<std::shared_ptr<PPGrad::TensorBase<Dim, DT>>> params) override
+        {
+            layout(params);
+
+            // Round k reduce-scatters the k-th piece of every rank's slice (the number of rounds only depends on the layout, so it is the same on all ranks).
+            DT *shardGrad = shard->getGrad()->data();
+            const size_t rounds = (*std::max_element(shardCounts.begin(), shardCounts.end()) + pieceElements - 1) / pieceElements;
+            std::vector<int> roundCounts(worldSize);
+            for (size_t k = 0; k < rounds; k++)
+            {
+                size_t packed = 0;
+                for (int r = 0; r < worldSize; r++)
+                {
+                    const size_t begin = std::min<size_t>(k * pieceElements, shardCounts[r]);
+                    const size_t end = std::min<size_t>(begin + pieceElements, shardCounts[r]);
+                    roundCounts[r] = end - begin;
+                    packGrads(params, shardDispls[r] + begin, shardDispls[r] + end, chunk.data() + packed);
+                    packed += end - begin;
+                }
+                MPI_Reduce_scatter(chunk.data(), shardGrad + std::min<size_t>(k * pieceElements, shardCounts[worldRank]), roundCounts.data(), PPGrad::mpiDatatype<DT>(), MPI_SUM, comm);
+            }
+            for (int i = 0; i < shardCounts[worldRank]; i++)
+            {
+                shardGrad[i] *= gradScale;
+            }
+
+            // The parameters are replicated, so this rank's slice of them is current.
+            DT *shardData = shard->getData()->data();
+            size_t offset = 0;
+            std::vector<std::shared_ptr<Eigen::Tensor<DT, Dim>>> data;
+            for (std::shared_ptr<PPGrad::TensorBase<Dim, DT>> &param : params)
+            {
+                const size_t size = param->getData()->size();
+                const size_t begin = std::max<size_t>(offset, shardDispls[worldRank]);
+                const size_t end = std::min<size_t>(offset + size, shardDispls[worldRank] + shardCounts[worldRank]);
+                if (begin < end)
+                {
+                    std::copy(param->getData()->data() + (begin - offset), param->getData()->data() + (end - offset), shardData + (begin - shardDispls[worldRank]));
+                }
+                offset += size;
+                param->zeroGrad();
+                data.push_back(param->getData());
+            }
+            std::vector<std::shared_ptr<PPGrad::TensorBase<Dim, DT>>> shardParams = {shard};
+            optimizer->update(shardParams);
+
+            // Allgather the updated slices straight into the parameters: rank r's slice arrives through a datatype covering its range of the parameters' storage.
+            std::vector<MPI_Datatype> sendTypes(worldSize, PPGrad::mpiDatatype<DT>());
+            std::vector<MPI_Datatype> recvTypes(worldSize);
+            std::vector<int> sendCounts(worldSize, shardCounts[worldRank]);
+            std::vector<int> recvCounts(worldSize);
+            std::vector<int> displs(worldSize, 0);
+            for (int r = 0; r < worldSize; r++)
+            {
+                recvTypes[r] = PPGrad::createTensorsType<Dim, DT>(data, shardDispls[r], shardDispls[r] + shardCounts[r]);
+                recvCounts[r] = shardCounts[r] > 0 ? 1 : 0;
+            }
+            MPI_Alltoallw(shardData, sendCounts.data(), displs.data(), sendTypes.data(), MPI_BOTTOM, recvCounts.data(), displs.data(), recvTypes.data(), comm);
+            for (MPI_Datatype &type : recvTypes)
+            {
+                MPI_Type_free(&type);
+            }
+        }
+
+        void resetState() override
+        {
+            optimizer->resetState();
+        }
+
+        /// @brief State of the wrapped optimizer for all parameters, gathered from the slices of all ranks (collective), so checkpoints do not depend on the number of ranks.
+        OptimizerState<Dim, DT> getState() override
+        {
+            OptimizerState<Dim, DT> state = optimizer->getState();
+            for (std::pair<std::string, std::shared_ptr<Eigen::Tensor<DT, Dim>>> &entry : state)
+            {
+                std::shared_ptr<Eigen::Tensor<DT, Dim>> full = std::make_shared<Eigen::Tensor<DT, Dim>>(flatDims(total));
+                MPI_Allgatherv(entry.second->data(), shardCounts[worldRank], PPGrad::mpiDatatype<DT>(), full->data(), shardCounts.data(), shardDispls.data(), PPGrad::mpiDatatype<DT>(), comm);
+                entry.second = full;
+            }
+            return state;
+        }
+
+        /// @brief Restore the state from `getState()`, keeping this rank's slice of every state tensor.
+        /// @details Called before the first update (e.g., when resuming), the slices are laid out from the size of the stored state.
+        void setState(const OptimizerState<Dim, DT> &state) override
+        {
+            OptimizerState<Dim, DT> slices;
+            for (const std::pair<std::string, std::shared_ptr<Eigen::Tensor<DT, Dim>>> &entry : state)
+            {
+                if (!shard)
+                {
+                    std::vector<std::shared_ptr<PPGrad::TensorBase<Dim, DT>>> flatParam = {PPGrad::Tensor<Dim, DT>::zeros(flatShape(entry.second->size()), false)};
+                    layout(flatParam);
+                }
+                if ((size_t)entry.second->size() != total)
+                {
+                    throw std::invalid_argument("Sharded optimizer state " + entry.first + " does not cover all " + std::to_string(total) + " parameter elements.");
+                }
+                std::shared_ptr<Eigen::Tensor<DT, Dim>> slice = std::make_shared<Eigen::Tensor<DT, Dim>>(flatDims(shardCounts[worldRank]));
+                std::copy(entry.second->data() + shardDispls[worldRank], entry.second->data() + shardDispls[worldRank] + shardCounts[worldRank], slice->data());
+                slices.emplace_back(entry.first, slice);
+            }
+            optimizer->setState(slices);
+        }
+
+        int64_t getStep() const override
+        {
+            return optimizer->getStep();
+        }
+
+        void setStep(int64_t step) override
+        {
+            optimizer->setStep(step);
+        }
+    };
+
+} // namespace PPNN
@@ -0,0 +1,448 @@
+/** @file
+ * @brief Tensor-parallel (Megatron-style) Dense layers whose weights are sharded across the ranks of a communicator, plus the autograd nodes of their collectives.
+ */
+
+#pragma once
+
+#include "Tensor/TensorBase.hpp"
+#include "Tensor/Tensor.hpp"
+#include "NN/Model.hpp"
+#include "NN/WeightInitializers.hpp"
+#include "NN/Activations.hpp"
+#include "TensorMPI.hpp"
+#include <unsupported/Eigen/CXX11/Tensor>
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <utility>
+#include <vector>
+#include <omp.h>
+#include <mpi.h>
+
+namespace PPNN
+{
+
+    /// @brief Rows [first, second) of `n` rows owned by `rank` when they are split as evenly as possible over `size` ranks (the first `n % size` ranks get one more).
+    inline std::pair<Eigen::Index, Eigen::Index> tensorParallelShard(Eigen::Index n, int size, int rank)
+    {
+        const Eigen::Index base = n / size;
+        const Eigen::Index remainder = n % size;
+        const Eigen::Index first = rank * base + std::min<Eigen::Index>(rank, remainder);
+        return {first, first + base + (rank < remainder ? 1 : 0)};
+    }
+
+    namespace TensorParallel
+    {
+
+        /// @brief Abort unless called by the master thread outside of any parallel region: every rank of `comm` has to issue the collectives of the
+        /// tensor-parallel layers in the same order, and MPI is only initialized for the master thread (`MPI_THREAD_FUNNELED`).
+        inline void requireMasterThread(const char *operation)
+        {
+            if (omp_in_parallel() || omp_get_thread_num() != 0)
+            {
+                std::cerr << "Error: " << operation << " of a tensor-parallel layer must run on the master thread outside of parallel regions "
+                          << "(process the samples one after the other, see `Model::runsCollectives()`)." << std::endl;
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+        }
+
+        /// @brief This rank's rows (along dimension 0) of `full`.
+        template <int Dim, typename DT>
+        Eigen::Tensor<DT, Dim> sliceRows(const Eigen::Tensor<DT, Dim> &full, MPI_Comm comm)
+        {
+            int size, rank;
+            MPI_Comm_size(comm, &size);
+            MPI_Comm_rank(comm, &rank);
+            const std::pair<Eigen::Index, Eigen::Index> rows = tensorParallelShard(full.dimension(0), size, rank);
+            Eigen::DSizes<Eigen::Index, Dim> offsets;
+            Eigen::DSizes<Eigen::Index, Dim> extents = full.dimensions();
+            for (int d = 0; d < Dim; d++)
+                offsets[d] = 0;
+            offsets[0] = rows.first;
+            extents[0] = rows.second - rows.first;
+            return full.slice(offsets, extents);
+        }
+
+        /// @brief Concatenate the rows (along dimension 0) every rank of `comm` holds into the full tensor of `fullRows` rows (collective).
+        template <int Dim, typename DT>
+        Eigen::Tensor<DT, Dim> allgatherRows(const Eigen::Tensor<DT, Dim> &local, Eigen::Index fullRows, MPI_Comm comm)
+        {
+            int size;
+            MPI_Comm_size(comm, &size);
+            Eigen::Index elementsPerRow = 1;
+            for (int d = 1; d < Dim; d++)
+                elementsPerRow *= local.dimension(d);
+
+            // Every rank's block is contiguous in the receive buffer, in rank order.
+            std::vector<int> counts(size), displs(size);
+            for (int r = 0, displ = 0; r < size; r++)
+            {
+                const std::pair<Eigen::Index, Eigen::Index> rows = tensorParallelShard(fullRows, size, r);
+                counts[r] = (int)((rows.second - rows.first) * elementsPerRow);
+                displs[r] = displ;
+                displ += counts[r];
+            }
+            std::vector<DT> blocks(fullRows * elementsPerRow);
+            MPI_Allgatherv(local.data(), (int)local.size(), PPGrad::mpiDatatype<DT>(), blocks.data(), counts.data(), displs.data(), PPGrad::mpiDatatype<DT>(), comm);
+
+            Eigen::DSizes<Eigen::Index, Dim> dims = local.dimensions();
+            dims[0] = fullRows;
+            Eigen::Tensor<DT, Dim> full(dims);
+            Eigen::DSizes<Eigen::Index, Dim> offsets;
+            for (int d = 0; d < Dim; d++)
+                offsets[d] = 0;
+            for (int r = 0; r < size; r++)
+            {
+                const std::pair<Eigen::Index, Eigen::Index> rows = tensorParallelShard(fullRows, size, r);
+                Eigen::DSizes<Eigen::Index, Dim> extents = dims;
+                extents[0] = rows.second - rows.first;
+                offsets[0] = rows.first;
+                full.slice(offsets, extents) = Eigen::TensorMap<Eigen::Tensor<DT, Dim>>(blocks.data() + displs[r], extents);
+            }
+            return full;
+        }
+
+        /// @brief Sum `tensor` over all ranks of `comm`, in place (collective).
+        template <int Dim, typename DT>
+        void allreduceSum(Eigen::Tensor<DT, Dim> &tensor, MPI_Comm comm)
+        {
+            MPI_Allreduce(MPI_IN_PLACE, tensor.data(), (int)tensor.size(), PPGrad::mpiDatatype<DT>(), MPI_SUM, comm);
+        }
+
+        /// @brief Node entering a tensor-parallel region with a replicated input (`f` in Megatron-LM): identity in forward(), allreduce of the gradient in backward(),
+        /// as every rank only computes the gradient contributed by its shard of the weights.
+        template <int Dim, typename DT>
+        class CopyTensor : public PPGrad::Tensor<Dim, DT>
+        {
+        private:
+            std::shared_ptr<PPGrad::TensorBase<Dim, DT>> input;
+            MPI_Comm comm;
+
+        public:
+            CopyTensor(std::shared_ptr<PPGrad::TensorBase<Dim, DT>> input, MPI_Comm comm) : input(input), comm(comm)
+            {
+                this->data = input->getData();
+                this->gradient = std::make_shared<Eigen::Tensor<DT, Dim>>(this->data->dimensions());
+                this->gradient->setZero();
+                this->requiresGrad = input->getRequiresGrad();
+            }
+
+            void _backward() override
+            {
+                if (input->getRequiresGrad())
+                {
+                    requireMasterThread("backward()");
+                    std::shared_ptr<Eigen::Tensor<DT, Dim>> grad = std::make_shared<Eigen::Tensor<DT, Dim>>(*this->gradient);
+                    allreduceSum(*grad, comm);
+                    input->addGrad(grad);
+                }
+            }
+
+            std::vector<std::shared_ptr<PPGrad::TensorBase<Dim, DT>>> getParents() override
+            {
+                return {input};
+            }
+
+            bool isCollective() const override
+            {
+                return true;
+            }
+        };
+
+        /// @brief Node leaving a tensor-parallel region with partial sums (`g` in Megatron-LM): allreduce in forward(), identity in backward(),
+        /// as the gradient of the (replicated) sum is already the same on all ranks.
+        template <int Dim, typename DT>
+        class ReduceTensor : public PPGrad::Tensor<Dim, DT>
+        {
+        private:
+            std::shared_ptr<PPGrad::TensorBase<Dim, DT>> input;
+
+        public:
+            ReduceTensor(std::shared_ptr<PPGrad::TensorBase<Dim, DT>> input, MPI_Comm comm) : input(input)
+            {
+                requireMasterThread("forward()");
+                this->data = std::make_shared<Eigen::Tensor<DT, Dim>>(*input->getData());
+                allreduceSum(*this->data, comm);
+                this->gradient = std::make_shared<Eigen::Tensor<DT, Dim>>(this->data->dimensions());
+                this->gradient->setZero();
+                this->requiresGrad = input->getRequiresGrad();
+            }
+
+            void _backward() override
+            {
+                if (input->getRequiresGrad())
+                {
+                    input->addGrad(std::make_shared<Eigen::Tensor<DT, Dim>>(*this->gradient));
+                }
+            }
+
+            std::vector<std::shared_ptr<PPGrad::TensorBase<Dim, DT>>> getParents() override
+            {
+                return {input};
+            }
+        };
+
+        /// @brief Node concatenating the row shards of all ranks into the full (replicated) tensor: allgather in forward(), in backward() every rank keeps the gradient of its own rows.
+        template <int Dim, typename DT>
+        class GatherTensor : public PPGrad::Tensor<Dim, DT>
+        {
+        private:
+            std::shared_ptr<PPGrad::TensorBase<Dim, DT>> input;
+            MPI_Comm comm;
+
+        public:
+            GatherTensor(std::shared_ptr<PPGrad::TensorBase<Dim, DT>> input, Eigen::Index fullRows, MPI_Comm comm) : input(input), comm(comm)
+            {
+                requireMasterThread("forward()");
+                this->data = std::make_shared<Eigen::Tensor<DT, Dim>>(allgatherRows(*input->getData(), fullRows, comm));
+                this->gradient = std::make_shared<Eigen::Tensor<DT, Dim>>(this->data->dimensions());
+                this->gradient->setZero();
+                this->requiresGrad = input->getRequiresGrad();
+            }
+
+            void _backward() override
+            {
+                if (input->getRequiresGrad())
+                {
+                    input->addGrad(std::make_shared<Eigen::Tensor<DT, Dim>>(sliceRows(*this->gradient, comm)));
+                }
+            }
+
+            std::vector<std::shared_ptr<PPGrad::TensorBase<Dim, DT>>> getParents() override
+            {
+                return {input};
+            }
+        };
+
+        /// @brief Node splitting a replicated tensor into this rank's rows: slice in forward(), allgather of the row gradients in backward().
+        template <int Dim, typename DT>
+        class ScatterTensor : public PPGrad::Tensor<Dim, DT>
+        {
+        private:
+            std::shared_ptr<PPGrad::TensorBase<Dim, DT>> input;
+            MPI_Comm comm;
+
+        public:
+            ScatterTensor(std::shared_ptr<PPGrad::TensorBase<Dim, DT>> input, MPI_Comm comm) : input(input), comm(comm)
+            {
+                this->data = std::make_shared<Eigen::Tensor<DT, Dim>>(sliceRows(*input->getData(), comm));
+                this->gradient = std::make_shared<Eigen::Tensor<DT, Dim>>(this->data->dimensions());
+                this->gradient->setZero();
+                this->requiresGrad = input->getRequiresGrad();
+            }
+
+            void _backward() override
+            {
+                if (input->getRequiresGrad())
+                {
+                    requireMasterThread("backward()");
+                    input->addGrad(std::make_shared<Eigen::Tensor<DT, Dim>>(allgatherRows(*this->gradient, input->getData()->dimension(0), comm)));
+                }
+            }
+
+            std::vector<std::shared_ptr<PPGrad::TensorBase<Dim, DT>>> getParents() override
+            {
+                return {input};
+            }
+
+            bool isCollective() const override
+            {
+                return true;
+            }
+        };
+
+    } // namespace TensorParallel
+
+    /// @brief Base of the tensor-parallel layers: owns the (duplicated) communicator of the ranks sharing the weights and the layer's activation.
+    template <int Dim, typename DT>
+    class TensorParallelDense : public Model<Dim, DT>
+    {
+    protected:
+        /// @brief List of all [trainable] parameters of this rank's shard of the layer (in order: W, b)
+        std::vector<std::shared_ptr<PPGrad::TensorBase<Dim, DT>>> params;
+        std::shared_ptr<PPGrad::TensorBase<Dim, DT>> W;
+        std::shared_ptr<PPGrad::TensorBase<Dim, DT>> b;
+        std::shared_ptr<PPNN::Activation<Dim, DT>> activation;
+
+        MPI_Comm comm; ///< Ranks sharing the weights of the layer (duplicated).
+        int size;      ///< Number of ranks in `comm`.
+        int rank;      ///< Rank in `comm`.
+
+        TensorParallelDense(MPI_Comm comm, PPNN::Activations activation)
+        {
+            MPI_Comm_dup(comm, &this->comm);
+            MPI_Comm_size(this->comm, &size);
+            MPI_Comm_rank(this->comm, &rank);
+            if (activation == PPNN::Activations::ReLU)
+            {
+                this->activation = std::make_shared<PPNN::ReLU<Dim, DT>>();
+            }
+            else
+            {
+                this->activation = std::make_shared<PPNN::Linear<Dim, DT>>();
+            }
+        }
+
+        /// @brief Initialize the full `outDim x inDim` weights with `initializer` (the same on all ranks, as the initializers are deterministic) and return this rank's
+        /// `rows` and `cols`, so a sharded layer starts from exactly the weights of the corresponding `Dense` layer.
+        static std::shared_ptr<PPGrad::TensorBase<Dim, DT>> initShard(int inDim, int outDim, WeightInititializers initializer,
+                                                                     std::pair<Eigen::Index, Eigen::Index> rows, std::pair<Eigen::Index, Eigen::Index> cols)
+        {
+            std::shared_ptr<PPGrad::TensorBase<Dim, DT>> full = PPGrad::Tensor<Dim, DT>::zeros({outDim, inDim}, false);
+            WeightInitializer<Dim, DT>::init(full, initializer);
+            Eigen::DSizes<Eigen::Index, Dim> offsets;
+            Eigen::DSizes<Eigen::Index, Dim> extents;
+            for (int d = 0; d < Dim; d++)
+            {
+                offsets[d] = 0;
+                extents[d] = 1;
+            }
+            offsets[0] = rows.first;
+            offsets[1] = cols.first;
+            extents[0] = rows.second - rows.first;
+            extents[1] = cols.second - cols.first;
+            return std::make_shared<PPGrad::Tensor<Dim, DT>>(std::make_shared<Eigen::Tensor<DT, Dim>>(full->getData()->slice(offsets, extents)), true);
+        }
+
+    public:
+        ~TensorParallelDense()
+        {
+            int finalized;
+            MPI_Finalized(&finalized);
+            if (!finalized)
+            {
+                MPI_Comm_free(&comm);
+            }
+        }
+
+        TensorParallelDense(const TensorParallelDense &) = delete;
+        TensorParallelDense &operator=(const TensorParallelDense &) = delete;
+
+        /// @brief Forward function of the layer for a batch of inputs (one collective per sample and direction, issued in sample order).
+        std::vector<std::shared_ptr<PPGrad::TensorBase<Dim, DT>>> forward(std::vector<std::shared_ptr<PPGrad::TensorBase<Dim, DT>>> inputs) override
+        {
+            std::vector<std::shared_ptr<PPGrad::TensorBase<Dim, DT>>> outputs;
+            outputs.reserve(inputs.size());
+            for (std::shared_ptr<PPGrad::TensorBase<Dim, DT>> input : inputs)
+            {
+                outputs.push_back(this->forward(input));
+            }
+            return outputs;
+        }
+
+        using Model<Dim, DT>::forward;
+
+        /// @brief Return this rank's shard of the [trainable] parameters.
+        std::vector<std::shared_ptr<PPGrad::TensorBase<Dim, DT>>> &getParams() override
+        {
+            return this->params;
+        }
+
+        /// @brief Set this rank's shard of the [trainable] parameters (in order: W, b).
+        void setParams(std::vector<std::shared_ptr<PPGrad::TensorBase<Dim, DT>>> &params) override
+        {
+            W = params[0];
+            b = params[1];
+        }
+
+        bool runsCollectives() const override
+        {
+            return true;
+        }
+    };
+
+    /// @brief Dense layer `y = act(Wx + b)` with the rows of `W` (output features) sharded across the ranks of a communicator.
+    /// @details Every rank holds `outDim / p` rows of `W` and `b` and computes its slice of the output from the full (replicated) input, without communication.
+    /// In backward(), the input gradients of the shards are summed with an allreduce. The output slices are either gathered into the full output (allgather,
+    /// whose backward() just keeps the local rows of the gradient), or left sharded as the input of a `RowParallelDense`, which then avoids all communication
+    /// in between the two layers (the MLP block of Megatron-LM).
+    template <int Dim, typename DT>
+    class ColumnParallelDense : public TensorParallelDense<Dim, DT>
+    {
+    private:
+        int outDim;
+        bool gatherOutput;
+
+    public:
+        /// @brief Constructor for a column-parallel Dense layer (collective over `comm`).
+        /// @param inDim Dimension of input tensor.
+        /// @param outDim Dimension of output tensor (of the full layer).
+        /// @param comm Ranks sharing the layer (all must construct it with the same arguments).
+        /// @param gatherOutput Whether to return the full output on every rank (otherwise only this rank's `tensorParallelShard()` of the outputs).
+        ColumnParallelDense(
+            int inDim,
+            int outDim,
+            MPI_Comm comm,
+            bool gatherOutput = true,
+            WeightInititializers initializer = WeightInititializers::XAVIER,
+            PPNN::Activations activation = PPNN::Activations::Linear)
+            : TensorParallelDense<Dim, DT>(comm, activation), outDim(outDim), gatherOutput(gatherOutput)
+        {
+            const std::pair<Eigen::Index, Eigen::Index> rows = tensorParallelShard(outDim, this->size, this->rank);
+            this->W = this->initShard(inDim, outDim, initializer, rows, {0, inDim});
+            this->b = PPGrad::Tensor<Dim, DT>::zeros({(int)(rows.second - rows.first), 1}, true);
+            WeightInitializer<Dim, DT>::init(this->b, WeightInititializers::ZEROS);
+
+            this->params.push_back(this->W);
+            this->params.push_back(this->b);
+        }
+
+        /// @brief Forward function of the layer for a single (replicated) input.
+        std::shared_ptr<PPGrad::TensorBase<Dim, DT>> forward(std::shared_ptr<PPGrad::TensorBase<Dim, DT>> input) override
+        {
+            std::shared_ptr<PPGrad::TensorBase<Dim, DT>> x = std::make_shared<TensorParallel::CopyTensor<Dim, DT>>(input, this->comm);
+            // The activation is element-wise, so it is applied to the slice before gathering.
+            std::shared_ptr<PPGrad::TensorBase<Dim, DT>> y = this->activation->operator()((this->W * x) + this->b);
+            if (gatherOutput)
+            {
+                y = std::make_shared<TensorParallel::GatherTensor<Dim, DT>>(y, outDim, this->comm);
+            }
+            return y;
+        }
+    };
+
+    /// @brief Dense layer `y = act(Wx + b)` with the columns of `W` (input features) sharded across the ranks of a communicator.
+    /// @details Every rank holds `inDim / p` columns of `W` and multiplies them with its slice of the input, which is either taken from a replicated input (in backward(),
+    /// the input gradient slices are gathered again) or comes sharded from a `ColumnParallelDense` with `gatherOutput = false`. The partial products are summed with an
+    /// allreduce (whose gradient is passed through unchanged), then the replicated bias and the activation are applied on every rank.
+    template <int Dim, typename DT>
+    class RowParallelDense : public TensorParallelDense<Dim, DT>
+    {
+    private:
+        bool inputIsSharded;
+
+    public:
+        /// @brief Constructor for a row-parallel Dense layer (collective over `comm`).
+        /// @param inDim Dimension of input tensor (of the full layer).
+        /// @param outDim Dimension of output tensor.
+        /// @param comm Ranks sharing the layer (all must construct it with the same arguments).
+        /// @param inputIsSharded Whether the inputs are already this rank's `tensorParallelShard()` of the input features (otherwise the full input is expected).
+        RowParallelDense(
+            int inDim,
+            int outDim,
+            MPI_Comm comm,
+            bool inputIsSharded = true,
+            WeightInititializers initializer = WeightInititializers::XAVIER,
+            PPNN::Activations activation = PPNN::Activations::Linear)
+            : TensorParallelDense<Dim, DT>(comm, activation), inputIsSharded(inputIsSharded)
+        {
+            const std::pair<Eigen::Index, Eigen::Index> cols = tensorParallelShard(inDim, this->size, this->rank);
+            this->W = this->initShard(inDim, outDim, initializer, {0, outDim}, cols);
+            this->b = PPGrad::Tensor<Dim, DT>::zeros({outDim, 1}, true);
+            WeightInitializer<Dim, DT>::init(this->b, WeightInititializers::ZEROS);
+
+            this->params.push_back(this->W);
+            this->params.push_back(this->b);
+        }
+
+        /// @brief Forward function of the layer for a single input (full or sharded, see `inputIsSharded`).
+        std::shared_ptr<PPGrad::TensorBase<Dim, DT>> forward(std::shared_ptr<PPGrad::TensorBase<Dim, DT>> input) override
+        {
+            std::shared_ptr<PPGrad::TensorBase<Dim, DT>> x = inputIsSharded ? input : std::make_shared<TensorParallel::ScatterTensor<Dim, DT>>(input, this->comm);
+            std::shared_ptr<PPGrad::TensorBase<Dim, DT>> partial = this->W * x;
+            std::shared_ptr<PPGrad::TensorBase<Dim, DT>> sum = std::make_shared<TensorParallel::ReduceTensor<Dim, DT>>(partial, this->comm);
+            return this->activation->operator()(sum + this->b);
+        }
+    };
+
+} // namespace PPNN
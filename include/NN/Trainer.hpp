@@ -7,9 +7,14 @@
 #include "NN/Model.hpp"
 #include "NN/Optimizer.hpp"
 #include "NN/Loss.hpp"
+#include "NN/DatasetView.hpp"
 #include <vector>
 #include <memory>
 #include <iostream>
+#include <numeric>
+#include <algorithm>
+#include <stdexcept>
+#include <omp.h>
 
 namespace PPNN
 {
@@ -25,6 +30,68 @@ namespace PPNN
         std::shared_ptr<Optimizer<Dim, DT>> optimizer;
         std::shared_ptr<Loss<Dim, DT>> loss;
         std::vector<std::shared_ptr<PPGrad::TensorBase<Dim, DT>>> params;
+        bool hogwild = false; ///< Whether to train with lock-free concurrent SGD steps (see `setHogwild()`).
+
+        /// @brief Hogwild training loop: every OpenMP thread takes whole batches and applies their SGD step to the shared parameters without any locks.
+        void trainHogwild(DatasetView<Dim, DT> inputs,
+                          DatasetView<Dim, DT> targets,
+                          size_t epochs,
+                          size_t batchSize,
+                          bool verbose)
+        {
+            const DT learningRate = std::dynamic_pointer_cast<SGD<Dim, DT>>(optimizer)->getLearningRate();
+            const size_t numBatches = inputs.numBatches(batchSize);
+            if (verbose)
+            {
+                std::cout << "Hogwild training with " << omp_get_max_threads() << " threads." << std::endl;
+            }
+
+            for (size_t epoch = 0; epoch < epochs; epoch++)
+            {
+                DT epochLoss = 0;
+#pragma omp parallel default(shared) reduction(+ : epochLoss)
+                {
+                    // Every thread accumulates the gradients of its batch privately...
+                    std::vector<Eigen::Tensor<DT, Dim>> grads;
+                    grads.reserve(params.size());
+                    PPGrad::GradSink<Dim, DT> sink;
+                    for (std::shared_ptr<PPGrad::TensorBase<Dim, DT>> &param : params)
+                    {
+                        grads.emplace_back(param->getData()->dimensions());
+                        grads.back().setZero();
+                        sink.grads[param.get()] = &grads.back();
+                    }
+                    PPGrad::TensorBase<Dim, DT>::setThreadGradSink(&sink);
+
+#pragma omp for schedule(dynamic, 1)
+                    for (size_t batch = 0; batch < numBatches; batch++)
+                    {
+                        const DatasetView<Dim, DT> batchInputs = inputs.batch(batch, batchSize);
+                        const DatasetView<Dim, DT> batchTargets = targets.batch(batch, batchSize);
+                        for (size_t sampleIdx = 0; sampleIdx < batchInputs.size(); sampleIdx++)
+                        {
+                            std::shared_ptr<PPGrad::TensorBase<Dim, DT>> prediction = model->forward(batchInputs[sampleIdx]);
+                            epochLoss += loss->operator()(prediction, batchTargets[sampleIdx], true);
+                            PPGrad::TensorBase<Dim, DT>::backward(prediction);
+                        }
+
+                        // ...and applies its SGD step element-wise to the shared parameters, racing with the other threads by design.
+                        for (size_t i = 0; i < params.size(); i++)
+                        {
+                            *params[i]->getData() = *params[i]->getData() - (learningRate * grads[i]);
+                            grads[i].setZero();
+                        }
+                    }
+
+                    PPGrad::TensorBase<Dim, DT>::setThreadGradSink(nullptr);
+                }
+
+                if (verbose)
+                {
+                    std::cout << "Epoch: " << epoch << ", Loss: " << epochLoss / inputs.size() << std::endl;
+                }
+            }
+        }
 
     public:
         Trainer(std::shared_ptr<Model<Dim, DT>> model, std::shared_ptr<Optimizer<Dim, DT>> optimizer, std::shared_ptr<Loss<Dim, DT>> loss)
@@ -35,34 +102,55 @@ namespace PPNN
             this->params = model->getParams(); // TODO: Return by reference
         }
 
-        void train(std::vector<std::shared_ptr<PPGrad::TensorBase<Dim, DT>>> inputs,
-                   std::vector<std::shared_ptr<PPGrad::TensorBase<Dim, DT>>> targets,
+        /// @brief Enable Hogwild training (Niu et al., 2011): the OpenMP threads train on different batches concurrently and update the shared parameters without locks.
+        /// @details Every batch is still one SGD step (with the gradient summed over its samples), only the steps of different threads overlap and may overwrite
+        /// each other's element updates. This converges for sparse or small models and scales with the number of threads, as nothing is serialized.
+        /// Requires the plain `SGD` optimizer, whose step the trainer then applies itself.
+        /// @param hogwild Whether to train Hogwild.
+        void setHogwild(bool hogwild = true)
+        {
+            if (hogwild && std::dynamic_pointer_cast<SGD<Dim, DT>>(optimizer) == nullptr)
+            {
+                throw std::invalid_argument("Hogwild training requires the SGD optimizer.");
+            }
+            this->hogwild = hogwild;
+        }
+
+        /// @brief Train the model on `inputs` and `targets` (e.g., `std::vector`s of tensors, which are viewed, not copied).
+        /// @details Every batch is a slice of the views, the last batch of an epoch may be smaller than `batchSize`.
+        void train(DatasetView<Dim, DT> inputs,
+                   DatasetView<Dim, DT> targets,
                    size_t epochs,
                    size_t batchSize,
                    bool verbose = false)
         {
+            if (inputs.size() != targets.size())
+            {
+                throw std::invalid_argument("Inputs and targets must have the same number of samples.");
+            }
+            if (hogwild)
+            {
+                trainHogwild(inputs, targets, epochs, batchSize, verbose);
+                return;
+            }
+
             for (size_t epoch = 0; epoch < epochs; epoch++)
             {
                 std::vector<DT> epochLosses;
-                for (size_t batchStart = 0; batchStart < inputs.size(); batchStart += batchSize)
+                for (size_t batch = 0; batch < inputs.numBatches(batchSize); batch++)
                 {
-                    std::vector<std::shared_ptr<PPGrad::TensorBase<Dim, DT>>> batchInputs;
-                    std::vector<std::shared_ptr<PPGrad::TensorBase<Dim, DT>>> batchTargets;
-                    for (size_t batchIdx = batchStart; batchIdx < batchStart + batchSize; batchIdx++)
-                    {
-                        batchInputs.push_back(inputs[batchIdx]);
-                        batchTargets.push_back(targets[batchIdx]);
-                    }
-
-                    std::vector<std::shared_ptr<PPGrad::TensorBase<Dim, DT>>> batchPredictions = model->forward(batchInputs);
-                    DT batchLoss = loss->operator()(batchPredictions, batchTargets, true);
-                    epochLosses.push_back(batchLoss);
+                    const DatasetView<Dim, DT> batchInputs = inputs.batch(batch, batchSize);
+                    const DatasetView<Dim, DT> batchTargets = targets.batch(batch, batchSize);
 
-                    // Call backward on each output produced by forward() to accumulate gradients in the parameters.
-                    for (std::shared_ptr<PPGrad::TensorBase<Dim, DT>> &prediction : batchPredictions)
+                    // Forward, loss and backward() per sample accumulate the same gradients in the parameters as a batched pass, without materializing the batch.
+                    DT batchLoss = 0;
+                    for (size_t sampleIdx = 0; sampleIdx < batchInputs.size(); sampleIdx++)
                     {
+                        std::shared_ptr<PPGrad::TensorBase<Dim, DT>> prediction = model->forward(batchInputs[sampleIdx]);
+                        batchLoss += loss->operator()(prediction, batchTargets[sampleIdx], true);
                         PPGrad::TensorBase<Dim, DT>::backward(prediction);
                     }
+                    epochLosses.push_back(batchLoss / batchInputs.size());
 
                     optimizer->update(params);
                 }
@@ -6,10 +6,22 @@
 #include <unsupported/Eigen/CXX11/Tensor>
 #include <memory>
 #include <vector>
+#include <functional>
+#include <unordered_map>
 
 namespace PPGrad
 {
 
+    template <int Dim, typename DT>
+    class TensorBase;
+
+    /// @brief Thread-private gradient buffers of shared (leaf) tensors, see `TensorBase::setThreadGradSink()`.
+    template <int Dim, typename DT>
+    struct GradSink
+    {
+        std::unordered_map<const TensorBase<Dim, DT> *, Eigen::Tensor<DT, Dim> *> grads; ///< Buffer every listed tensor's gradient is accumulated into instead of its own.
+    };
+
     /// @brief Abstract Tensor class for all Eigen accelerated math on tensors.
     /// @details This class is a wrapper around Eigen::Matrix and Eigen::Tensor and is supposed to be immutable. Each operation instantiates a new Tensor object.s
     /// @tparam T The type of the underlying data (Eigen::Matrix or Eigen::Tensor).
@@ -26,6 +38,12 @@ namespace PPGrad
 
         bool requiresGrad = false; ///< Whether or not this tensor requires gradient accumulation.
 
+        std::function<void()> gradHook; ///< Optional callback fired after every addGrad() (e.g., gradient readiness tracking in DPTrainer).
+
+        static inline thread_local GradSink<Dim, DT> *threadGradSink = nullptr; ///< Gradient sink of the calling thread (nullptr = accumulate into the shared gradients).
+
+        static inline size_t parallelBackwardMinNodes = 256; ///< Graphs with fewer nodes are differentiated sequentially (see `setParallelBackward()`).
+
     public:
         /// @brief Get the underlying data of the tensor (of type T).
         /// @details Will probably not be implemented outside of debugging.
@@ -54,9 +72,44 @@ namespace PPGrad
             return this->gradient;
         }
 
+        /// @brief Register a callback that is fired after every gradient accumulation into this tensor.
+        /// @details The hook is called from whichever (OpenMP) thread runs backward(), so it has to be thread-safe. Pass `nullptr` to remove it.
+        /// @param hook Callback to invoke after each addGrad().
+        void setGradHook(std::function<void()> hook)
+        {
+            this->gradHook = hook;
+        }
+
+        /// @brief Install a gradient sink for the calling thread (e.g., for lock-free Hogwild training).
+        /// @details While installed, gradients this thread accumulates into a tensor listed in the sink go to the sink's buffer instead. The thread must only run backward()
+        /// on graphs it built itself, as all accumulation then skips the lock and the gradient hooks. Pass `nullptr` to uninstall it.
+        /// @param sink Sink to install.
+        static void setThreadGradSink(GradSink<Dim, DT> *sink)
+        {
+            threadGradSink = sink;
+        }
+
+        /// @brief Configure the parallel backward() executor.
+        /// @details backward() on a graph of at least `minNodes` nodes runs every node's _backward() as an OpenMP task as soon as all nodes consuming it are done,
+        /// so independent branches (e.g., the two inputs of a product or the heads of a multi-head model) are differentiated concurrently by the (work-stealing) task scheduler.
+        /// Smaller graphs, graphs with a collective node (see `isCollective()`), and backward() calls from within a (possibly inactive) parallel region or with a gradient sink
+        /// installed, run sequentially in reverse topological order.
+        /// @param minNodes Minimum number of nodes for parallel execution (`SIZE_MAX` = always sequential).
+        static void setParallelBackward(size_t minNodes)
+        {
+            parallelBackwardMinNodes = minNodes;
+        }
+
         /// @brief Get the parents of this tensor in the computation graph.
         virtual std::vector<std::shared_ptr<PPGrad::TensorBase<Dim, DT>>> getParents() = 0;
 
+        /// @brief Return true if _backward() runs a collective (e.g., MPI) operation.
+        /// @details Graphs containing such a node are always differentiated sequentially on the calling thread, so every rank issues the collectives in the same order.
+        virtual bool isCollective() const
+        {
+            return false;
+        }
+
         // ------- Static methods ------- //
 
         /// @brief Topologically order all parents of this tensor and call _backward() on them.
@@ -0,0 +1,347 @@
+/** @file
+ * @brief Binary on-disk format for datasets of equally shaped tensors, so every rank can read its own shard (see `PPGrad::readTensorShard`) or map it into memory (`PPGrad::MappedTensorDataset`).
+ * @details Layout (native byte order): magic `PPGRADDS`, `uint32` version, `uint32` element size, `uint32` number of dimensions, `uint32` reserved,
+ * `uint64` number of samples, `int64` extent of every dimension, followed by the samples back to back (each in Eigen's column-major order).
+ */
+
+#pragma once
+#include "Tensor/TensorBase.hpp"
+#include "Tensor/Tensor.hpp"
+#include "MappedFile.hpp"
+#include <unsupported/Eigen/CXX11/Tensor>
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace PPGrad
+{
+
+    /// @brief Header of a tensor dataset file.
+    struct TensorDatasetHeader
+    {
+        static constexpr char MAGIC[8] = {'P', 'P', 'G', 'R', 'A', 'D', 'D', 'S'};
+        static constexpr uint32_t VERSION = 1;
+
+        uint32_t elementSize = 0;  ///< Size of a single element in bytes.
+        uint64_t count = 0;        ///< Number of samples.
+        std::vector<int64_t> dims; ///< Shape of every sample.
+
+        /// @brief Number of elements of a single sample.
+        size_t sampleElements() const
+        {
+            size_t elements = 1;
+            for (int64_t dim : dims)
+                elements *= dim;
+            return elements;
+        }
+
+        /// @brief Byte offset of the first sample in the file.
+        size_t dataOffset() const
+        {
+            return sizeof(MAGIC) + 4 * sizeof(uint32_t) + sizeof(uint64_t) + dims.size() * sizeof(int64_t);
+        }
+    };
+
+    /// @brief Write `samples` (which must all have the same shape) as a tensor dataset file.
+    /// @param path File to (over)write.
+    /// @param samples Samples to store.
+    template <int Dim, typename DT>
+    void writeTensorDataset(const std::string &path, const std::vector<Eigen::Tensor<DT, Dim>> &samples)
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if (!file)
+        {
+            throw std::runtime_error("Cannot open " + path + " for writing.");
+        }
+
+        const uint32_t header[4] = {TensorDatasetHeader::VERSION, (uint32_t)sizeof(DT), (uint32_t)Dim, 0};
+        const uint64_t count = samples.size();
+        file.write(TensorDatasetHeader::MAGIC, sizeof(TensorDatasetHeader::MAGIC));
+        file.write(reinterpret_cast<const char *>(header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(&count), sizeof(count));
+        for (int i = 0; i < Dim; i++)
+        {
+            const int64_t dim = samples.empty() ? 0 : samples[0].dimension(i);
+            file.write(reinterpret_cast<const char *>(&dim), sizeof(dim));
+        }
+
+        for (const Eigen::Tensor<DT, Dim> &sample : samples)
+        {
+            if (sample.dimensions() != samples[0].dimensions())
+            {
+                throw std::runtime_error("All samples of a tensor dataset must have the same shape.");
+            }
+            file.write(reinterpret_cast<const char *>(sample.data()), sample.size() * sizeof(DT));
+        }
+        if (!file)
+        {
+            throw std::runtime_error("Failed writing " + path + ".");
+        }
+    }
+
+    /// @brief Read (and validate) the header of a tensor dataset file.
+    /// @param path Dataset file.
+    /// @return The header.
+    inline TensorDatasetHeader readTensorDatasetHeader(const std::string &path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        char magic[sizeof(TensorDatasetHeader::MAGIC)];
+        uint32_t header[4];
+        TensorDatasetHeader result;
+        if (!file.read(magic, sizeof(magic)) || std::memcmp(magic, TensorDatasetHeader::MAGIC, sizeof(magic)) != 0 ||
+            !file.read(reinterpret_cast<char *>(header), sizeof(header)) || header[0] != TensorDatasetHeader::VERSION ||
+            !file.read(reinterpret_cast<char *>(&result.count), sizeof(result.count)))
+        {
+            throw std::runtime_error(path + " is not a tensor dataset file.");
+        }
+        result.elementSize = header[1];
+        result.dims.resize(header[2]);
+        if (!file.read(reinterpret_cast<char *>(result.dims.data()), result.dims.size() * sizeof(int64_t)))
+        {
+            throw std::runtime_error(path + " is truncated.");
+        }
+        return result;
+    }
+
+    /// @brief Check that a dataset file holds samples of type `Eigen::Tensor<DT, Dim>`.
+    template <int Dim, typename DT>
+    void checkTensorDatasetHeader(const TensorDatasetHeader &header, const std::string &path)
+    {
+        if (header.elementSize != sizeof(DT) || header.dims.size() != (size_t)Dim)
+        {
+            throw std::runtime_error(path + " holds " + std::to_string(header.dims.size()) + "-D samples of " + std::to_string(header.elementSize) +
+                                     "-byte elements, expected " + std::to_string(Dim) + "-D samples of " + std::to_string(sizeof(DT)) + "-byte elements.");
+        }
+    }
+
+    /// @brief Allocate `count` (uninitialized) sample tensors of the dataset's shape.
+    template <int Dim, typename DT>
+    std::vector<std::shared_ptr<Eigen::Tensor<DT, Dim>>> allocateTensorDatasetSamples(const TensorDatasetHeader &header, size_t count)
+    {
+        Eigen::array<Eigen::Index, Dim> dimensions;
+        for (int i = 0; i < Dim; i++)
+            dimensions[i] = header.dims[i];
+        std::vector<std::shared_ptr<Eigen::Tensor<DT, Dim>>> samples(count);
+        for (std::shared_ptr<Eigen::Tensor<DT, Dim>> &sample : samples)
+            sample = std::make_shared<Eigen::Tensor<DT, Dim>>(dimensions);
+        return samples;
+    }
+
+    /// @brief Read the samples [begin, end) of a tensor dataset file (serial, without MPI).
+    /// @param path Dataset file.
+    /// @param begin First sample to read.
+    /// @param end One past the last sample to read (clamped to the number of samples).
+    /// @return The samples wrapped as (leaf) tensors.
+    template <int Dim, typename DT>
+    std::vector<std::shared_ptr<TensorBase<Dim, DT>>> readTensorDataset(const std::string &path, size_t begin = 0, size_t end = SIZE_MAX)
+    {
+        TensorDatasetHeader header = readTensorDatasetHeader(path);
+        checkTensorDatasetHeader<Dim, DT>(header, path);
+        end = std::min<size_t>(end, header.count);
+        begin = std::min(begin, end);
+
+        std::ifstream file(path, std::ios::binary);
+        const size_t sampleBytes = header.sampleElements() * sizeof(DT);
+        file.seekg(header.dataOffset() + begin * sampleBytes);
+
+        std::vector<std::shared_ptr<TensorBase<Dim, DT>>> outputs;
+        for (std::shared_ptr<Eigen::Tensor<DT, Dim>> &sample : allocateTensorDatasetSamples<Dim, DT>(header, end - begin))
+        {
+            if (!file.read(reinterpret_cast<char *>(sample->data()), sampleBytes))
+            {
+                throw std::runtime_error(path + " is truncated.");
+            }
+            outputs.push_back(std::make_shared<Tensor<Dim, DT>>(sample));
+        }
+        return outputs;
+    }
+
+    /// @brief A tensor dataset file mapped into memory: samples are viewed in place, batches are copied into reusable tensors, and a background thread prefetches upcoming samples.
+    /// @details Every file is one column of a dataset (e.g., inputs and targets in two files) with all samples back to back, so a range of samples is one contiguous block.
+    /// Opening costs the same for any file size; pages are read when first touched, or ahead of time by `prefetch()`.
+    template <int Dim, typename DT>
+    class MappedTensorDataset
+    {
+    private:
+        std::string path;
+        TensorDatasetHeader header;
+        std::unique_ptr<MappedFile> file;
+        Eigen::array<Eigen::Index, Dim> dimensions; ///< Shape of every sample.
+
+        std::thread prefetcher;                               ///< Background thread faulting in the pages of upcoming samples.
+        std::mutex mutex;                                     ///< Protects `queue` and `stopping`.
+        std::condition_variable wake;                         ///< Signals new work (or shutdown) to the prefetcher.
+        std::deque<std::pair<size_t, size_t>> queue;          ///< Sample ranges [begin, end) to prefetch.
+        bool stopping = false;                                ///< Whether the prefetcher should exit.
+
+        const DT *sampleData(size_t i) const
+        {
+            return reinterpret_cast<const DT *>(file->data() + header.dataOffset()) + i * header.sampleElements();
+        }
+
+        /// @brief Throw unless the samples [begin, end) exist.
+        void checkRange(size_t begin, size_t end) const
+        {
+            if (begin > end || end > header.count)
+            {
+                throw std::out_of_range("Samples [" + std::to_string(begin) + ", " + std::to_string(end) + ") out of range, " + path + " holds " + std::to_string(header.count) + ".");
+            }
+        }
+
+        void prefetchLoop()
+        {
+            const size_t page = ::sysconf(_SC_PAGESIZE);
+            const size_t sampleBytes = header.sampleElements() * sizeof(DT);
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true)
+            {
+                wake.wait(lock, [this]()
+                          { return stopping || !queue.empty(); });
+                if (stopping)
+                {
+                    return;
+                }
+                const std::pair<size_t, size_t> range = queue.front();
+                queue.pop_front();
+                lock.unlock();
+
+                // Start the readahead, then touch every page so the samples are resident when the training step gets to them.
+                const size_t offset = header.dataOffset() + range.first * sampleBytes;
+                const size_t bytes = (range.second - range.first) * sampleBytes;
+                file->willNeed(offset, bytes);
+                volatile unsigned char sink = 0;
+                for (size_t touched = offset / page * page; touched < offset + bytes; touched += page)
+                {
+                    sink = sink + file->data()[touched];
+                }
+                lock.lock();
+            }
+        }
+
+    public:
+        /// @brief Map the dataset file `path`, whose samples have to be of type `Eigen::Tensor<DT, Dim>`.
+        /// @param path Dataset file.
+        MappedTensorDataset(const std::string &path) : path(path), header(readTensorDatasetHeader(path))
+        {
+            checkTensorDatasetHeader<Dim, DT>(header, path);
+            file = std::make_unique<MappedFile>(path);
+            if (file->size() < header.dataOffset() + header.count * header.sampleElements() * sizeof(DT))
+            {
+                throw std::runtime_error(path + " is truncated.");
+            }
+            for (int i = 0; i < Dim; i++)
+                dimensions[i] = header.dims[i];
+        }
+
+        MappedTensorDataset(const MappedTensorDataset &) = delete;
+        MappedTensorDataset &operator=(const MappedTensorDataset &) = delete;
+
+        ~MappedTensorDataset()
+        {
+            if (prefetcher.joinable())
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    stopping = true;
+                }
+                wake.notify_one();
+                prefetcher.join();
+            }
+        }
+
+        /// @brief Number of samples.
+        size_t size() const
+        {
+            return header.count;
+        }
+
+        /// @brief View sample `i` in place (valid as long as this object lives).
+        Eigen::TensorMap<const Eigen::Tensor<DT, Dim>> sample(size_t i) const
+        {
+            checkRange(i, i + 1);
+            return Eigen::TensorMap<const Eigen::Tensor<DT, Dim>>(sampleData(i), dimensions);
+        }
+
+        /// @brief View the samples [begin, end) in place as one tensor with the sample index as the last dimension.
+        Eigen::TensorMap<const Eigen::Tensor<DT, Dim + 1>> batch(size_t begin, size_t end) const
+        {
+            checkRange(begin, end);
+            Eigen::array<Eigen::Index, Dim + 1> batchDimensions;
+            for (int i = 0; i < Dim; i++)
+                batchDimensions[i] = dimensions[i];
+            batchDimensions[Dim] = end - begin;
+            return Eigen::TensorMap<const Eigen::Tensor<DT, Dim + 1>>(sampleData(begin), batchDimensions);
+        }
+
+        /// @brief Copy the samples `indices[0]`, `indices[1]`, ... into `outputs`, reusing its tensors if it already holds enough of them (so steady-state batches allocate nothing).
+        /// @param indices Samples to load.
+        /// @param outputs Batch of (leaf) tensors, grown and resized to `indices.size()` as needed.
+        void load(const std::vector<size_t> &indices, std::vector<std::shared_ptr<TensorBase<Dim, DT>>> &outputs) const
+        {
+            for (size_t index : indices)
+            {
+                checkRange(index, index + 1);
+            }
+            for (size_t i = outputs.size(); i < indices.size(); i++)
+            {
+                outputs.push_back(std::make_shared<Tensor<Dim, DT>>(std::make_shared<Eigen::Tensor<DT, Dim>>(dimensions)));
+            }
+            outputs.resize(indices.size());
+            for (size_t i = 0; i < indices.size(); i++)
+            {
+                std::copy(sampleData(indices[i]), sampleData(indices[i]) + header.sampleElements(), outputs[i]->getData()->data());
+            }
+        }
+
+        /// @brief Copy the samples [begin, end) into `outputs` (see `load(const std::vector<size_t> &, ...)`).
+        void load(size_t begin, size_t end, std::vector<std::shared_ptr<TensorBase<Dim, DT>>> &outputs) const
+        {
+            std::vector<size_t> indices(end - begin);
+            for (size_t i = 0; i < indices.size(); i++)
+                indices[i] = begin + i;
+            load(indices, outputs);
+        }
+
+        /// @brief Ask the background thread to bring the samples [begin, end) into memory (returns immediately), e.g., for the batch after the one being computed.
+        void prefetch(size_t begin, size_t end)
+        {
+            end = std::min<size_t>(end, header.count);
+            if (begin >= end)
+            {
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!prefetcher.joinable())
+                {
+                    prefetcher = std::thread(&MappedTensorDataset::prefetchLoop, this);
+                }
+                queue.emplace_back(begin, end);
+            }
+            wake.notify_one();
+        }
+
+        /// @brief Prefetch the (possibly scattered) samples `indices` (see `prefetch(size_t, size_t)`), merging consecutive ones into ranges.
+        void prefetch(const std::vector<size_t> &indices)
+        {
+            for (size_t i = 0; i < indices.size();)
+            {
+                size_t j = i + 1;
+                while (j < indices.size() && indices[j] == indices[j - 1] + 1)
+                    j++;
+                prefetch(indices[i], indices[j - 1] + 1);
+                i = j;
+            }
+        }
+    };
+
+} // namespace PPGrad
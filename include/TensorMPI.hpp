@@ -5,15 +5,74 @@
 
 #pragma once
 #include "Tensor/TensorBase.hpp"
+#include "Tensor/Tensor.hpp"
 #include "NN/Model.hpp"
+#include "TensorDataset.hpp"
+#include "Checksum.hpp"
 #include <unsupported/Eigen/CXX11/Tensor>
 #include <memory>
 #include <vector>
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
 #include <mpi.h>
 
 namespace PPGrad
 {
 
+    /// @brief Map the scalar type of the tensors to the matching MPI datatype.
+    /// @tparam DT Data type of the tensor elements.
+    /// @return MPI datatype describing a single element of type `DT`.
+    template <typename DT>
+    MPI_Datatype mpiDatatype();
+
+    template <>
+    inline MPI_Datatype mpiDatatype<double>()
+    {
+        return MPI_DOUBLE;
+    }
+
+    template <>
+    inline MPI_Datatype mpiDatatype<float>()
+    {
+        return MPI_FLOAT;
+    }
+
+    /// @brief Create an MPI datatype covering the storage of all given tensors (absolute addresses, i.e., to be used with `MPI_BOTTOM`), so a single MPI call can land the data of many tensors in place.
+    /// @details Optionally only elements `[begin, end)` of the tensors' concatenation are covered, e.g., one rank's slice of a flattened model.
+    /// @tparam Dim Dimension of the tensors.
+    /// @tparam DT Data type of the tensors.
+    /// @param tensors Tensors whose storage the type describes (must outlive the type's use).
+    /// @param begin First element of the concatenation to cover.
+    /// @param end One past the last element of the concatenation to cover (clamped to its size).
+    /// @return Committed datatype, to be freed with `MPI_Type_free`.
+    template <int Dim, typename DT>
+    MPI_Datatype createTensorsType(const std::vector<std::shared_ptr<Eigen::Tensor<DT, Dim>>> &tensors, size_t begin = 0, size_t end = SIZE_MAX)
+    {
+        std::vector<int> blockLengths;
+        std::vector<MPI_Aint> addresses;
+        size_t offset = 0;
+        for (const std::shared_ptr<Eigen::Tensor<DT, Dim>> &tensor : tensors)
+        {
+            const size_t first = std::max(begin, offset);
+            const size_t last = std::min(end, offset + (size_t)tensor->size());
+            if (first < last)
+            {
+                blockLengths.push_back(last - first);
+                addresses.emplace_back();
+                MPI_Get_address(tensor->data() + (first - offset), &addresses.back());
+            }
+            offset += tensor->size();
+        }
+        MPI_Datatype type;
+        MPI_Type_create_hindexed(blockLengths.size(), blockLengths.data(), addresses.data(), mpiDatatype<DT>(), &type);
+        MPI_Type_commit(&type);
+        return type;
+    }
+
     /// @brief Create an Eigen::TensorMap object from a raw pointer to data with shape of `dims` and index sequence `Is`.
     /// @tparam DT Data type of the tensor.
     /// @tparam Dim Number of tensor dimensions.
@@ -45,7 +104,7 @@ namespace PPGrad
     }
 
     /// @brief Scatter a vector of Eigen::Tensor objects across MPI processes.
-    /// @details Root (rank 0) process will flatten the data and scatter it across all processes, ignoring the remainder if the data is not evenly divisible.
+    /// @details Root (rank 0) process will flatten the data and scatter it across all processes, ignoring the remainder (whole tensors) if the data is not evenly divisible. See `tensorScatterv` for a remainder-safe version.
     /// @tparam DT Data type of the tensors.
     /// @tparam Dim Dimension of the tensors.
     /// @param inputs Vector of Eigen::Tensor objects to scatter.
@@ -74,13 +133,13 @@ namespace PPGrad
         int sendCount;
         if (worldRank == 0)
         {
-            // Calculate the number of elements to send to each process
-            sendCount = flat_data.size() / worldSize;
+            // Calculate the number of elements to send to each process (whole tensors only)
+            sendCount = (inputs.size() / worldSize) * (inputs.empty() ? 0 : inputs[0].size());
         }
         MPI_Bcast(&sendCount, 1, MPI_INT, 0, MPI_COMM_WORLD);
 
         // Issue a graceful warning if the data is not evenly divisible amongst the processes
-        if (flat_data.size() % worldSize != 0)
+        if (worldRank == 0 && inputs.size() % worldSize != 0)
         {
             std::cerr << "Warning: Data is not evenly divisible amongst processes." << std::endl;
 
@@ -137,47 +196,267 @@ namespace PPGrad
         return outputs;
     }
 
+    /// @brief Scatter a vector of Eigen::Tensor objects (of possibly different shapes) across MPI processes, balancing uneven counts.
+    /// @details Rank `r` receives `n / worldSize` tensors, plus one if `r < n % worldSize`, so nothing is dropped (a trainer must then tolerate shards that differ by one sample).
+    /// Shapes travel with the data. Every output tensor is allocated at its final shape and a single `MPI_Scatterv` receives straight into the storage of all of them, so apart from root's flattening nothing is copied.
+    /// @tparam DT Data type of the tensors.
+    /// @tparam Dim Dimension of the tensors.
+    /// @param inputs Vector of Eigen::Tensor objects to scatter (only read on root).
+    /// @param worldSize Number of MPI processes in `comm`.
+    /// @param worldRank Rank of the calling MPI process in `comm`.
+    /// @param comm Communicator to scatter over (root is rank 0).
+    /// @return Vector of shared pointers to TensorBase objects containing this rank's tensors, in their original order.
+    template <int Dim, typename DT>
+    std::vector<std::shared_ptr<TensorBase<Dim, DT>>> tensorScatterv(
+        const std::vector<Eigen::Tensor<DT, Dim>> &inputs,
+        const int worldSize,
+        const int worldRank,
+        MPI_Comm comm = MPI_COMM_WORLD)
+    {
+        // Root: balanced tensor counts, shapes and flat data of every rank
+        std::vector<int> tensorCounts(worldSize), shapeCounts(worldSize), shapeDispls(worldSize), dataCounts(worldSize), dataDispls(worldSize);
+        std::vector<int> shapes;
+        std::vector<DT> flatData;
+        if (worldRank == 0)
+        {
+            size_t tensor = 0;
+            for (int r = 0; r < worldSize; r++)
+            {
+                tensorCounts[r] = inputs.size() / worldSize + ((size_t)r < inputs.size() % worldSize ? 1 : 0);
+                shapeCounts[r] = tensorCounts[r] * Dim;
+                shapeDispls[r] = shapes.size();
+                dataDispls[r] = flatData.size();
+                for (int i = 0; i < tensorCounts[r]; i++, tensor++)
+                {
+                    for (int d = 0; d < Dim; d++)
+                        shapes.push_back(inputs[tensor].dimension(d));
+                    flatData.insert(flatData.end(), inputs[tensor].data(), inputs[tensor].data() + inputs[tensor].size());
+                }
+                dataCounts[r] = flatData.size() - dataDispls[r];
+            }
+        }
+
+        int localCount;
+        MPI_Scatter(tensorCounts.data(), 1, MPI_INT, &localCount, 1, MPI_INT, 0, comm);
+        std::vector<int> localShapes(localCount * Dim);
+        MPI_Scatterv(shapes.data(), shapeCounts.data(), shapeDispls.data(), MPI_INT, localShapes.data(), localShapes.size(), MPI_INT, 0, comm);
+
+        // Allocate the outputs at their final shapes and receive into them directly
+        std::vector<std::shared_ptr<Eigen::Tensor<DT, Dim>>> tensors(localCount);
+        for (int i = 0; i < localCount; i++)
+        {
+            Eigen::array<Eigen::Index, Dim> dimensions;
+            for (int d = 0; d < Dim; d++)
+                dimensions[d] = localShapes[i * Dim + d];
+            tensors[i] = std::make_shared<Eigen::Tensor<DT, Dim>>(dimensions);
+        }
+        MPI_Datatype recvType = createTensorsType<Dim, DT>(tensors);
+        MPI_Scatterv(flatData.data(), dataCounts.data(), dataDispls.data(), mpiDatatype<DT>(), MPI_BOTTOM, localCount > 0 ? 1 : 0, recvType, 0, comm);
+        MPI_Type_free(&recvType);
+
+        std::vector<std::shared_ptr<TensorBase<Dim, DT>>> outputs;
+        for (std::shared_ptr<Eigen::Tensor<DT, Dim>> &tensor : tensors)
+        {
+            outputs.push_back(std::make_shared<Tensor<Dim, DT>>(tensor));
+        }
+        return outputs;
+    }
+
+    /// @brief How the samples of a dataset file are split between the ranks.
+    enum class ShardModes
+    {
+        CONTIGUOUS, ///< Rank `r` reads the `r`-th contiguous block of samples.
+        STRIDED     ///< Rank `r` reads samples `r, r + worldSize, r + 2 * worldSize, ...`.
+    };
+
+    /// @brief Read this rank's shard of a tensor dataset file (see `writeTensorDataset`) with collective MPI-IO, i.e., without any rank holding the whole dataset.
+    /// @details All ranks of `comm` must call this. Like `tensorScatterv`, rank `r` gets `count / worldSize` samples, plus one if `r < count % worldSize`, so nothing is dropped
+    /// (`DPTrainer` runs the same number of batches on shards that differ by one sample).
+    /// The samples are read straight into their tensors through an `MPI_Type_create_hindexed` memory type. `tensorScatter` remains as fallback for data that only exists in root's memory.
+    /// @tparam Dim Dimension of the samples.
+    /// @tparam DT Data type of the samples.
+    /// @param path Dataset file (on a file system all ranks can access).
+    /// @param worldSize Number of MPI processes in `comm`.
+    /// @param worldRank Rank of the calling MPI process in `comm`.
+    /// @param mode Contiguous blocks or round-robin samples.
+    /// @param comm Communicator of the readers.
+    /// @return Vector of shared pointers to TensorBase objects containing this rank's samples.
+    template <int Dim, typename DT>
+    std::vector<std::shared_ptr<TensorBase<Dim, DT>>> readTensorShard(
+        const std::string &path,
+        const int worldSize,
+        const int worldRank,
+        ShardModes mode = ShardModes::CONTIGUOUS,
+        MPI_Comm comm = MPI_COMM_WORLD)
+    {
+        TensorDatasetHeader header = readTensorDatasetHeader(path);
+        checkTensorDatasetHeader<Dim, DT>(header, path);
+
+        const size_t remainder = header.count % worldSize;
+        const size_t shardCount = header.count / worldSize + ((size_t)worldRank < remainder ? 1 : 0);
+        const int sampleElements = header.sampleElements();
+
+        std::vector<std::shared_ptr<Eigen::Tensor<DT, Dim>>> samples = allocateTensorDatasetSamples<Dim, DT>(header, shardCount);
+
+        MPI_File file;
+        if (MPI_File_open(comm, path.c_str(), MPI_MODE_RDONLY, MPI_INFO_NULL, &file) != MPI_SUCCESS)
+        {
+            throw std::runtime_error("Cannot open " + path + " with MPI-IO.");
+        }
+        // All ranks see the same size, so they all fail here together.
+        MPI_Offset fileSize;
+        if (MPI_File_get_size(file, &fileSize) != MPI_SUCCESS || (size_t)fileSize < header.dataOffset() + header.count * sampleElements * sizeof(DT))
+        {
+            MPI_File_close(&file);
+            throw std::runtime_error(path + " is truncated.");
+        }
+
+        // File view: this rank's samples only.
+        MPI_Datatype fileType;
+        MPI_Offset displacement;
+        if (mode == ShardModes::CONTIGUOUS)
+        {
+            MPI_Type_contiguous(sampleElements, mpiDatatype<DT>(), &fileType);
+            const size_t first = (size_t)worldRank * (header.count / worldSize) + std::min((size_t)worldRank, remainder);
+            displacement = header.dataOffset() + (MPI_Offset)first * sampleElements * sizeof(DT);
+        }
+        else
+        {
+            MPI_Type_vector(shardCount, sampleElements, sampleElements * worldSize, mpiDatatype<DT>(), &fileType);
+            displacement = header.dataOffset() + (MPI_Offset)worldRank * sampleElements * sizeof(DT);
+        }
+        MPI_Type_commit(&fileType);
+        MPI_File_set_view(file, displacement, mpiDatatype<DT>(), fileType, "native", MPI_INFO_NULL);
+
+        // Memory type: the storage of every sample tensor, so the data lands in place.
+        MPI_Datatype memoryType = createTensorsType<Dim, DT>(samples);
+
+        MPI_Status status;
+        const int result = MPI_File_read_all(file, MPI_BOTTOM, shardCount > 0 ? 1 : 0, memoryType, &status);
+        MPI_Count elementsRead = 0;
+        if (result == MPI_SUCCESS)
+        {
+            MPI_Get_elements_x(&status, mpiDatatype<DT>(), &elementsRead);
+        }
+
+        MPI_Type_free(&memoryType);
+        MPI_Type_free(&fileType);
+        MPI_File_close(&file);
+        if (result != MPI_SUCCESS || (size_t)elementsRead != shardCount * sampleElements)
+        {
+            throw std::runtime_error("Failed reading " + std::to_string(shardCount * sampleElements) + " elements of " + path + " with MPI-IO (read " + std::to_string(elementsRead) + ").");
+        }
+
+        std::vector<std::shared_ptr<TensorBase<Dim, DT>>> outputs;
+        for (std::shared_ptr<Eigen::Tensor<DT, Dim>> &sample : samples)
+        {
+            outputs.push_back(std::make_shared<Tensor<Dim, DT>>(sample));
+        }
+        return outputs;
+    }
+
     /// @brief Broadcast all underlying parameters of `PPNN::Model` object to all MPI processes.
     /// @details All callers should have the same model ready, with different parameters only!
+    /// Root packs every parameter into one flat buffer, which is broadcast in chunks of `chunkBytes` with one `MPI_Ibcast` each, so the receivers unpack (and checksum) a chunk while the following ones are still in flight.
+    /// The parameter shapes are compared across ranks beforehand and a checksum of the whole buffer is verified on every receiver afterwards, a mismatch of either aborts.
     /// @tparam DT Data type of the model parameters.
     /// @tparam Dim Dimension of the model parameters.
     /// @param model Pointer to the model to broadcast.
     /// @param worldSize Number of MPI processes in the comm world.
     /// @param worldRank Rank of the calling MPI process.
+    /// @param verbose Report the size and time of the broadcast on root.
+    /// @param chunkBytes Size of the pipelined chunks.
     /// @return Pointer to the model with parameters broadcasted to all MPI processes (i.e., same for all calling processes)
     template <int Dim, typename DT>
     std::shared_ptr<PPNN::Model<Dim, DT>> modelBroadcast(
         std::shared_ptr<PPNN::Model<Dim, DT>> model,
         const int worldSize,
-        const int worldRank)
+        const int worldRank,
+        bool verbose = false,
+        size_t chunkBytes = 4 * 1024 * 1024)
     {
-        // Make sure all nodes have the same number of parameters
-        int paramCount = model->getParams().size();
-        MPI_Allreduce(MPI_IN_PLACE, &paramCount, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
-        paramCount /= worldSize;
+        const double begin = MPI_Wtime();
+        std::vector<std::shared_ptr<TensorBase<Dim, DT>>> &params = model->getParams();
 
-        if (paramCount != model->getParams().size())
+        // Make sure all nodes have the same parameter shapes, in the same order: min == max of a hash of the shape list (max of ~hash is ~min)
+        long long totalElements = 0;
+        std::vector<long long> shapes = {(long long)params.size()};
+        for (std::shared_ptr<TensorBase<Dim, DT>> &param : params)
         {
-            std::cerr << "Error: All nodes must have the same number of parameters in the model before broadcasting." << std::endl;
+            totalElements += param->getData()->size();
+            for (int d = 0; d < Dim; d++)
+                shapes.push_back(param->getData()->dimension(d));
+        }
+        const uint64_t shapeHash = checksum64(shapes.data(), shapes.size() * sizeof(long long));
+        uint64_t layout[2] = {shapeHash, ~shapeHash};
+        MPI_Allreduce(MPI_IN_PLACE, layout, 2, MPI_UINT64_T, MPI_MAX, MPI_COMM_WORLD);
+        if (layout[0] != ~layout[1])
+        {
+            std::cerr << "Error: All nodes must have the same parameter shapes in the model before broadcasting." << std::endl;
             MPI_Abort(MPI_COMM_WORLD, 1);
         }
 
-        // Broadcast the parameters
-        for (size_t i = 0; i < paramCount; i++)
+        // Pack on root
+        std::vector<DT> flat(totalElements);
+        if (worldRank == 0)
         {
-            // Get the data from the model
-            std::vector<int> tensorDims;
-            for (int dim : model->getParams()[i]->getData()->dimensions())
-                tensorDims.push_back(dim);
+            size_t offset = 0;
+            for (std::shared_ptr<TensorBase<Dim, DT>> &param : params)
+            {
+                std::copy(param->getData()->data(), param->getData()->data() + param->getData()->size(), flat.data() + offset);
+                offset += param->getData()->size();
+            }
+        }
 
-            Eigen::TensorMap<Eigen::Tensor<DT, Dim>> tensorMap = createTensorMap<Dim, DT>(model->getParams()[i]->getData()->data(), tensorDims);
-            Eigen::Tensor<DT, Dim> tensor = tensorMap;
+        // Broadcast all chunks at once, they are pipelined through the broadcast tree
+        const size_t chunkElements = std::max<size_t>(1, chunkBytes / sizeof(DT));
+        const size_t chunks = (flat.size() + chunkElements - 1) / chunkElements;
+        std::vector<MPI_Request> requests(chunks);
+        for (size_t c = 0; c < chunks; c++)
+        {
+            const size_t first = c * chunkElements;
+            MPI_Ibcast(flat.data() + first, std::min(chunkElements, flat.size() - first), mpiDatatype<DT>(), 0, MPI_COMM_WORLD, &requests[c]);
+        }
+
+        // Checksum (and on receivers unpack) every chunk as soon as it is there
+        uint64_t checksum = checksum64(nullptr, 0);
+        size_t param = 0;
+        size_t paramOffset = 0;
+        for (size_t c = 0; c < chunks; c++)
+        {
+            MPI_Wait(&requests[c], MPI_STATUS_IGNORE);
+            const size_t first = c * chunkElements;
+            const size_t last = std::min(first + chunkElements, flat.size());
+            checksum = checksum64(flat.data() + first, (last - first) * sizeof(DT), checksum);
 
-            // Broadcast the data
-            MPI_Bcast(tensor.data(), tensor.size(), MPI_DOUBLE, 0, MPI_COMM_WORLD);
+            for (size_t i = first; worldRank != 0 && i < last;)
+            {
+                DT *dst = params[param]->getData()->data();
+                const size_t count = std::min<size_t>(last - i, params[param]->getData()->size() - paramOffset);
+                std::copy(flat.data() + i, flat.data() + i + count, dst + paramOffset);
+                i += count;
+                paramOffset += count;
+                if (paramOffset == (size_t)params[param]->getData()->size())
+                {
+                    param++;
+                    paramOffset = 0;
+                }
+            }
+        }
 
-            // Set the data in the model
-            *model->getParams()[i]->getData() = tensor;
+        uint64_t rootChecksum = checksum;
+        MPI_Bcast(&rootChecksum, 1, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+        if (rootChecksum != checksum)
+        {
+            std::cerr << "Error: [Rank: " << worldRank << "] Model broadcast checksum mismatch." << std::endl;
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+
+        if (verbose && worldRank == 0)
+        {
+            const double elapsed = MPI_Wtime() - begin;
+            std::cout << "Broadcast " << params.size() << " parameters (" << flat.size() * sizeof(DT) / 1024.0 / 1024.0 << " MiB, " << chunks << " chunks) to "
+                      << worldSize - 1 << " ranks in " << elapsed * 1e3 << " ms (checksum " << std::hex << checksum << std::dec << ")." << std::endl;
         }
 
         return model;
@@ -238,10 +238,23 @@ namespace PPGrad
     template <int Dim, typename DT>
     void Tensor<Dim, DT>::addGrad(std::shared_ptr<Eigen::Tensor<DT, Dim>> grad)
     {
+        // Thread-private accumulation (no lock, no hooks).
+        if (GradSink<Dim, DT> *sink = this->threadGradSink)
+        {
+            typename std::unordered_map<const TensorBase<Dim, DT> *, Eigen::Tensor<DT, Dim> *>::iterator it = sink->grads.find(this);
+            *(it != sink->grads.end() ? it->second : this->gradient.get()) += *grad;
+            return;
+        }
+
 #pragma omp critical
         {
             *this->gradient += *grad;
         }
+
+        if (this->gradHook)
+        {
+            this->gradHook();
+        }
     }
 
     // Explicit template instantiations
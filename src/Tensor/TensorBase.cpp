@@ -11,22 +11,102 @@
 #include "Tensor/MultSTensor.hpp"
 #include "Tensor/DivSTensor.hpp"
 #include "TopologicalSort.hpp"
+#include <algorithm>
+#include <atomic>
 #include <memory>
 #include <stack>
+#include <unordered_map>
+#include <vector>
+#include <omp.h>
 
 namespace PPGrad
 {
 
+    /// @brief Run `nodes[i]->_backward()`, then every parent whose consumers are all done, spawning all but the last ready parent as tasks (the last one continues inline).
+    template <int Dim, typename DT>
+    static void runBackwardNode(size_t i,
+                                const std::vector<std::shared_ptr<TensorBase<Dim, DT>>> &nodes,
+                                const std::vector<std::vector<size_t>> &parents,
+                                std::atomic<int32_t> *pending)
+    {
+        while (true)
+        {
+            nodes[i]->_backward();
+            size_t next = nodes.size();
+            for (size_t parent : parents[i])
+            {
+                if (pending[parent].fetch_sub(1) != 1)
+                {
+                    continue;
+                }
+                if (next != nodes.size())
+                {
+#pragma omp task default(shared) firstprivate(next)
+                    runBackwardNode<Dim, DT>(next, nodes, parents, pending);
+                }
+                next = parent;
+            }
+            if (next == nodes.size())
+            {
+                return;
+            }
+            i = next;
+        }
+    }
+
     /// @brief Calculate the gradient of this tensor with respect to it's inputs.
     template <int Dim, typename DT>
     void TensorBase<Dim, DT>::backward(std::shared_ptr<PPGrad::TensorBase<Dim, DT>> root)
     {
         std::stack<std::shared_ptr<PPGrad::TensorBase<Dim, DT>>> sortedNodes = topologicalSort<Dim, DT>(root);
+        // omp_get_level() also counts inactive regions (e.g., `parallel if(false)`), in which omp_in_parallel() is false.
+        bool sequential = sortedNodes.size() < parallelBackwardMinNodes || threadGradSink != nullptr || omp_get_level() > 0 || omp_get_max_threads() == 1;
+        std::vector<std::shared_ptr<TensorBase<Dim, DT>>> nodes;
+        nodes.reserve(sortedNodes.size());
         while (!sortedNodes.empty())
         {
-            sortedNodes.top()->_backward();
+            nodes.push_back(sortedNodes.top());
             sortedNodes.pop();
+            sequential = sequential || nodes.back()->isCollective();
+        }
+        if (sequential)
+        {
+            for (std::shared_ptr<TensorBase<Dim, DT>> &node : nodes)
+            {
+                node->_backward();
+            }
+            return;
         }
+
+        // Dependency counts: a node is ready once every (distinct) node consuming it ran its _backward().
+        std::unordered_map<const TensorBase<Dim, DT> *, size_t> index;
+        for (size_t i = 0; i < nodes.size(); i++)
+        {
+            index[nodes[i].get()] = i;
+        }
+        std::vector<std::vector<size_t>> parents(nodes.size());
+        std::unique_ptr<std::atomic<int32_t>[]> pending = std::make_unique<std::atomic<int32_t>[]>(nodes.size());
+        for (size_t i = 0; i < nodes.size(); i++)
+        {
+            pending[i].store(0);
+        }
+        for (size_t i = 0; i < nodes.size(); i++)
+        {
+            for (std::shared_ptr<TensorBase<Dim, DT>> &parent : nodes[i]->getParents())
+            {
+                const size_t p = index.at(parent.get());
+                if (std::find(parents[i].begin(), parents[i].end(), p) == parents[i].end())
+                {
+                    parents[i].push_back(p);
+                    pending[p]++;
+                }
+            }
+        }
+
+        // The root (first in topological order) has no consumers, the tasks it spawns are finished at the end of the parallel region.
+#pragma omp parallel default(shared)
+#pragma omp single
+        runBackwardNode<Dim, DT>(0, nodes, parents, pending.get());
     }
 
     template <int Dim, typename DT>
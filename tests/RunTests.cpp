@@ -14,6 +14,23 @@
 #include "Tensor/DivSTensor.hpp"
 
 #include "NumericalGradientTests.hpp"
+#include "HalfPrecision.hpp"
+#include "TensorDataset.hpp"
+#include "NN/Dense.hpp"
+#include "NN/Trainer.hpp"
+#include "NN/Checkpoint.hpp"
+#include "NN/DistributedSampler.hpp"
+#ifdef USE_MPI
+#include "NN/GradSynchronizer.hpp"
+#include "NN/TensorParallel.hpp"
+#include "TensorMPI.hpp"
+#endif
+
+#include <filesystem>
+#include <algorithm>
+#include <functional>
+#include <atomic>
+#include <omp.h>
 
 // -------- AddTensor Tests --------
 
@@ -665,4 +682,765 @@ TEST(ActivationsTests, ReLUActivation)
             }
         }
     }
-}
\ No newline at end of file
+}
+
+// -------- Parallel Backward Tests --------
+
+// The task-based backward() of a wide graph (with a leaf shared by all branches) yields the gradients of the sequential one.
+TEST(ParallelBackwardTest, MatchesSequentialBackward)
+{
+    std::shared_ptr<PPGrad::TensorBase<2, double>> w = PPGrad::Tensor<2, double>::zeros({2, 2}, true);
+    std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> leaves;
+    w->getData()->setRandom();
+    for (int i = 0; i < 100; i++)
+    {
+        leaves.push_back(PPGrad::Tensor<2, double>::zeros({2, 2}, true));
+        leaves.back()->getData()->setRandom();
+    }
+
+    // sum_i (w * a_i) * a_i: 401 nodes, the branches are independent apart from w.
+    std::function<void()> differentiate = [&]()
+    {
+        std::shared_ptr<PPGrad::TensorBase<2, double>> root = (w * leaves[0]) * leaves[0];
+        for (size_t i = 1; i < leaves.size(); i++)
+        {
+            root = root + (w * leaves[i]) * leaves[i];
+        }
+        root->getGrad()->setConstant(1.0);
+        PPGrad::TensorBase<2, double>::backward(root);
+    };
+
+    PPGrad::TensorBase<2, double>::setParallelBackward(SIZE_MAX);
+    differentiate();
+    std::vector<Eigen::Tensor<double, 2>> expected = {*w->getGrad()};
+    for (std::shared_ptr<PPGrad::TensorBase<2, double>> &leaf : leaves)
+    {
+        expected.push_back(*leaf->getGrad());
+        leaf->zeroGrad();
+    }
+    w->zeroGrad();
+
+    const int threads = omp_get_max_threads();
+    omp_set_num_threads(4);
+    PPGrad::TensorBase<2, double>::setParallelBackward(1);
+    differentiate();
+    omp_set_num_threads(threads);
+    PPGrad::TensorBase<2, double>::setParallelBackward(256);
+
+    for (int j = 0; j < 2; j++)
+    {
+        for (int k = 0; k < 2; k++)
+        {
+            EXPECT_NEAR((*w->getGrad())(j, k), expected[0](j, k), 1e-10);
+            for (size_t i = 0; i < leaves.size(); i++)
+            {
+                EXPECT_NEAR((*leaves[i]->getGrad())(j, k), expected[i + 1](j, k), 1e-12);
+            }
+        }
+    }
+}
+
+// Identity node recording whether its _backward() ran in an active parallel region (i.e., as a task), optionally posing as a collective.
+class ParallelProbeTensor : public PPGrad::Tensor<2, double>
+{
+private:
+    std::shared_ptr<PPGrad::TensorBase<2, double>> input;
+    bool collective;
+
+public:
+    static inline std::atomic<bool> ranInParallel{false};
+
+    ParallelProbeTensor(std::shared_ptr<PPGrad::TensorBase<2, double>> input, bool collective) : input(input), collective(collective)
+    {
+        this->data = input->getData();
+        this->gradient = std::make_shared<Eigen::Tensor<double, 2>>(this->data->dimensions());
+        this->gradient->setZero();
+        this->requiresGrad = true;
+    }
+
+    void _backward() override
+    {
+        if (omp_in_parallel())
+        {
+            ranInParallel = true;
+        }
+        input->addGrad(std::make_shared<Eigen::Tensor<double, 2>>(*this->gradient));
+    }
+
+    std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> getParents() override
+    {
+        return {input};
+    }
+
+    bool isCollective() const override
+    {
+        return collective;
+    }
+};
+
+// backward() runs sequentially on the calling thread from within an inactive (`if(false)`) parallel region and on graphs with a collective node.
+TEST(ParallelBackwardTest, SequentialInInactiveRegionsAndForCollectives)
+{
+    std::shared_ptr<PPGrad::TensorBase<2, double>> w = PPGrad::Tensor<2, double>::zeros({2, 2}, true);
+    std::function<void(bool)> differentiate = [&](bool collective)
+    {
+        std::shared_ptr<PPGrad::TensorBase<2, double>> root = std::make_shared<ParallelProbeTensor>(w * w, collective);
+        for (int i = 1; i < 50; i++)
+        {
+            std::shared_ptr<PPGrad::TensorBase<2, double>> probe = std::make_shared<ParallelProbeTensor>(w * w, false);
+            root = root + probe;
+        }
+        root->getGrad()->setConstant(1.0);
+        ParallelProbeTensor::ranInParallel = false;
+        PPGrad::TensorBase<2, double>::backward(root);
+    };
+
+    const int threads = omp_get_max_threads();
+    omp_set_num_threads(4);
+    PPGrad::TensorBase<2, double>::setParallelBackward(1);
+
+    differentiate(false);
+    EXPECT_TRUE(ParallelProbeTensor::ranInParallel.load());
+#pragma omp parallel if (false)
+    differentiate(false);
+    EXPECT_FALSE(ParallelProbeTensor::ranInParallel.load());
+    differentiate(true);
+    EXPECT_FALSE(ParallelProbeTensor::ranInParallel.load());
+
+    omp_set_num_threads(threads);
+    PPGrad::TensorBase<2, double>::setParallelBackward(256);
+}
+
+// -------- Half Precision Tests --------
+
+// Values representable in 16 bits survive the round trip exactly.
+TEST(HalfPrecisionTest, ExactRoundTrip)
+{
+    const float values[] = {0.0f, -0.0f, 1.0f, -2.5f, 0.15625f, 1024.0f, 65504.0f, 6.103515625e-05f, 5.9604644775390625e-08f};
+    for (float value : values)
+    {
+        EXPECT_EQ(PPGrad::fp16ToFloat(PPGrad::floatToFP16(value)), value);
+    }
+    const float bfValues[] = {0.0f, 1.0f, -2.5f, 0.15625f, 1024.0f, 65536.0f};
+    for (float value : bfValues)
+    {
+        EXPECT_EQ(PPGrad::bf16ToFloat(PPGrad::floatToBF16(value)), value);
+    }
+}
+
+// Conversions round to nearest, ties to even.
+TEST(HalfPrecisionTest, RoundToNearestEven)
+{
+    // 1 + 2^-11 is exactly between 1 and the next half (1 + 2^-10): ties to 1
+    EXPECT_EQ(PPGrad::floatToFP16(1.0f + 0.00048828125f), 0x3C00);
+    // 1 + 3 * 2^-11 is between 1 + 2^-10 and 1 + 2^-9: ties to the even 1 + 2^-9
+    EXPECT_EQ(PPGrad::floatToFP16(1.0f + 3 * 0.00048828125f), 0x3C02);
+    EXPECT_NEAR(PPGrad::fp16ToFloat(PPGrad::floatToFP16(0.1f)), 0.1f, 1e-4);
+    // bf16 keeps 8 mantissa bits: 1 + 2^-8 ties to 1, 1 + 3 * 2^-8 ties to 1 + 2^-6
+    EXPECT_EQ(PPGrad::floatToBF16(1.0f + 0.00390625f), 0x3F80);
+    EXPECT_EQ(PPGrad::floatToBF16(1.0f + 3 * 0.00390625f), 0x3F82);
+    EXPECT_NEAR(PPGrad::bf16ToFloat(PPGrad::floatToBF16(0.1f)), 0.1f, 1e-3);
+}
+
+// Out of range values saturate to infinity or flush to (signed) zero, NaN stays NaN.
+TEST(HalfPrecisionTest, SpecialValues)
+{
+    EXPECT_EQ(PPGrad::floatToFP16(65520.0f), 0x7C00);
+    EXPECT_EQ(PPGrad::floatToFP16(-1.0e6f), 0xFC00);
+    EXPECT_EQ(PPGrad::floatToFP16(1.0e-10f), 0x0000);
+    EXPECT_EQ(PPGrad::floatToFP16(-1.0e-10f), 0x8000);
+    EXPECT_TRUE(std::isinf(PPGrad::fp16ToFloat(0x7C00)));
+    EXPECT_TRUE(std::isnan(PPGrad::fp16ToFloat(PPGrad::floatToFP16(std::nanf("")))));
+    EXPECT_TRUE(std::isnan(PPGrad::bf16ToFloat(PPGrad::floatToBF16(std::nanf("")))));
+    EXPECT_TRUE(std::isinf(PPGrad::bf16ToFloat(PPGrad::floatToBF16(std::numeric_limits<float>::infinity()))));
+}
+
+// -------- Tensor Dataset Tests --------
+
+// Samples written to a dataset file are read back unchanged, also partially.
+TEST(TensorDatasetTest, WriteReadRoundTrip)
+{
+    std::vector<Eigen::Tensor<double, 2>> samples;
+    for (int i = 0; i < 5; i++)
+    {
+        Eigen::Tensor<double, 2> sample(2, 3);
+        sample.setRandom();
+        samples.push_back(sample);
+    }
+    const std::string path = (std::filesystem::temp_directory_path() / "ppgrad_dataset_test.ppds").string();
+    PPGrad::writeTensorDataset<2, double>(path, samples);
+
+    PPGrad::TensorDatasetHeader header = PPGrad::readTensorDatasetHeader(path);
+    EXPECT_EQ(header.count, 5u);
+    EXPECT_EQ(header.elementSize, sizeof(double));
+    EXPECT_EQ(header.sampleElements(), 6u);
+    EXPECT_EQ(std::filesystem::file_size(path), header.dataOffset() + 5 * 6 * sizeof(double));
+
+    std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> all = PPGrad::readTensorDataset<2, double>(path);
+    std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> tail = PPGrad::readTensorDataset<2, double>(path, 3);
+    ASSERT_EQ(all.size(), 5u);
+    ASSERT_EQ(tail.size(), 2u);
+    for (int i = 0; i < 5; i++)
+    {
+        for (int j = 0; j < 2; j++)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                EXPECT_EQ((*all[i]->getData())(j, k), samples[i](j, k));
+                if (i >= 3)
+                {
+                    EXPECT_EQ((*tail[i - 3]->getData())(j, k), samples[i](j, k));
+                }
+            }
+        }
+    }
+
+    // Reading with the wrong element type or dimension is rejected.
+    EXPECT_THROW((PPGrad::checkTensorDatasetHeader<2, float>(header, path)), std::runtime_error);
+    EXPECT_THROW((PPGrad::checkTensorDatasetHeader<3, double>(header, path)), std::runtime_error);
+    EXPECT_NO_THROW((PPGrad::checkTensorDatasetHeader<2, double>(header, path)));
+    std::filesystem::remove(path);
+}
+
+// A mapped dataset views samples and batches in place, and loads batches into reused tensors.
+TEST(TensorDatasetTest, MappedViewsAndLoads)
+{
+    std::vector<Eigen::Tensor<double, 2>> samples;
+    for (int i = 0; i < 6; i++)
+    {
+        Eigen::Tensor<double, 2> sample(2, 1);
+        sample.setValues({{2.0 * i}, {2.0 * i + 1}});
+        samples.push_back(sample);
+    }
+    const std::string path = (std::filesystem::temp_directory_path() / "ppgrad_mapped_dataset_test.ppds").string();
+    PPGrad::writeTensorDataset<2, double>(path, samples);
+    {
+        PPGrad::MappedTensorDataset<2, double> dataset(path);
+        ASSERT_EQ(dataset.size(), 6u);
+        EXPECT_EQ(dataset.sample(4)(1, 0), 9.0);
+        Eigen::TensorMap<const Eigen::Tensor<double, 3>> batch = dataset.batch(2, 5);
+        EXPECT_EQ(batch.dimension(2), 3);
+        EXPECT_EQ(batch(0, 0, 1), 6.0);
+
+        dataset.prefetch({1, 2, 3, 5});
+        std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> loaded;
+        dataset.load({5, 0}, loaded);
+        ASSERT_EQ(loaded.size(), 2u);
+        EXPECT_EQ((*loaded[0]->getData())(1, 0), 11.0);
+        EXPECT_EQ((*loaded[1]->getData())(0, 0), 0.0);
+
+        const double *storage = loaded[0]->getData()->data();
+        dataset.load(3, 4, loaded);
+        ASSERT_EQ(loaded.size(), 1u);
+        EXPECT_EQ(loaded[0]->getData()->data(), storage);
+        EXPECT_EQ((*loaded[0]->getData())(0, 0), 6.0);
+
+        EXPECT_THROW(dataset.sample(6), std::out_of_range);
+        EXPECT_THROW(dataset.batch(4, 7), std::out_of_range);
+        EXPECT_THROW(dataset.load({0, 6}, loaded), std::out_of_range);
+        EXPECT_THROW(dataset.load(5, 7, loaded), std::out_of_range);
+        EXPECT_THROW((PPGrad::MappedTensorDataset<2, float>(path)), std::runtime_error);
+    }
+    std::filesystem::remove(path);
+}
+
+// -------- Distributed Sampler Tests --------
+
+// Every epoch, the ranks split a fresh permutation of all samples into equally sized shares, and every rank computes the same split on its own.
+TEST(DistributedSamplerTest, SplitsFreshPermutationEveryEpoch)
+{
+    const size_t numSamples = 10;
+    const int numReplicas = 3;
+    std::vector<std::vector<size_t>> epochs;
+    for (size_t epoch = 0; epoch < 2; epoch++)
+    {
+        std::vector<size_t> all;
+        for (int rank = 0; rank < numReplicas; rank++)
+        {
+            PPNN::DistributedSampler sampler(numSamples, numReplicas, rank, 7);
+            std::vector<size_t> indices = sampler.indices(epoch);
+            ASSERT_EQ(indices.size(), 4u);
+            EXPECT_EQ(indices, PPNN::DistributedSampler(numSamples, numReplicas, rank, 7).indices(epoch));
+            all.insert(all.end(), indices.begin(), indices.end());
+        }
+
+        // Strided split: the first numSamples entries (rank-major within each position) are a permutation, the rest pads from its beginning.
+        std::vector<size_t> permutation(numSamples + 2);
+        for (size_t i = 0; i < permutation.size(); i++)
+            permutation[i] = all[(i % numReplicas) * 4 + i / numReplicas];
+        std::vector<size_t> sorted(permutation.begin(), permutation.begin() + numSamples);
+        std::sort(sorted.begin(), sorted.end());
+        for (size_t i = 0; i < numSamples; i++)
+            EXPECT_EQ(sorted[i], i);
+        EXPECT_EQ(permutation[10], permutation[0]);
+        EXPECT_EQ(permutation[11], permutation[1]);
+        epochs.push_back(permutation);
+    }
+    EXPECT_NE(epochs[0], epochs[1]);
+
+    // Without shuffling, every rank gets the same strided shard every epoch.
+    EXPECT_EQ(PPNN::DistributedSampler(numSamples, numReplicas, 1, 7, false).indices(5), (std::vector<size_t>{1, 4, 7, 0}));
+    EXPECT_THROW(PPNN::DistributedSampler(numSamples, numReplicas, numReplicas), std::invalid_argument);
+}
+
+// -------- Dataset View Tests --------
+
+// Batches are non-owning slices of the samples (also through an index order), and the last batch holds the remainder.
+TEST(DatasetViewTest, SlicesAndGathersWithoutCopying)
+{
+    std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> samples;
+    for (int i = 0; i < 5; i++)
+    {
+        samples.push_back(PPGrad::Tensor<2, double>::zeros({1, 1}));
+    }
+    PPNN::DatasetView<2, double> view(samples);
+    ASSERT_EQ(view.numBatches(2), 3u);
+    EXPECT_EQ(view.batch(1, 2).size(), 2u);
+    EXPECT_EQ(view.batch(1, 2)[1].get(), samples[3].get());
+    EXPECT_EQ(view.batch(2, 2).size(), 1u);
+    EXPECT_EQ(view.batch(2, 2)[0].get(), samples[4].get());
+    EXPECT_EQ(samples[4].use_count(), 1);
+
+    std::vector<size_t> order = {4, 0, 3};
+    PPNN::DatasetView<2, double> gathered = view.gather(order);
+    EXPECT_EQ(gathered.slice(1, 10).size(), 2u);
+    EXPECT_EQ(gathered.slice(1, 10)[1].get(), samples[3].get());
+    EXPECT_THROW(gathered.gather(order), std::invalid_argument);
+
+    // Training on a sample count that is not a multiple of the batch size visits the remainder as a partial batch.
+    std::shared_ptr<PPNN::Dense<2, double>> model = std::make_shared<PPNN::Dense<2, double>>(1, 1);
+    std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> targets;
+    for (int i = 0; i < 5; i++)
+    {
+        (*samples[i]->getData())(0, 0) = i;
+        targets.push_back(PPGrad::Tensor<2, double>::zeros({1, 1}));
+        (*targets[i]->getData())(0, 0) = 2.0 * i;
+    }
+    PPNN::Trainer<2, double> trainer(model, std::make_shared<PPNN::SGD<2, double>>(0.01), std::make_shared<PPNN::MSE<2, double>>());
+    trainer.train(samples, targets, 500, 2);
+    EXPECT_NEAR((*model->getParams()[0]->getData())(0, 0), 2.0, 1e-2);
+    EXPECT_THROW(trainer.train(samples, view.slice(0, 4), 1, 2), std::invalid_argument);
+}
+
+// -------- Hogwild Tests --------
+
+// A thread's gradient sink takes the gradients of the listed tensors, the shared gradient stays untouched.
+TEST(HogwildTest, GradSinkRedirectsLeafGradients)
+{
+    std::shared_ptr<PPGrad::TensorBase<2, double>> w = PPGrad::Tensor<2, double>::zeros({1, 1}, true);
+    std::shared_ptr<PPGrad::TensorBase<2, double>> x = PPGrad::Tensor<2, double>::zeros({1, 1});
+    (*w->getData())(0, 0) = 2.0;
+    (*x->getData())(0, 0) = 3.0;
+
+    Eigen::Tensor<double, 2> localGrad(1, 1);
+    localGrad.setZero();
+    PPGrad::GradSink<2, double> sink;
+    sink.grads[w.get()] = &localGrad;
+    PPGrad::TensorBase<2, double>::setThreadGradSink(&sink);
+    std::shared_ptr<PPGrad::TensorBase<2, double>> y = w * x;
+    y->getGrad()->setConstant(1.0);
+    PPGrad::TensorBase<2, double>::backward(y);
+    PPGrad::TensorBase<2, double>::setThreadGradSink(nullptr);
+
+    EXPECT_EQ(localGrad(0, 0), 3.0);
+    EXPECT_EQ((*w->getGrad())(0, 0), 0.0);
+}
+
+// Hogwild training of a single dense layer learns to invert the sign of its input.
+TEST(HogwildTest, LearnsSignInversion)
+{
+    std::shared_ptr<PPNN::Dense<2, double>> model = std::make_shared<PPNN::Dense<2, double>>(1, 1);
+    std::shared_ptr<PPNN::Optimizer<2, double>> optimizer = std::make_shared<PPNN::SGD<2, double>>(0.01);
+    std::shared_ptr<PPNN::Loss<2, double>> loss = std::make_shared<PPNN::MSE<2, double>>();
+    std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> inputs;
+    std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> targets;
+    for (int i = 0; i < 101; i++)
+    {
+        std::shared_ptr<PPGrad::TensorBase<2, double>> input = PPGrad::Tensor<2, double>::zeros({1, 1});
+        std::shared_ptr<PPGrad::TensorBase<2, double>> target = PPGrad::Tensor<2, double>::zeros({1, 1});
+        (*input->getData())(0, 0) = (i - 50) / 25.0;
+        (*target->getData())(0, 0) = -(i - 50) / 25.0;
+        inputs.push_back(input);
+        targets.push_back(target);
+    }
+
+    PPNN::Trainer<2, double> trainer(model, optimizer, loss);
+    trainer.setHogwild();
+    trainer.train(inputs, targets, 50, 4);
+    EXPECT_NEAR((*model->getParams()[0]->getData())(0, 0), -1.0, 1e-3);
+    EXPECT_NEAR((*model->getParams()[1]->getData())(0, 0), 0.0, 1e-3);
+
+    // Hogwild applies the SGD step itself, so other optimizers are rejected.
+    std::shared_ptr<PPNN::Optimizer<2, double>> nesterov = std::make_shared<PPNN::NesterovSGD<2, double>>(0.01);
+    PPNN::Trainer<2, double> nesterovTrainer(model, nesterov, loss);
+    EXPECT_THROW(nesterovTrainer.setHogwild(), std::invalid_argument);
+}
+
+// -------- Optimizer Tests --------
+
+// The fused AdamW step matches the textbook formulas, zeroes the gradients and gives the same result when split across threads.
+TEST(OptimizerTest, FusedAdamWMatchesReference)
+{
+    const double lr = 0.01, beta1 = 0.9, beta2 = 0.999, eps = 1e-8, decay = 0.1;
+    std::shared_ptr<PPNN::Dense<2, double>> model = std::make_shared<PPNN::Dense<2, double>>(300, 200);
+    std::shared_ptr<PPNN::Dense<2, double>> parallelModel = std::make_shared<PPNN::Dense<2, double>>(300, 200);
+    PPNN::AdamW<2, double> adam(lr, decay);
+    PPNN::AdamW<2, double> parallelAdam(lr, decay);
+
+    Eigen::Tensor<double, 2> W = *model->getParams()[0]->getData();
+    Eigen::Tensor<double, 2> m(W.dimensions()), v(W.dimensions());
+    m.setZero();
+    v.setZero();
+    const size_t minElements = PPNN::Adam<2, double>::parallelMinElements;
+    const int threads = omp_get_max_threads();
+    for (int t = 1; t <= 3; t++)
+    {
+        Eigen::Tensor<double, 2> grad(W.dimensions());
+        grad.setRandom();
+        for (std::shared_ptr<PPGrad::TensorBase<2, double>> &param : model->getParams())
+            param->getGrad()->setConstant(0.5);
+        for (std::shared_ptr<PPGrad::TensorBase<2, double>> &param : parallelModel->getParams())
+            param->getGrad()->setConstant(0.5);
+        *model->getParams()[0]->getGrad() = grad;
+        *parallelModel->getParams()[0]->getGrad() = grad;
+
+        // Reference step
+        m = beta1 * m + (1 - beta1) * grad;
+        v = beta2 * v + (1 - beta2) * grad.square();
+        Eigen::Tensor<double, 2> mHat = m / (1 - std::pow(beta1, t));
+        Eigen::Tensor<double, 2> vHat = v / (1 - std::pow(beta2, t));
+        W = W * (1 - lr * decay) - lr * (mHat / (vHat.sqrt() + eps));
+
+        PPNN::Adam<2, double>::parallelMinElements = SIZE_MAX;
+        adam.update(model->getParams());
+        PPNN::Adam<2, double>::parallelMinElements = 0;
+        omp_set_num_threads(4);
+        parallelAdam.update(parallelModel->getParams());
+        omp_set_num_threads(threads);
+    }
+    PPNN::Adam<2, double>::parallelMinElements = minElements;
+
+    Eigen::Tensor<double, 0> diff = (*model->getParams()[0]->getData() - W).abs().maximum();
+    EXPECT_LT(diff(), 1e-12);
+    for (size_t i = 0; i < model->getParams().size(); i++)
+    {
+        Eigen::Tensor<double, 0> parallelDiff = (*model->getParams()[i]->getData() - *parallelModel->getParams()[i]->getData()).abs().maximum();
+        EXPECT_EQ(parallelDiff(), 0.0);
+        Eigen::Tensor<double, 0> grad = model->getParams()[i]->getGrad()->abs().maximum();
+        EXPECT_EQ(grad(), 0.0);
+    }
+}
+
+// -------- Checkpoint Tests --------
+
+// Parameters, Adam's moments and step and the counters survive a save/load round trip.
+TEST(CheckpointTest, SaveLoadRoundTrip)
+{
+    std::shared_ptr<PPNN::Dense<2, double>> model = std::make_shared<PPNN::Dense<2, double>>(3, 2);
+    PPNN::Adam<2, double> adam(0.01);
+    for (int step = 0; step < 3; step++)
+    {
+        for (std::shared_ptr<PPGrad::TensorBase<2, double>> &param : model->getParams())
+        {
+            param->getGrad()->setRandom();
+        }
+        adam.update(model->getParams());
+    }
+
+    PPNN::Checkpoint<2, double> checkpoint;
+    checkpoint.counters.emplace_back("epoch", 7);
+    checkpoint.addParams(model->getParams());
+    checkpoint.addOptimizer("optimizer", adam);
+    const std::string path = (std::filesystem::temp_directory_path() / "ppgrad_checkpoint_test.ckpt").string();
+    PPNN::saveCheckpoint<2, double>(path, checkpoint);
+    EXPECT_FALSE(std::filesystem::exists(path + ".tmp"));
+
+    std::shared_ptr<PPNN::Dense<2, double>> restored = std::make_shared<PPNN::Dense<2, double>>(3, 2);
+    PPNN::Adam<2, double> restoredAdam(0.01);
+    PPNN::Checkpoint<2, double> loaded = PPNN::loadCheckpoint<2, double>(path);
+    loaded.restoreParams(restored->getParams());
+    loaded.restoreOptimizer("optimizer", restoredAdam);
+    std::filesystem::remove(path);
+
+    EXPECT_EQ(loaded.counter("epoch"), 7);
+    EXPECT_EQ(restoredAdam.getStep(), 3);
+    for (size_t i = 0; i < model->getParams().size(); i++)
+    {
+        Eigen::Tensor<double, 0> diff = (*model->getParams()[i]->getData() - *restored->getParams()[i]->getData()).abs().maximum();
+        EXPECT_EQ(diff(), 0.0);
+    }
+    PPNN::OptimizerState<2, double> state = adam.getState();
+    PPNN::OptimizerState<2, double> restoredState = restoredAdam.getState();
+    ASSERT_EQ(state.size(), 4u);
+    ASSERT_EQ(restoredState.size(), 4u);
+    for (size_t i = 0; i < state.size(); i++)
+    {
+        EXPECT_EQ(state[i].first, restoredState[i].first);
+        Eigen::Tensor<double, 0> diff = (*state[i].second - *restoredState[i].second).abs().maximum();
+        EXPECT_EQ(diff(), 0.0);
+    }
+
+    // A model of a different shape is rejected.
+    std::shared_ptr<PPNN::Dense<2, double>> other = std::make_shared<PPNN::Dense<2, double>>(2, 2);
+    EXPECT_THROW(loaded.restoreParams(other->getParams()), std::runtime_error);
+}
+
+// Payloads are 64-byte aligned and viewable in place, saveModel/loadModel round-trip and a corrupted payload is detected.
+TEST(CheckpointTest, MappedAlignedAndVerified)
+{
+    std::shared_ptr<PPNN::Dense<2, double>> model = std::make_shared<PPNN::Dense<2, double>>(5, 3);
+    const std::string path = (std::filesystem::temp_directory_path() / "ppgrad_mapped_test.ckpt").string();
+    PPNN::saveModel<2, double>(path, *model);
+
+    {
+        PPNN::MappedCheckpoint<2, double> mapped(path);
+        ASSERT_EQ(mapped.getEntries().size(), 2u);
+        for (const PPNN::CheckpointEntry &entry : mapped.getEntries())
+        {
+            EXPECT_EQ(entry.offset % PPNN::CheckpointHeader::ALIGNMENT, 0u);
+            EXPECT_TRUE(mapped.verify(entry));
+        }
+        Eigen::TensorMap<const Eigen::Tensor<double, 2>> W = mapped.view("param0");
+        ASSERT_EQ(W.dimension(0), 3);
+        ASSERT_EQ(W.dimension(1), 5);
+        EXPECT_EQ(W(2, 4), (*model->getParams()[0]->getData())(2, 4));
+        EXPECT_THROW((PPNN::MappedCheckpoint<2, float>(path).view("param0")), std::runtime_error);
+    }
+
+    std::shared_ptr<PPNN::Dense<2, double>> restored = std::make_shared<PPNN::Dense<2, double>>(5, 3);
+    PPNN::loadModel<2, double>(path, *restored);
+    Eigen::Tensor<double, 0> diff = (*model->getParams()[0]->getData() - *restored->getParams()[0]->getData()).abs().maximum();
+    EXPECT_EQ(diff(), 0.0);
+
+    // Flip a byte of the last payload.
+    const uint64_t offset = PPNN::MappedCheckpoint<2, double>(path).getEntries().back().offset;
+    {
+        std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(offset);
+        file.put(0x55);
+    }
+    EXPECT_THROW((PPNN::loadCheckpoint<2, double>(path)), std::runtime_error);
+    std::filesystem::remove(path);
+}
+
+#ifdef USE_MPI
+// -------- MPI Tests (built with `make tests CXX=mpic++`) --------
+
+// Initializes MPI (for the master thread, like the trainers) around all tests.
+class MPIEnvironment : public ::testing::Environment
+{
+public:
+    void SetUp() override
+    {
+        int provided;
+        MPI_Init_thread(nullptr, nullptr, MPI_THREAD_FUNNELED, &provided);
+    }
+
+    void TearDown() override
+    {
+        MPI_Finalize();
+    }
+};
+
+static ::testing::Environment *const mpiEnvironment = ::testing::AddGlobalTestEnvironment(new MPIEnvironment);
+
+// A sync without a backward() in between (e.g., DPTrainer's last sync) reduces the current gradients instead of re-applying the previous result.
+TEST(GradSynchronizerTest, FinishWithoutBackwardReducesCurrentGradients)
+{
+    int worldSize;
+    MPI_Comm_size(MPI_COMM_WORLD, &worldSize);
+    std::shared_ptr<PPGrad::TensorBase<2, double>> param = PPGrad::Tensor<2, double>::zeros({4, 3}, true);
+    std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> params = {param};
+    PPNN::GradSynchronizer<2, double> synchronizer(params, 32);
+
+    synchronizer.beginBackward(1, true);
+    Eigen::Tensor<double, 2> grad(4, 3);
+    grad.setConstant(2.0);
+    param->addGrad(std::make_shared<Eigen::Tensor<double, 2>>(grad));
+    synchronizer.endBackward();
+    synchronizer.finish(1.0 / worldSize);
+    Eigen::Tensor<double, 0> maxGrad = param->getGrad()->maximum();
+    EXPECT_DOUBLE_EQ(maxGrad(), 2.0);
+
+    param->zeroGrad();
+    synchronizer.finish(1.0 / worldSize);
+    Eigen::Tensor<double, 0> maxAbsGrad = param->getGrad()->abs().maximum();
+    EXPECT_EQ(maxAbsGrad(), 0.0);
+}
+
+// The low-precision reducers round every gradient and the reduced result once, so they stay within two 16-bit roundings of a double allreduce
+// (also with several buckets in flight).
+TEST(GradReducerTest, LowPrecisionMatchesDoubleAllreduce)
+{
+    int worldSize, worldRank;
+    MPI_Comm_size(MPI_COMM_WORLD, &worldSize);
+    MPI_Comm_rank(MPI_COMM_WORLD, &worldRank);
+    const size_t size = 1000;
+    std::vector<double> local(size);
+    for (size_t i = 0; i < size; i++)
+    {
+        local[i] = (1.0 + (double)((i * 7 + worldRank) % 13)) * std::pow(10.0, -(double)(i % 4) - 1.0);
+    }
+    std::vector<double> expected(size);
+    MPI_Allreduce(local.data(), expected.data(), size, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+
+    for (PPNN::CommPrecisions precision : {PPNN::CommPrecisions::BF16, PPNN::CommPrecisions::FP16})
+    {
+        const double unitRoundoff = precision == PPNN::CommPrecisions::BF16 ? std::pow(2.0, -8) : std::pow(2.0, -11);
+        PPNN::LowPrecisionReducer<double> reducer(precision);
+        std::vector<PPNN::GradBucket<double>> buckets(3);
+        for (size_t b = 0; b < buckets.size(); b++)
+        {
+            buckets[b].size = size;
+            buckets[b].buffers.assign(1, local);
+            reducer.start(buckets[b], b, 0, MPI_COMM_WORLD);
+            reducer.progress();
+        }
+        for (size_t b = 0; b < buckets.size(); b++)
+        {
+            reducer.finish(buckets[b], b, 0);
+            for (size_t i = 0; i < size; i++)
+            {
+                EXPECT_NEAR(buckets[b].buffers[0][i], expected[i], 2.01 * unitRoundoff * expected[i]) << "bucket " << b << ", element " << i;
+            }
+        }
+    }
+}
+
+// Regression test for ring tags repeating every 512 buckets and for receive buffers sized by segments: many more than 512 small rings are in flight at once,
+// with chunks much smaller than a segment, and every element has to match MPI_Allreduce.
+TEST(GradReducerTest, RingMatchesAllreduceWithManySmallBucketsInFlight)
+{
+    int worldRank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &worldRank);
+    const size_t numBuckets = 1200;
+    PPNN::RingReducer<double> reducer(64);
+    std::vector<PPNN::GradBucket<double>> buckets(numBuckets);
+    std::vector<std::vector<double>> expected(numBuckets);
+    for (size_t b = 0; b < numBuckets; b++)
+    {
+        buckets[b].size = 3 + b % 9;
+        buckets[b].buffers.assign(1, std::vector<double>(buckets[b].size));
+        for (size_t i = 0; i < buckets[b].size; i++)
+        {
+            buckets[b].buffers[0][i] = (double)((worldRank + 1) * (b * 16 + i) % 1021);
+        }
+        expected[b].resize(buckets[b].size);
+        MPI_Allreduce(buckets[b].buffers[0].data(), expected[b].data(), buckets[b].size, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    }
+
+    for (size_t b = 0; b < numBuckets; b++)
+    {
+        reducer.start(buckets[b], b, 0, MPI_COMM_WORLD);
+    }
+    reducer.progress();
+    size_t wrong = 0;
+    for (size_t b = 0; b < numBuckets; b++)
+    {
+        reducer.finish(buckets[b], b, 0);
+        for (size_t i = 0; i < buckets[b].size; i++)
+        {
+            wrong += buckets[b].buffers[0][i] != expected[b][i] ? 1 : 0;
+        }
+    }
+    EXPECT_EQ(wrong, 0u);
+}
+
+// The collectives of tensor-parallel layers run on the calling thread even when parallel backward() is enabled for their graph size, also from within an
+// inactive parallel region (as DPTrainer runs the samples of such models), and yield the sequential gradients.
+TEST(TensorParallelTest, BackwardStaysSequential)
+{
+    PPNN::ColumnParallelDense<2, double> column(4, 8, MPI_COMM_WORLD, false, PPNN::WeightInititializers::XAVIER, PPNN::Activations::ReLU);
+    PPNN::RowParallelDense<2, double> row(8, 3, MPI_COMM_WORLD, true);
+    std::shared_ptr<PPGrad::TensorBase<2, double>> x = PPGrad::Tensor<2, double>::zeros({4, 1}, true);
+    x->getData()->setConstant(0.5);
+    std::function<void()> differentiate = [&]()
+    {
+        std::shared_ptr<PPGrad::TensorBase<2, double>> y = row.forward(column.forward(x));
+        y->getGrad()->setConstant(1.0);
+        PPGrad::TensorBase<2, double>::backward(y);
+    };
+
+    PPGrad::TensorBase<2, double>::setParallelBackward(SIZE_MAX);
+    differentiate();
+    Eigen::Tensor<double, 2> expected = *x->getGrad();
+    x->zeroGrad();
+
+    const int threads = omp_get_max_threads();
+    omp_set_num_threads(4);
+    PPGrad::TensorBase<2, double>::setParallelBackward(1);
+    differentiate();
+    Eigen::Tensor<double, 0> diff = (*x->getGrad() - expected).abs().maximum();
+    EXPECT_EQ(diff(), 0.0);
+    x->zeroGrad();
+#pragma omp parallel if (false)
+    differentiate();
+    diff = (*x->getGrad() - expected).abs().maximum();
+    EXPECT_EQ(diff(), 0.0);
+    omp_set_num_threads(threads);
+    PPGrad::TensorBase<2, double>::setParallelBackward(256);
+}
+
+// A dataset file shorter than its header says is rejected instead of filling the shard with garbage.
+TEST(TensorDatasetTest, ShardReadRejectsTruncatedFile)
+{
+    int worldSize, worldRank;
+    MPI_Comm_size(MPI_COMM_WORLD, &worldSize);
+    MPI_Comm_rank(MPI_COMM_WORLD, &worldRank);
+    const std::string path = (std::filesystem::temp_directory_path() / ("ppgrad_truncated_test" + std::to_string(worldRank) + ".bin")).string();
+    std::vector<Eigen::Tensor<double, 2>> samples(6, Eigen::Tensor<double, 2>(2, 1));
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        samples[i].setConstant((double)i);
+    }
+    PPGrad::writeTensorDataset<2, double>(path, samples);
+
+    std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> shard = PPGrad::readTensorShard<2, double>(path, 1, 0, PPGrad::ShardModes::CONTIGUOUS, MPI_COMM_SELF);
+    ASSERT_EQ(shard.size(), 6u);
+    EXPECT_EQ((*shard[5]->getData())(1, 0), 5.0);
+
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - sizeof(double));
+    EXPECT_THROW((PPGrad::readTensorShard<2, double>(path, 1, 0, PPGrad::ShardModes::CONTIGUOUS, MPI_COMM_SELF)), std::runtime_error);
+    std::filesystem::remove(path);
+}
+
+// Shards split the remainder like tensorScatterv: every sample ends up on exactly one rank, in both sharding modes.
+TEST(TensorDatasetTest, ShardReadKeepsRemainder)
+{
+    int worldRank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &worldRank);
+    const std::string path = (std::filesystem::temp_directory_path() / ("ppgrad_remainder_test" + std::to_string(worldRank) + ".bin")).string();
+    std::vector<Eigen::Tensor<double, 2>> samples(10, Eigen::Tensor<double, 2>(2, 1));
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        samples[i].setConstant((double)i);
+    }
+    PPGrad::writeTensorDataset<2, double>(path, samples);
+
+    // The layout only depends on the given world size & rank, so a single process can read the shards of all (simulated) ranks.
+    const int shardRanks = 4;
+    for (PPGrad::ShardModes mode : {PPGrad::ShardModes::CONTIGUOUS, PPGrad::ShardModes::STRIDED})
+    {
+        std::vector<double> seen;
+        for (int r = 0; r < shardRanks; r++)
+        {
+            std::vector<std::shared_ptr<PPGrad::TensorBase<2, double>>> shard = PPGrad::readTensorShard<2, double>(path, shardRanks, r, mode, MPI_COMM_SELF);
+            EXPECT_EQ(shard.size(), r < 2 ? 3u : 2u);
+            for (size_t i = 0; i < shard.size(); i++)
+            {
+                const double value = (*shard[i]->getData())(0, 0);
+                EXPECT_EQ((*shard[i]->getData())(1, 0), value);
+                EXPECT_EQ(value, mode == PPGrad::ShardModes::CONTIGUOUS ? (double)(r * 2 + std::min(r, 2) + i) : (double)(r + i * shardRanks));
+                seen.push_back(value);
+            }
+        }
+        std::sort(seen.begin(), seen.end());
+        ASSERT_EQ(seen.size(), samples.size());
+        for (size_t i = 0; i < seen.size(); i++)
+        {
+            EXPECT_EQ(seen[i], (double)i);
+        }
+    }
+    std::filesystem::remove(path);
+}
+#endif